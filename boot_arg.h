@@ -11,6 +11,7 @@ extern "C" {
 #define BOOT_ARG_START_BOOTLOADER_NO_TIMEOUT    0x01
 #define BOOT_ARG_START_APPLICATION              0x02
 #define BOOT_ARG_START_ST_BOOTLOADER            0x03
+#define BOOT_ARG_START_BOOTLOADER_LONG_TIMEOUT  0x04
 
 void reboot_system(uint8_t arg);
 
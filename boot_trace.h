@@ -0,0 +1,110 @@
+/**
+ * Boot phase trace
+ *
+ * The bootloader records a cycle counter timestamp at the end of each boot phase
+ * into a small buffer in RAM, which is neither initialized by the bootloader
+ * nor by the application. The buffer is located directly after the two
+ * boot argument words at the beginning of RAM.
+ *
+ * This header can be included by the application in order to read the trace.
+ * The application's linker script must then reserve the beginning of RAM
+ * (BOOT_TRACE_RESERVED_SIZE bytes), like the bootloader's linker script does.
+ */
+
+#ifndef BOOT_TRACE_H
+#define BOOT_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+/** Marks a trace buffer as initialized */
+#define BOOT_TRACE_MAGIC            0xb0075ace
+
+/** Maximum number of recorded phases */
+#define BOOT_TRACE_LENGTH           16
+
+/** Number of bytes at the beginning of RAM reserved for boot arguments and trace */
+#define BOOT_TRACE_RESERVED_SIZE    256
+
+
+/**
+ * Boot phases, each recorded upon completion
+ */
+typedef enum {
+    /** Platform startup, i.e. the cycle counter was started */
+    BOOT_TRACE_RESET = 0,
+    /** System clock configured */
+    BOOT_TRACE_CLOCK = 1,
+    /** CAN peripheral initialized */
+    BOOT_TRACE_CAN_INIT = 2,
+    /** Config pages validated and read */
+    BOOT_TRACE_CONFIG = 3,
+    /** Listen window respectively bootloader timeout elapsed */
+    BOOT_TRACE_LISTEN = 4,
+    /** Application checksum verified (or verified marker found) */
+    BOOT_TRACE_APP_CRC = 5,
+    /** Reboot into the application requested */
+    BOOT_TRACE_JUMP = 6,
+} boot_trace_phase_t;
+
+
+typedef struct {
+    uint32_t phase;
+    uint32_t cycles;
+} boot_trace_entry_t;
+
+
+typedef struct {
+    /** Equals BOOT_TRACE_MAGIC, if the trace is valid */
+    uint32_t magic;
+    /** Number of valid entries */
+    uint32_t count;
+    boot_trace_entry_t entries[BOOT_TRACE_LENGTH];
+} boot_trace_t;
+
+
+/**
+ * Returns the trace buffer for a given start of RAM
+ *
+ * @retval NULL No valid trace was found
+ */
+static inline const boot_trace_t *boot_trace_at(void *ram_begin)
+{
+    const boot_trace_t *trace = (const boot_trace_t *) ((uint32_t *) ram_begin + 2);
+    if (trace->magic != BOOT_TRACE_MAGIC || trace->count > BOOT_TRACE_LENGTH) {
+        return NULL;
+    }
+    return trace;
+}
+
+
+/**
+ * Discards the recorded trace and begins a new one
+ */
+void boot_trace_start(void);
+
+/**
+ * Records the current cycle counter value for the given phase
+ *
+ * Records exceeding BOOT_TRACE_LENGTH are dropped.
+ */
+void boot_trace_record(boot_trace_phase_t phase);
+
+/**
+ * Returns the trace of the current boot
+ *
+ * @retval NULL Tracing is not supported on this platform
+ */
+const boot_trace_t *boot_trace_get(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BOOT_TRACE_H */
@@ -11,9 +11,14 @@
 #include "command.h"
 #include "can_datagram.h"
 #include "config.h"
+#include "config_storage.h"
 #include "boot_arg.h"
+#include "boot_trace.h"
 #include "timeout.h"
 #include "can_interface.h"
+#include "cycle_counter.h"
+#include "profiling.h"
+#include "command_queue.h"
 
 #include <cmp_mem_access/cmp_mem_access.h>
 
@@ -79,10 +84,28 @@ static void return_datagram(uint8_t source_id, uint8_t dest_id, uint8_t *data, s
 }
 
 
+/**
+ * Busy waits until the given reply slot begins
+ *
+ * @param start     Cycle counter value at the beginning of the first slot
+ * @param slot      Number of slots to wait
+ */
+static void wait_for_reply_slot(uint32_t start, uint8_t slot)
+{
+    // Waiting slot by slot keeps the cycle differences far from overflowing
+    uint32_t slot_cycles = (cycle_counter_get_frequency() / 1000000) * REPLY_SLOT_DURATION_US;
+
+    while (slot-- > 0) {
+        while ((cycle_counter_get() - start) < slot_cycles);
+        start += slot_cycles;
+    }
+}
+
+
 /**
  * Send complaint datagram to bootloader client about malformed received datagram
  */
-static void return_error_datagram(uint8_t source_id, uint8_t* output_buf, uint8_t error_code)
+static void return_error_datagram(uint8_t source_id, uint8_t dest_id, uint8_t* output_buf, uint8_t error_code)
 {
     cmp_mem_access_t out_cma;
     cmp_ctx_t out_writer;
@@ -99,13 +122,218 @@ static void return_error_datagram(uint8_t source_id, uint8_t* output_buf, uint8_
     // Send our reply via CAN
     return_datagram(
             source_id & (~ID_START_MASK),
-            0,
+            dest_id,
             output_buf,
             (size_t) reply_length
             );
 }
 
 
+/**
+ * Reception state of a datagram buffer
+ */
+typedef enum {
+    DATAGRAM_BUFFER_FREE,
+    DATAGRAM_BUFFER_RECEIVING,
+    DATAGRAM_BUFFER_READY
+} datagram_buffer_state_t;
+
+
+/**
+ * Reception buffer of one datagram, i.e. the reassembly context of one source
+ */
+typedef struct {
+    /**
+     * Struct to store the properties of an incoming datagram
+     */
+    can_datagram_t dt;
+    /**
+     * Buffer storing the encoded destination nodes of a datagram
+     * (list, bitmap or ranges, see can_datagram.h)
+     */
+    uint8_t addr_buf[128];
+    /**
+     * Buffer to store an incoming datagram
+     */
+    uint8_t data_buf[INPUT_BUFFER_SIZE];
+    datagram_buffer_state_t state;
+    /**
+     * Source ID of the datagram's frames, i.e. of the client to reply to
+     */
+    uint8_t source;
+    /**
+     * Time of the last frame received for the datagram in milliseconds, see get_time()
+     */
+    uint32_t last_frame;
+    /**
+     * Number of the datagram in order of completion
+     */
+    uint32_t sequence;
+    /**
+     * Cycles spent on receiving and reassembling the datagram
+     */
+    uint32_t reassembly_cycles;
+} datagram_buffer_t;
+
+
+/**
+ * Determines, whether a CAN frame was sent by a client to the bootloaders,
+ * i.e. whether its source is ID 0, a reserved client ID (see CLIENT_ID_MIN) or this node's ID
+ */
+static bool is_client_frame(uint32_t id, uint8_t node_id)
+{
+    uint32_t source = id & ~ID_START_MASK;
+
+    return source == 0
+        || source == node_id
+        || (source >= CLIENT_ID_MIN && source < CAN_DATAGRAM_NODE_COUNT);
+}
+
+
+/**
+ * Returns the buffer in the given state, which was least recently used,
+ * i.e. the oldest complete datagram or the datagram received longest ago, or NULL
+ */
+static datagram_buffer_t *least_recent_buffer(datagram_buffer_t *buffers, datagram_buffer_state_t state)
+{
+    datagram_buffer_t *found = NULL;
+    uint32_t now = get_time();
+
+    for (uint8_t i = 0; i < DATAGRAM_BUFFER_COUNT; i++) {
+        datagram_buffer_t *buffer = &buffers[i];
+        if (buffer->state != state) {
+            continue;
+        }
+        if (found == NULL
+         || (state == DATAGRAM_BUFFER_READY && buffer->sequence < found->sequence)
+         || (state != DATAGRAM_BUFFER_READY && (now - buffer->last_frame) > (now - found->last_frame))) {
+            found = buffer;
+        }
+    }
+    return found;
+}
+
+
+/**
+ * Returns the buffer reassembling a datagram of the given source, or NULL
+ */
+static datagram_buffer_t *receiving_buffer(datagram_buffer_t *buffers, uint8_t source)
+{
+    for (uint8_t i = 0; i < DATAGRAM_BUFFER_COUNT; i++) {
+        if (buffers[i].state == DATAGRAM_BUFFER_RECEIVING && buffers[i].source == source) {
+            return &buffers[i];
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * Returns true, if this node's ID, device class or group is amongst the datagram's targets
+ */
+static bool datagram_is_addressed(can_datagram_t *dt, bootloader_config_t *config)
+{
+    return can_datagram_is_addressed(dt, config->ID)
+        || can_datagram_is_class_addressed(dt, config->device_class)
+        || can_datagram_is_group_addressed(dt, config->group);
+}
+
+
+/**
+ * Executes the commands of a complete and valid datagram,
+ * if it addresses this node, and replies to its sender
+ *
+ * @return  true, if this node was addressed
+ */
+static bool execute_datagram(datagram_buffer_t *buffer, bootloader_config_t *config, uint8_t *output_buf)
+{
+    can_datagram_t *dt = &buffer->dt;
+
+    if (!datagram_is_addressed(dt, config)) {
+        return false;
+    }
+
+    // Allows flash commands to omit the device class
+    command_set_device_class_addressed(can_datagram_is_class_addressed(dt, config->device_class));
+
+    // Sequenced commands are cached per client
+    command_set_source(buffer->source);
+
+    // we were addressed
+    int reply_length = execute_datagram_commands(
+            (char*) dt->data,
+            dt->data_len,
+            &commands[0],
+            sizeof(commands)/sizeof(command_t),
+            (char*) output_buf,
+            OUTPUT_BUFFER_SIZE,
+            config
+            );
+
+    command_set_device_class_addressed(false);
+
+    // Attributed to the command selected during execution
+    profiling_record(PROFILING_PHASE_REASSEMBLY, buffer->reassembly_cycles);
+
+    // Quiet datagrams are only answered, if the command failed
+    bool quiet = (dt->destination_flags & CAN_DATAGRAM_FLAG_QUIET)
+              && command_reply_is_success((char *) output_buf, reply_length);
+
+    if (!quiet && (dt->destination_flags & CAN_DATAGRAM_FLAG_SLOTTED_REPLY)) {
+        // Avoid colliding with the replies of the other addressed nodes
+        wait_for_reply_slot(cycle_counter_get(), can_datagram_reply_slot(dt, config->ID));
+    }
+
+    if (quiet) {
+        set_status(SUCCESS);
+        led_on(LED_SUCCESS);
+
+    } else if (reply_length > 0) {
+        // The reply's CAN frame ID must not occupy start mask bits.
+        uint8_t return_id = buffer->source;
+
+        // Send the reply as generated by the corresponding command function
+        uint32_t reply_start = cycle_counter_get();
+        return_datagram(
+                config->ID,
+                return_id,
+                output_buf,
+                (size_t) reply_length
+                );
+        profiling_record(PROFILING_PHASE_REPLY, cycle_counter_get() - reply_start);
+        set_status(SUCCESS);
+        led_on(LED_SUCCESS);
+
+    } else {
+        // A negative return value represents an error code.
+        return_error_datagram(
+                config->ID,
+                buffer->source,
+                output_buf,
+                (-reply_length)
+                );
+        set_status(-reply_length);
+        led_on(LED_ERROR);
+    }
+
+    return true;
+}
+
+
+/**
+ * Executes the oldest complete datagram and frees its buffer
+ *
+ * @return  true, if this node was addressed
+ */
+static bool execute_oldest_datagram(datagram_buffer_t *buffers, bootloader_config_t *config, uint8_t *output_buf)
+{
+    datagram_buffer_t *buffer = least_recent_buffer(buffers, DATAGRAM_BUFFER_READY);
+    bool addressed = execute_datagram(buffer, config, output_buf);
+    buffer->state = DATAGRAM_BUFFER_FREE;
+    return addressed;
+}
+
+
 void bootloader_main(int arg)
 {
     /**
@@ -133,14 +361,9 @@ void bootloader_main(int arg)
      * Struct holding the bootloader's configuration
      */
     bootloader_config_t config;
-    if (config_is_valid(memory_get_config1_addr(), CONFIG_PAGE_SIZE)) {
-        // Read configuration from first configuration page
-        config = config_read(memory_get_config1_addr(), CONFIG_PAGE_SIZE);
-    } else if (config_is_valid(memory_get_config2_addr(), CONFIG_PAGE_SIZE)) {
-        // Read configuration from second configuration page
-        config = config_read(memory_get_config2_addr(), CONFIG_PAGE_SIZE);
-    } else {
+    if (!config_load(&config)) {
         // No valid configuration page found: Create new
+        memset(&config, 0, sizeof(config));
         strcpy(config.device_class, PLATFORM_DEVICE_CLASS);
         strcpy(config.board_name, PLATFORM_DEFAULT_NAME);
         config.ID = PLATFORM_DEFAULT_ID;
@@ -156,18 +379,20 @@ void bootloader_main(int arg)
     config.bootloader_commit = BOOTLOADER_COMMIT;
     config.bootloader_version = BOOTLOADER_VERSION;
 
+    boot_trace_record(BOOT_TRACE_CONFIG);
+
     /**
-     * Struct to store the properties of an incoming datagram
-     */
-    can_datagram_t dt;
-    /**
-     * Buffer storing the list of destination nodes of a datagram
+     * Datagram reception buffers: Datagrams of different sources are reassembled
+     * into separate buffers, while complete datagrams wait for execution.
+     *
+     * Static rather than on the stack, so that buffers exceeding the RAM
+     * fail at link time instead of overflowing the stack at runtime.
      */
-    uint8_t addr_buf[128];
+    static datagram_buffer_t buffers[DATAGRAM_BUFFER_COUNT];
     /**
-     * Buffer to store an incoming datagram
+     * Number of datagrams completed so far
      */
-    uint8_t data_buf[INPUT_BUFFER_SIZE];
+    uint32_t completed_count = 0;
     /**
      * Buffer to store the (at max.) 8 data bytes of the received CAN frame
      */
@@ -183,21 +408,17 @@ void bootloader_main(int arg)
     /**
      * Buffer for the construction of the response datagram
      */
-    uint8_t output_buf[OUTPUT_BUFFER_SIZE];
-    /**
-     * Size of the response datagram in bytes
-     */
-    uint8_t reply_length;
-    /**
-     * Switch to enable/disable datagram timeout timer
-     * This timeout is running, as soon as a start frame was received.
-     */
-    bool datagram_timeout_running = false;
+    static uint8_t output_buf[OUTPUT_BUFFER_SIZE];
 
-    can_datagram_init(&dt);
-    can_datagram_set_address_buffer(&dt, addr_buf);
-    can_datagram_set_data_buffer(&dt, data_buf, INPUT_BUFFER_SIZE);
-    can_datagram_start(&dt);
+    for (uint8_t i = 0; i < DATAGRAM_BUFFER_COUNT; i++) {
+        can_datagram_init(&buffers[i].dt);
+        can_datagram_set_address_buffer(&buffers[i].dt, buffers[i].addr_buf);
+        can_datagram_set_data_buffer(&buffers[i].dt, buffers[i].data_buf, INPUT_BUFFER_SIZE);
+        buffers[i].state = DATAGRAM_BUFFER_FREE;
+    }
+
+    command_queue_init();
+    command_sequenced_reset();
 
     /**
      * Configure CAN peripheral to receive only broadcast frames
@@ -210,25 +431,55 @@ void bootloader_main(int arg)
      */
     bootloader_timeout_start();
 
+    #ifdef BOOTLOADER_LISTEN_WINDOW
+    /**
+     * Switch determining whether only the short listen window is running,
+     * which is extended to the full timeout by the first bootloader frame
+     */
+    bool listen_window_running = (arg != BOOT_ARG_START_BOOTLOADER_LONG_TIMEOUT);
+    if (listen_window_running) {
+        bootloader_timeout_set(BOOTLOADER_LISTEN_WINDOW);
+    }
+    #endif
+
     /*
      * Remain in the bootloader until either timeout is reached or a jump
      * to the main application is requested via the appropriate CAN command.
      */
     while (true) {
         if (bootloader_timeout_enabled && bootloader_timeout_reached()) {
+            boot_trace_record(BOOT_TRACE_LISTEN);
             command_jump_to_application(0, NULL, NULL, &config);
         }
 
-        if (datagram_timeout_running && datagram_timeout_reached()) {
-            // Inform client about timeout
-            return_error_datagram(config.ID, output_buf, ERROR_DATAGRAM_TIMEOUT);
-            set_status(ERROR_DATAGRAM_TIMEOUT);
-            // Begin new empty datagram in order to avoid possible datagram duplication
-            can_datagram_start(&dt);
-            // Stop timeout timer; will be started by next datagram start frame
-            datagram_timeout_running = false;
+        bool receiving = false;
+        for (uint8_t i = 0; i < DATAGRAM_BUFFER_COUNT; i++) {
+            datagram_buffer_t *buffer = &buffers[i];
+            if (buffer->state != DATAGRAM_BUFFER_RECEIVING) {
+                continue;
+            }
 
-            led_on(LED_ERROR);
+            if ((get_time() - buffer->last_frame) >= DATAGRAM_TIMEOUT) {
+                // Inform client about timeout
+                return_error_datagram(config.ID, buffer->source, output_buf, ERROR_DATAGRAM_TIMEOUT);
+                set_status(ERROR_DATAGRAM_TIMEOUT);
+                // Discard the incomplete datagram in order to avoid possible datagram duplication
+                buffer->state = DATAGRAM_BUFFER_FREE;
+
+                led_on(LED_ERROR);
+            } else {
+                receiving = true;
+            }
+        }
+
+        bool ready = (least_recent_buffer(buffers, DATAGRAM_BUFFER_READY) != NULL);
+
+        /*
+         * Execute asynchronously submitted commands between datagrams,
+         * so that their reception is not interrupted by long operations.
+         */
+        if (!receiving && !ready && command_queue_process(&config)) {
+            continue;
         }
 
         #ifdef BOOTLOADER_SLEEP_UNTIL_INTERRUPT
@@ -240,112 +491,110 @@ void bootloader_main(int arg)
          *  - Might interfer with the above timeout functionality,
          *    except if the timeout is realized via a timer peripheral i.e. interrupt
          */
-        asm("wfi");
+        if (!ready) {
+            asm("wfi");
+        }
         #endif
 
-        // Poll CAN reception FIFO for incoming frames
-        if (!can_interface_read_message(&id, data, &data_length, CAN_RECEIVE_TIMEOUT)) {
+        /*
+         * Poll CAN reception FIFO for incoming frames
+         *
+         * While complete datagrams wait for execution, the FIFO is only drained
+         * without waiting: The oldest datagram is executed as soon as it runs empty,
+         * while the frames of the next datagram are buffered meanwhile.
+         */
+        if (!can_interface_read_message(&id, data, &data_length,
+                                        ready ? 0 : CAN_RECEIVE_TIMEOUT)) {
             // No frames were received
+            if (ready && execute_oldest_datagram(buffers, &config, output_buf)) {
+                // Disable bootloader timeout
+                bootloader_timeout_enabled = false;
+            }
             continue;
         }
 
-        if (id != ID_START_MASK
-         && id != 0x000
-         && id != (config.ID | ID_START_MASK)
-         && id != config.ID) {
-            // The frame is not a bootloader broadcast, nor is it addressed to this device's ID.
+        if (!is_client_frame(id, config.ID)) {
+            // The frame was sent by another node, e.g. as reply to a client
             continue;
         }
 
-        // This frame was for us, so the current datagram didn't time out
-        datagram_timeout_reset();
+        uint32_t frame_start = cycle_counter_get();
+
+        // The datagrams of each source are reassembled separately
+        uint8_t source = id & ~ID_START_MASK;
+        datagram_buffer_t *rx = receiving_buffer(buffers, source);
 
         // Datagram start frame received: Begin a new, empty reception datagram
         if ((id & ID_START_MASK) != 0) {
-            can_datagram_start(&dt);
-            datagram_timeout_running = true;
+            if (rx == NULL) {
+                rx = least_recent_buffer(buffers, DATAGRAM_BUFFER_FREE);
+            }
+            if (rx == NULL && ready) {
+                // Make room by executing the oldest complete datagram
+                if (execute_oldest_datagram(buffers, &config, output_buf)) {
+                    bootloader_timeout_enabled = false;
+                }
+                rx = least_recent_buffer(buffers, DATAGRAM_BUFFER_FREE);
+            }
+            if (rx == NULL) {
+                // Evict the datagram, whose source was silent for the longest time
+                rx = least_recent_buffer(buffers, DATAGRAM_BUFFER_RECEIVING);
+            }
+
+            can_datagram_start(&rx->dt);
+            rx->state = DATAGRAM_BUFFER_RECEIVING;
+            rx->source = source;
+            rx->reassembly_cycles = 0;
             set_status(ERROR_UNSPECIFIED);
+
+        } else if (rx == NULL) {
+            // The start of this datagram was missed or its buffer was evicted
+            continue;
         }
 
-        // Append frame bytes to current reception datagram
+        // This frame was for us, so the datagram didn't time out
+        rx->last_frame = get_time();
+
+        // Append frame bytes to the source's reception datagram
         for (uint8_t i = 0; i < data_length; i++) {
-            can_datagram_input_byte(&dt, data[i]);
+            can_datagram_input_byte(&rx->dt, data[i]);
         }
 
+        rx->reassembly_cycles += cycle_counter_get() - frame_start;
+
+        #ifdef BOOTLOADER_LISTEN_WINDOW
+        if (listen_window_running
+         && can_datagram_destinations_are_decoded(&rx->dt)
+         && datagram_is_addressed(&rx->dt, &config)) {
+            // A client addresses this node: Give it the full timeout
+            bootloader_timeout_set(BOOTLOADER_TIMEOUT);
+            bootloader_timeout_start();
+            listen_window_running = false;
+        }
+        #endif
+
         // Frames with fewer than 8 bytes can only mean end of datagram
-        if (can_datagram_is_complete(&dt)
+        if (can_datagram_is_complete(&rx->dt)
          || (data_length < 8)) {
-            if (can_datagram_is_valid(&dt)) {
-
-                // Stop waiting for more frames to this datagram
-                datagram_timeout_running = false;
+            if (can_datagram_is_valid(&rx->dt)) {
                 set_status(SUCCESS);
 
-                // Check, if this nodes's ID is amongst the datagram's target IDs
-                bool addressed = false;
-                int i;
-                for (i = 0; i < dt.destination_nodes_len; i++) {
-                    if (dt.destination_nodes[i] == config.ID) {
-                        addressed = true;
-                        break;
-                    }
-                }
-
-                if (addressed) {
-                    // Disable bootloader timeout
-                    bootloader_timeout_enabled = false;
-
-                    // we were addressed
-                    reply_length = execute_datagram_commands(
-                            (char*) dt.data,
-                            dt.data_len,
-                            &commands[0],
-                            sizeof(commands)/sizeof(command_t),
-                            (char*) output_buf,
-                            OUTPUT_BUFFER_SIZE,
-                            &config
-                            );
-
-                    if (reply_length > 0) {
-                        // The reply's CAN frame ID must not occupy start mask bits.
-                        uint8_t return_id = id & ~ID_START_MASK;
-
-                        // Send the reply as generated by the corresponding command function
-                        return_datagram(
-                                config.ID,
-                                return_id,
-                                output_buf,
-                                (size_t) reply_length
-                                );
-                        set_status(SUCCESS);
-                        led_on(LED_SUCCESS);
-
-                    } else {
-                        // A negative return value represents an error code.
-                        return_error_datagram(
-                                config.ID,
-                                output_buf,
-                                (-reply_length)
-                                );
-                        set_status(-reply_length);
-                        led_on(LED_ERROR);
-                    }
-                }
+                // Queue the datagram for execution
+                rx->state = DATAGRAM_BUFFER_READY;
+                rx->sequence = completed_count++;
             } else {
                 // The received datagram could not be decoded.
                 return_error_datagram(
                         config.ID,
+                        source,
                         output_buf,
                         ERROR_CORRUPT_DATAGRAM
                         );
                 set_status(ERROR_CORRUPT_DATAGRAM);
                 led_on(LED_ERROR);
-            }
 
-            // Begin a new datagram, regardsless of whether the current datagram was valid or not
-            can_datagram_start(&dt);
-            // Stop timeout timer; will be started by next datagram start frame
-            datagram_timeout_running = false;
+                rx->state = DATAGRAM_BUFFER_FREE;
+            }
         }
     }
 }
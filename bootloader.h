@@ -42,6 +42,50 @@ extern "C" {
 #define PLATFORM_DEFAULT_ID  1
 #endif
 
+/**
+ * Number of CAN frames of the replies sent in reply slots
+ *
+ * A status code or checksum reply datagram takes two frames.
+ */
+#ifndef REPLY_SLOT_FRAMES
+#define REPLY_SLOT_FRAMES       2
+#endif
+
+/**
+ * Duration of one reply slot in microseconds
+ *
+ * Nodes addressed by a datagram with the slotted reply flag delay their reply
+ * by their reply slot times this duration, counted from the end of command execution.
+ * The default fits a reply of REPLY_SLOT_FRAMES frames with 500 us margin.
+ * With CAN_INTER_FRAME_DELAY every frame is preceded by up to CAN_INTER_FRAME_DELAY+1 ms
+ * (see return_datagram()), otherwise it takes about 130 us at 1 Mbit/s.
+ *
+ * This value can be overwritten by the respective platform.h.
+ */
+#ifndef REPLY_SLOT_DURATION_US
+#ifdef CAN_INTER_FRAME_DELAY
+#define REPLY_SLOT_DURATION_US  ((CAN_INTER_FRAME_DELAY + 1) * 1000 * REPLY_SLOT_FRAMES + 500)
+#else
+#define REPLY_SLOT_DURATION_US  (130 * REPLY_SLOT_FRAMES + 500)
+#endif
+#endif
+
+/**
+ * Number of datagram reception buffers, each INPUT_BUFFER_SIZE bytes large
+ *
+ * Every buffer reassembles the datagram of one source ID, so that the datagrams
+ * of concurrent clients don't interrupt each other. When a start frame of another source
+ * finds no free buffer, the oldest complete datagram is executed first, otherwise
+ * the datagram whose source was silent for the longest time is discarded.
+ * With more than one buffer the frames of the next datagram are also reassembled,
+ * while the previous datagram waits for execution.
+ *
+ * This value can be overwritten by the respective platform.h.
+ */
+#ifndef DATAGRAM_BUFFER_COUNT
+#define DATAGRAM_BUFFER_COUNT   1
+#endif
+
 void bootloader_main(int arg);
 
 #ifdef __cplusplus
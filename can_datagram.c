@@ -6,6 +6,7 @@
 enum {
     STATE_PROTOCOL_VERSION,
     STATE_CRC,
+    STATE_DST_FORMAT,
     STATE_DST_LEN,
     STATE_DST,
     STATE_DATA_LEN,
@@ -30,6 +31,47 @@ void can_datagram_set_data_buffer(can_datagram_t *dt, uint8_t *buf, size_t buf_s
     dt->_data_buffer_size = buf_size;
 }
 
+static void can_datagram_address_node(can_datagram_t *dt, uint8_t id)
+{
+    if (id < CAN_DATAGRAM_NODE_COUNT) {
+        dt->destination_bitmap[id / 8] |= (1 << (id % 8));
+    }
+}
+
+static void can_datagram_decode_destination(can_datagram_t *dt, uint8_t index, uint8_t val)
+{
+    if (dt->protocol_version < CAN_DATAGRAM_VERSION_COMPACT) {
+        can_datagram_address_node(dt, val);
+        return;
+    }
+
+    switch (dt->destination_format) {
+        case CAN_DATAGRAM_DESTINATION_LIST:
+            can_datagram_address_node(dt, val);
+            break;
+
+        case CAN_DATAGRAM_DESTINATION_BITMAP:
+            if (index < sizeof(dt->destination_bitmap)) {
+                dt->destination_bitmap[index] = val;
+            }
+            break;
+
+        case CAN_DATAGRAM_DESTINATION_RANGES:
+            // The range is complete with its last node ID
+            if (index % 2 == 1) {
+                for (unsigned int id = dt->destination_nodes[index - 1]; id <= val; id++) {
+                    can_datagram_address_node(dt, id);
+                }
+            }
+            break;
+
+        default:
+            // Device classes and groups are matched after reception,
+            // unknown formats address no node.
+            break;
+    }
+}
+
 void can_datagram_input_byte(can_datagram_t *dt, uint8_t val)
 {
     switch (dt->_reader_state) {
@@ -43,10 +85,20 @@ void can_datagram_input_byte(can_datagram_t *dt, uint8_t val)
             dt->_crc_bytes_read ++;
 
             if (dt->_crc_bytes_read >= 4) {
-                dt->_reader_state = STATE_DST_LEN;
+                if (dt->protocol_version >= CAN_DATAGRAM_VERSION_COMPACT) {
+                    dt->_reader_state = STATE_DST_FORMAT;
+                } else {
+                    dt->_reader_state = STATE_DST_LEN;
+                }
             }
             break;
 
+        case STATE_DST_FORMAT: /* Destination encoding */
+            dt->destination_format = val & CAN_DATAGRAM_DESTINATION_FORMAT_MASK;
+            dt->destination_flags = val & ~CAN_DATAGRAM_DESTINATION_FORMAT_MASK;
+            dt->_reader_state = STATE_DST_LEN;
+            break;
+
         case STATE_DST_LEN: /* Destination nodes list length */
             dt->destination_nodes_len = val;
             dt->_reader_state = STATE_DST;
@@ -54,6 +106,7 @@ void can_datagram_input_byte(can_datagram_t *dt, uint8_t val)
 
         case STATE_DST: /* Destination nodes */
             dt->destination_nodes[dt->_destination_nodes_read] = val;
+            can_datagram_decode_destination(dt, dt->_destination_nodes_read, val);
             dt->_destination_nodes_read ++;
 
             if (dt->_destination_nodes_read >= dt->destination_nodes_len) {
@@ -99,11 +152,76 @@ bool can_datagram_is_complete(can_datagram_t *dt)
     return (dt->_reader_state == STATE_TRAILING);
 }
 
+bool can_datagram_destinations_are_decoded(can_datagram_t *dt)
+{
+    return (dt->_reader_state >= STATE_DATA_LEN);
+}
+
 bool can_datagram_is_valid(can_datagram_t *dt)
 {
     return (can_datagram_is_complete(dt))
         && (can_datagram_compute_crc(dt) == dt->crc)
-        && (dt->protocol_version == CAN_DATAGRAM_VERSION);
+        && (dt->protocol_version == CAN_DATAGRAM_VERSION
+         || dt->protocol_version == CAN_DATAGRAM_VERSION_COMPACT);
+}
+
+bool can_datagram_is_addressed(can_datagram_t *dt, uint8_t id)
+{
+    if (id >= CAN_DATAGRAM_NODE_COUNT) {
+        return false;
+    }
+    return dt->destination_bitmap[id / 8] & (1 << (id % 8));
+}
+
+static bool can_datagram_has_destination_format(can_datagram_t *dt, uint8_t format)
+{
+    return (dt->protocol_version >= CAN_DATAGRAM_VERSION_COMPACT)
+        && (dt->destination_format == format);
+}
+
+bool can_datagram_is_class_addressed(can_datagram_t *dt, const char *device_class)
+{
+    if (!can_datagram_has_destination_format(dt, CAN_DATAGRAM_DESTINATION_CLASS)
+     || dt->destination_nodes_len != 4) {
+        return false;
+    }
+
+    uint32_t hash = crc32(0, (const uint8_t *) device_class, strlen(device_class));
+    return (dt->destination_nodes[0] == ((hash >> 24) & 0xff))
+        && (dt->destination_nodes[1] == ((hash >> 16) & 0xff))
+        && (dt->destination_nodes[2] == ((hash >> 8) & 0xff))
+        && (dt->destination_nodes[3] == (hash & 0xff));
+}
+
+bool can_datagram_is_group_addressed(can_datagram_t *dt, uint8_t group)
+{
+    if (!can_datagram_has_destination_format(dt, CAN_DATAGRAM_DESTINATION_GROUPS)
+     || group == 0) {
+        return false;
+    }
+
+    for (int i = 0; i < dt->destination_nodes_len; i++) {
+        if (dt->destination_nodes[i] == group) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint8_t can_datagram_reply_slot(can_datagram_t *dt, uint8_t id)
+{
+    if (can_datagram_has_destination_format(dt, CAN_DATAGRAM_DESTINATION_CLASS)
+     || can_datagram_has_destination_format(dt, CAN_DATAGRAM_DESTINATION_GROUPS)) {
+        return id;
+    }
+
+    uint8_t slot = 0;
+    for (uint8_t node = 0; node < id && node < CAN_DATAGRAM_NODE_COUNT; node++) {
+        if (can_datagram_is_addressed(dt, node)) {
+            slot++;
+        }
+    }
+    return slot;
 }
 
 void can_datagram_start(can_datagram_t *dt)
@@ -114,6 +232,9 @@ void can_datagram_start(can_datagram_t *dt)
     dt->_destination_nodes_read = 0;
     dt->_data_length_bytes_read = 0;
     dt->_data_bytes_read = 0;
+    dt->destination_format = 0;
+    dt->destination_flags = 0;
+    memset(dt->destination_bitmap, 0, sizeof(dt->destination_bitmap));
 }
 
 int can_datagram_output_bytes(can_datagram_t *dt, char *buffer, size_t buffer_len)
@@ -132,10 +253,19 @@ int can_datagram_output_bytes(can_datagram_t *dt, char *buffer, size_t buffer_le
                 dt->_crc_bytes_written ++;
 
                 if (dt->_crc_bytes_written >= 4) {
-                    dt->_writer_state = STATE_DST_LEN;
+                    if (dt->protocol_version >= CAN_DATAGRAM_VERSION_COMPACT) {
+                        dt->_writer_state = STATE_DST_FORMAT;
+                    } else {
+                        dt->_writer_state = STATE_DST_LEN;
+                    }
                 }
                 break;
 
+            case STATE_DST_FORMAT: /* Destination encoding */
+                buffer[i] = dt->destination_format | dt->destination_flags;
+                dt->_writer_state = STATE_DST_LEN;
+                break;
+
             case STATE_DST_LEN: /* Destination node length */
                 buffer[i] = dt->destination_nodes_len;
                 dt->_writer_state = STATE_DST;
@@ -192,7 +322,12 @@ uint32_t can_datagram_compute_crc(can_datagram_t *dt)
 {
     uint32_t crc;
     uint8_t tmp[4];
-    crc = crc32(0, &dt->destination_nodes_len, 1);
+    crc = 0;
+    if (dt->protocol_version >= CAN_DATAGRAM_VERSION_COMPACT) {
+        uint8_t format = dt->destination_format | dt->destination_flags;
+        crc = crc32(crc, &format, 1);
+    }
+    crc = crc32(crc, &dt->destination_nodes_len, 1);
     crc = crc32(crc, &dt->destination_nodes[0], dt->destination_nodes_len);
 
     /* data_len is not in network endianess, correct that before CRC update. */
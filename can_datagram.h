@@ -11,20 +11,57 @@ extern "C" {
 
 #define CAN_DATAGRAM_VERSION 1
 
+/**
+ * Datagram version with a destination format byte preceding the destination length,
+ * allowing compact encodings of large destination sets
+ */
+#define CAN_DATAGRAM_VERSION_COMPACT 2
+
+/** Destination formats of version 2 datagrams */
+#define CAN_DATAGRAM_DESTINATION_LIST       0   /**< One byte per node ID, like in version 1 */
+#define CAN_DATAGRAM_DESTINATION_BITMAP     1   /**< Bit n (LSB first) set, if node n is addressed */
+#define CAN_DATAGRAM_DESTINATION_RANGES     2   /**< Pairs of first and last node ID (inclusive) */
+#define CAN_DATAGRAM_DESTINATION_CLASS      3   /**< CRC32 of the device class string, MSB first */
+#define CAN_DATAGRAM_DESTINATION_GROUPS     4   /**< List of group IDs as configured on the nodes */
+
+/** The destination format byte's lower bits select the format, the upper bits are flags */
+#define CAN_DATAGRAM_DESTINATION_FORMAT_MASK    0x0f
+
+/** Addressed nodes reply one after another in slots, see can_datagram_reply_slot() */
+#define CAN_DATAGRAM_FLAG_SLOTTED_REPLY         0x80
+
+/** Addressed nodes only reply, if the command failed (see command_reply_is_success()) */
+#define CAN_DATAGRAM_FLAG_QUIET                 0x40
+
+/** Node IDs are 7 bits wide, since the CAN ID's 8th bit is the start mask */
+#define CAN_DATAGRAM_NODE_COUNT 128
+
 /**
  * When this bit is set in a CAN frame ID,
  * the frame is considered the beginning of a datagram.
  */
 #define ID_START_MASK (1 << 7)
 
+/**
+ * Source IDs from CLIENT_ID_MIN up to CAN_DATAGRAM_NODE_COUNT - 1 are reserved
+ * for clients besides the default client ID 0, e.g. for tools running concurrently.
+ * Their count must be a power of two, so that one CAN filter matches all of them.
+ */
+#define CLIENT_ID_MIN 0x78
+
 
 typedef struct {
     int protocol_version;
     uint32_t crc;
 
+    uint8_t destination_format;
+    uint8_t destination_flags;
     uint8_t destination_nodes_len;
     uint8_t *destination_nodes;
 
+    /** Addressed node IDs, decoded from any destination format during reception */
+    uint8_t destination_bitmap[CAN_DATAGRAM_NODE_COUNT / 8];
+
     uint32_t data_len;
     uint8_t *data;
 
@@ -57,9 +94,36 @@ void can_datagram_input_byte(can_datagram_t *dt, uint8_t val);
 /** Returns true if the datagram is complete (all data were read). */
 bool can_datagram_is_complete(can_datagram_t *dt);
 
+/** Returns true once the destinations of the received datagram are decoded. */
+bool can_datagram_destinations_are_decoded(can_datagram_t *dt);
+
 /** Returns true if the datagram is valid (complete and CRC match). */
 bool can_datagram_is_valid(can_datagram_t *dt);
 
+/** Returns true if the given node ID is amongst the received datagram's destinations. */
+bool can_datagram_is_addressed(can_datagram_t *dt, uint8_t id);
+
+/**
+ * Returns true if the received datagram is addressed to the given device class
+ * (destination format CAN_DATAGRAM_DESTINATION_CLASS).
+ */
+bool can_datagram_is_class_addressed(can_datagram_t *dt, const char *device_class);
+
+/**
+ * Returns true if the received datagram is addressed to the given group
+ * (destination format CAN_DATAGRAM_DESTINATION_GROUPS). Group 0 is never addressed.
+ */
+bool can_datagram_is_group_addressed(can_datagram_t *dt, uint8_t group);
+
+/**
+ * Returns the reply slot of the given node in a datagram with CAN_DATAGRAM_FLAG_SLOTTED_REPLY
+ *
+ * The slot is the node's rank amongst the addressed node IDs, i.e. the number of
+ * addressed nodes with a lower ID. For device class and group destinations,
+ * whose members are unknown, the slot is the node ID itself.
+ */
+uint8_t can_datagram_reply_slot(can_datagram_t *dt, uint8_t id);
+
 /** Signals to the parser that we are at the start of a datagram.
  *
  * The start of datagram comes from the Message ID (physical layer).
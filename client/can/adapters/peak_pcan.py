@@ -77,9 +77,14 @@ class PeakPCANInterface:
         self.pcan.Write(self.channel, msg)
 
 
-    def receive_frame(self):
+    def send_frames(self, frames):
+        for frame in frames:
+            self.send_frame(frame)
+
+
+    def receive_frame(self, timeout=3):
         try:
             # Try to retrieve a frame from the queue within specified timeout period
-            return self.rx_queue.get(block=True, timeout=3)
+            return self.rx_queue.get(block=True, timeout=timeout)
         except:
             return None
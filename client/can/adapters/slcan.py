@@ -20,7 +20,7 @@ class SLCANInterface:
 
     MIN_MSG_LEN = len('t1230')
 
-    def __init__(self, args):
+    def __init__(self, args, reader_thread=True):
         port = args.serial_device
         try:
             self.port = serial.Serial(port=port, timeout=1)
@@ -61,10 +61,14 @@ class SLCANInterface:
         # Queue for received CAN frames
         self.rx_queue = Queue()
 
-        # Start independent thread for frame reception
-        t = threading.Thread(target=self.spin)
-        t.daemon = True
-        t.start()
+        # Received data following the last complete message
+        self.part = b''
+
+        if reader_thread:
+            # Start independent thread for frame reception
+            t = threading.Thread(target=self.spin)
+            t.daemon = True
+            t.start()
 
         # Configure adapter
         self.send_command("S8");    # Set the bitrate to 1 Mbit
@@ -76,47 +80,62 @@ class SLCANInterface:
         self.port.reset_input_buffer()
 
     def spin(self):
-        part = ''
         while True:
             try:
-                part += self.port.read(1).decode('ascii')
-            except serial.serialutil.SerialException:
+                # Block for the first byte, then take everything the adapter has sent
+                data = self.port.read(max(1, self.port.in_waiting))
+            except (serial.serialutil.SerialException, TypeError):
+                # pyserial raises a TypeError, if the port was closed during the read
+                if not self.port.is_open:
+                    return
                 # Continue reading anyway until program terminates
-                pass
+                continue
 
-            if part.startswith('\r'):
-                part.lstrip('\r')
+            for frame in self.feed(data):
+                self.rx_queue.put(frame)
 
-            if '\r' not in part:
-                continue
+    def fileno(self):
+        return self.port.fileno()
+
+    def read_frames(self):
+        """
+        Returns the received frames, which can be read without blocking.
+        """
+        return self.feed(self.port.read(self.port.in_waiting))
 
-            data = part.split('\r')
-            data, part = data[:-1], data[-1]
+    def feed(self, data):
+        """
+        Parses the data received from the adapter and returns the completed frames.
+        """
+        self.part += data
+        if b'\r' not in self.part:
+            return []
 
-            for frame in data:
-                if frame is None:
-                    continue
-                frame = self.decode_frame(frame)
-                if frame:
-                    self.rx_queue.put(frame)
-                    can.logging.debug("Received CAN frame via SLCAN adapter.")
+        data = self.part.split(b'\r')
+        data, self.part = data[:-1], data[-1]
+
+        frames = [frame for frame in map(self.decode_frame, data) if frame]
+        if frames:
+            can.logging.debug("Received {} CAN frames via SLCAN adapter.".format(len(frames)))
+        return frames
 
     def send_command(self, cmd):
-        cmd += '\r'
-        cmd = cmd.encode('ascii')
-        self.port.flushOutput()
-        self.port.write(cmd)
-        self.port.flushOutput()
+        self.port.write(cmd.encode('ascii') + b'\r')
 
     def decode_frame(self, msg):
+        """
+        Decodes a single SLCAN frame message (without the trailing carriage return).
+
+        Returns None for messages which are not frames, e.g. acknowledgements.
+        """
         if len(msg) < self.MIN_MSG_LEN:
             return None
 
-        cmd, msg = msg[0], msg[1:]
-        if cmd == 'T':
+        cmd, msg = msg[:1], msg[1:]
+        if cmd == b'T':
             extended = True
             id_len = 8
-        elif cmd == 't':
+        elif cmd == b't':
             extended = False
             id_len = 3
         else:
@@ -126,50 +145,44 @@ class SLCANInterface:
             return None
         try:
             can_id = int(msg[0:id_len], 16)
-        except:
+        except ValueError:
             can.logging.warning("Failed to parse ID from incoming SLCAN frame.")
             return None
-        msg = msg[id_len:]
         try:
-            data_len = int(msg[0])
-        except:
+            data_len = int(msg[id_len:id_len + 1])
+        except ValueError:
             can.logging.warning("Failed to parse DLC from incoming SLCAN frame.")
             return None
-        msg = msg[1:]
+        msg = msg[id_len + 1:]
         if len(msg) < 2 * data_len:
             can.logging.warning("Insufficient data in incoming SLCAN frame.")
             return None
         try:
-            data = [int(msg[i:i + 2], 16) for i in range(0, 2 * data_len, 2)]
-        except:
+            data = bytearray.fromhex(msg[:2 * data_len].decode('ascii'))
+        except ValueError:
             can.logging.warning("Failed to parse data bytes from incoming SLCAN frame.")
             return None
 
-        return can.Frame(id=can_id, data=bytearray(data), data_length=data_len, extended=extended)
+        return can.Frame(id=can_id, data=data, data_length=data_len, extended=extended)
 
     def encode_frame(self, frame):
         if frame.extended:
-            cmd = 'T'
-            can_id = '{:08x}'.format(frame.id)
-        else:
-            cmd = 't'
-            can_id = '{:03x}'.format(frame.id)
-
-        length = '{:x}'.format(frame.data_length)
-
-        data = ''
-        for b in frame.data:
-            data += '{:02x}'.format(b)
-        return cmd + can_id + length + data
+            return 'T{:08x}{:x}{}'.format(frame.id, frame.data_length, bytes(frame.data).hex())
+        return 't{:03x}{:x}{}'.format(frame.id, frame.data_length, bytes(frame.data).hex())
 
     def send_frame(self, frame):
-        can.logging.debug("Transmitting CAN frame via SLCAN adapter...")
-        cmd = self.encode_frame(frame)
-        self.send_command(cmd)
+        self.send_frames([frame])
+
+    def send_frames(self, frames):
+        """
+        Transmits the frames with a single write to the adapter.
+        """
+        can.logging.debug("Transmitting CAN frames via SLCAN adapter...")
+        self.port.write(''.join(self.encode_frame(frame) + '\r' for frame in frames).encode('ascii'))
 
-    def receive_frame(self):
+    def receive_frame(self, timeout=3):
         try:
             # Try to retrieve a frame from the queue within specified timeout period
-            return self.rx_queue.get(block=True, timeout=3)
+            return self.rx_queue.get(block=True, timeout=timeout)
         except:
             return None
@@ -2,9 +2,11 @@
 import can
 import socket
 import struct
+import select
 from queue import Queue
 import threading
 import errno
+import time
 from sys import exit
 
 
@@ -17,9 +19,36 @@ class SocketCANInterface:
     CAN_FRAME_FMT = "=IB3x8s"
     CAN_FRAME_SIZE = struct.calcsize(CAN_FRAME_FMT)
 
-    def __init__(self, interface):
+    # struct can_filter and the raw socket options from <linux/can.h> and <linux/can/raw.h>
+    CAN_FILTER_FMT = "=II"
+    CAN_EFF_FLAG = 0x80000000
+    CAN_RTR_FLAG = 0x40000000
+    CAN_SFF_MASK = 0x000007ff
+    SOL_CAN_RAW = 101
+    CAN_RAW_FILTER = 1
+
+    # Socket buffer size, enough for several write datagrams in flight
+    SOCKET_BUFFER_SIZE = 1 << 18
+
+    # Maximum number of frames read per wakeup of the reception thread
+    RECEIVE_BATCH_SIZE = 64
+
+    # Time to wait for transmission buffer space before giving up
+    SEND_TIMEOUT = 2.
+
+    # Initial and maximum delay between retries when the interface queue is full
+    SEND_BACKOFF = 0.0005
+    SEND_BACKOFF_MAX = 0.02
+
+    def __init__(self, interface, ids=None, reader_thread=True):
         """
         Initiates a CAN connection on the given interface (e.g. 'can0').
+
+        If ids are given, only frames sent by those nodes are received,
+        all other traffic is dropped by the kernel.
+
+        Without reader thread, frames are only received with read_frames(),
+        when the socket is readable, see can.aio.
         """
 
         try:
@@ -56,68 +85,132 @@ class SocketCANInterface:
             raise
             exit(1)
 
-        # Set transmission and reception timeout
-        self.socket.settimeout(2.)
+        # Waiting for the socket is done with select(), so it never blocks
+        self.socket.setblocking(False)
 
         # Set buffer sizes
-        self.socket.setsockopt(socket.SOL_SOCKET, socket.SO_SNDBUF, 4096)
-        self.socket.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+        self.socket.setsockopt(socket.SOL_SOCKET, socket.SO_SNDBUF, self.SOCKET_BUFFER_SIZE)
+        self.socket.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, self.SOCKET_BUFFER_SIZE)
+
+        if ids:
+            self.socket.setsockopt(self.SOL_CAN_RAW, self.CAN_RAW_FILTER, self.encode_filter(ids))
 
         # Create queue for received CAN frames
         self.rx_queue = Queue()
 
-        # Start independent thread for frame reception
-        t = threading.Thread(target=self.loop)
-        t.daemon = True
-        t.start()
+        if reader_thread:
+            # Start independent thread for frame reception
+            t = threading.Thread(target=self.loop)
+            t.daemon = True
+            t.start()
+
+
+    def encode_filter(self, ids):
+        """
+        Returns the CAN_RAW_FILTER option value matching standard data frames of the given nodes.
+
+        The start of datagram bit is masked, so that all frames of a datagram pass.
+        """
+        mask = self.CAN_EFF_FLAG | self.CAN_RTR_FLAG | (self.CAN_SFF_MASK & ~can.START_OF_DATAGRAM_MASK)
+        return b''.join(struct.pack(self.CAN_FILTER_FMT, id, mask) for id in sorted(set(ids)))
 
 
     def loop(self):
         while True:
+            for frame in self.receive_frames():
+                self.rx_queue.put(frame)
+
+
+    def receive_frames(self, timeout=2.):
+        """
+        Waits for the socket to become readable and returns the frames,
+        which can be read without blocking, at most RECEIVE_BATCH_SIZE.
+        """
+        readable, _, _ = select.select([self.socket], [], [], timeout)
+        if not readable:
+            return []
+
+        frames = []
+        while len(frames) < self.RECEIVE_BATCH_SIZE:
             try:
-                frame, _ = self.socket.recvfrom(self.CAN_FRAME_SIZE)
-            except socket.timeout:
-                continue
+                frame = self.socket.recv(self.CAN_FRAME_SIZE)
+            except (BlockingIOError, InterruptedError):
+                break
 
             can_id, can_dlc, data = struct.unpack(self.CAN_FRAME_FMT, frame)
-            frame = can.Frame(id=can_id, data=data[:can_dlc])
-            self.rx_queue.put(frame)
-            can.logging.debug("Received CAN frame from socket.")
+            frames.append(can.Frame(id=can_id, data=data[:can_dlc]))
 
+        can.logging.debug("Received {} CAN frames from socket.".format(len(frames)))
+        return frames
 
-    def send_frame(self, frame):
-        can.logging.debug("Transmitting CAN frame via socket...")
+
+    def fileno(self):
+        return self.socket.fileno()
+
+
+    def read_frames(self):
+        """
+        Returns the received frames, which can be read without blocking.
+        """
+        return self.receive_frames(timeout=0)
+
+
+    def encode_frame(self, frame):
         data = frame.data.ljust(8, b'\x00')
-        data = struct.pack(self.CAN_FRAME_FMT,
+        return struct.pack(self.CAN_FRAME_FMT,
                            frame.id,
                            len(frame.data),
                            data)
 
-        try:
-            self.socket.send(data)
-        except socket.timeout:
-            can.logging.warning("Socket transmission timed out.")
-            pass
-        except OSError as e:
-            if e.errno == errno.ENOBUFS:
+
+    def send_frame(self, frame):
+        self.send_frames([frame])
+
+
+    def send_frames(self, frames):
+        """
+        Transmits the frames in order.
+
+        Whenever the transmission buffer or the interface queue is full,
+        waits for it to drain instead of failing, up to SEND_TIMEOUT per frame.
+        """
+        can.logging.debug("Transmitting CAN frames via socket...")
+        for packet in [self.encode_frame(frame) for frame in frames]:
+            self.send_packet(packet)
+
+
+    def send_packet(self, packet):
+        deadline = time.monotonic() + self.SEND_TIMEOUT
+        backoff = self.SEND_BACKOFF
+
+        while True:
+            try:
+                self.socket.send(packet)
+                return
+            except (BlockingIOError, InterruptedError):
+                # Socket buffer is full, wait until it is writable again
+                select.select([], [self.socket], [], max(deadline - time.monotonic(), 0))
+            except OSError as e:
+                if e.errno == errno.ENOBUFS:
+                    # The interface queue is full, which select() doesn't report
+                    time.sleep(backoff)
+                    backoff = min(2 * backoff, self.SEND_BACKOFF_MAX)
+                elif e.errno == errno.ENETDOWN:
+                    # Network is down
+                    can.logging.critical("The CAN network is down.")
+                    exit(errno.ENETDOWN)
+                else:
+                    raise
+
+            if time.monotonic() >= deadline:
                 # Buffer overflow
                 can.logging.critical("Transmission buffer overflow. Probably CAN frames are not being acknowledged properly on the bus.")
                 exit(errno.ENOBUFS)
-            elif e.errno == errno.ENETDOWN:
-                # Network is down
-                can.logging.critical("The CAN network is down.")
-                exit(errno.ENETDOWN)
-            else:
-                raise
-                exit(1)
-        except:
-            raise
-            exit(1)
 
 
-    def receive_frame(self):
+    def receive_frame(self, timeout=3):
         try:
             # Try to retrieve a frame from the queue within specified timeout period
-            return self.rx_queue.get(block=True, timeout=3)
+            return self.rx_queue.get(block=True, timeout=timeout)
         except:
             return None
@@ -0,0 +1,125 @@
+"""
+Single threaded CAN transport on top of an asyncio event loop.
+
+The adapter is registered as readable file descriptor with the loop,
+frames are reassembled into datagrams as soon as they are read,
+and commands are awaitables, which complete when all destinations replied
+or when their deadline expires, whichever comes first.
+
+Any adapter which is opened without reader thread and provides fileno(),
+read_frames() and send_frames() can be used, e.g. SocketCAN and SLCAN.
+"""
+import asyncio
+from collections import defaultdict
+
+from .datagram import DatagramDecoder, encode_datagram, datagram_to_frames, is_start_of_datagram
+
+# Source ID is bits[6:0], see PROTOCOL.markdown
+SOURCE_ID_MASK = 0x7f
+
+
+class Transport:
+    def __init__(self, adapter, source=0, loop=None):
+        """
+        Starts receiving the frames of the adapter in the given or running event loop.
+
+        Datagrams are sent with the given source ID.
+        """
+        self.adapter = adapter
+        self.source = source
+        self.loop = loop or asyncio.get_running_loop()
+
+        self.decoders = defaultdict(DatagramDecoder)
+
+        # Callbacks of the requests waiting for a reply, by node ID
+        self.pending = {}
+
+        # Datagrams, which no request waits for, as (data, destinations, source) tuples
+        self.datagrams = asyncio.Queue()
+
+        self.loop.add_reader(adapter.fileno(), self.readable)
+
+    def close(self):
+        self.loop.remove_reader(self.adapter.fileno())
+
+    def readable(self):
+        for frame in self.adapter.read_frames():
+            self.frame_received(frame)
+
+    def frame_received(self, frame):
+        if frame.extended:
+            # The bootloader doesn't use extended IDs
+            return
+
+        src = frame.id & SOURCE_ID_MASK
+
+        if (src in self.decoders) and is_start_of_datagram(frame):
+            # Begin new datagram
+            del self.decoders[src]
+
+        datagram = self.decoders[src].input(frame.data[:frame.data_length])
+        if datagram is None:
+            return
+
+        del self.decoders[src]
+        data, destinations = datagram
+
+        reply = self.pending.pop(src, None)
+        if reply:
+            reply(src, data)
+        else:
+            self.datagrams.put_nowait((data, destinations, src))
+
+    def send(self, command, destinations, flags=0):
+        """
+        Sends the command without waiting for replies.
+        """
+        datagram = encode_datagram(command, destinations, flags)
+        self.adapter.send_frames(list(datagram_to_frames(datagram, self.source)))
+
+    async def request(self, command, destinations, timeout=1., flags=0, sources=None):
+        """
+        Sends the command and waits for the replies of all destinations, at most timeout seconds.
+        If sources are given, the replies of these nodes are awaited instead,
+        e.g. of a node which replies with its new ID.
+
+        Returns the replies received until then as dict of node ID and reply data.
+        Only one request may wait for a reply from the same node at a time.
+        """
+        nodes = set(destinations if sources is None else sources)
+        busy = sorted(id for id in nodes if id in self.pending)
+        if busy:
+            raise RuntimeError("Nodes {} already have a pending request".format(busy))
+
+        replies = {}
+        done = self.loop.create_future()
+
+        def reply(src, data):
+            replies[src] = data
+            if len(replies) == len(nodes) and not done.done():
+                done.set_result(None)
+
+        for id in nodes:
+            self.pending[id] = reply
+
+        try:
+            self.send(command, destinations, flags)
+            await asyncio.wait_for(done, timeout)
+        except asyncio.TimeoutError:
+            pass
+        finally:
+            for id in nodes:
+                if self.pending.get(id) is reply:
+                    del self.pending[id]
+
+        return replies
+
+    async def receive(self, timeout=None):
+        """
+        Returns the next datagram no request waited for, as (data, destinations, source) tuple,
+        or None if none arrives within timeout seconds.
+        """
+        try:
+            return await asyncio.wait_for(self.datagrams.get(), timeout)
+        except asyncio.TimeoutError:
+            return None
@@ -6,8 +6,27 @@ import can
 from .frame import *
 
 DATAGRAM_VERSION = 1
+DATAGRAM_VERSION_COMPACT = 2
 START_OF_DATAGRAM_MASK = (1 << 7)
 
+# Destination formats of compact (version 2) datagrams
+DESTINATION_LIST = 0
+DESTINATION_BITMAP = 1
+DESTINATION_RANGES = 2
+DESTINATION_CLASS = 3
+DESTINATION_GROUPS = 4
+
+# Flags in the upper bits of the destination format byte
+DESTINATION_FORMAT_MASK = 0x0f
+FLAG_SLOTTED_REPLY = 0x80
+FLAG_QUIET = 0x40
+
+# Node IDs are 7 bits wide, the 8th bit of the CAN ID is the start mask
+MAX_NODE_ID = 127
+
+# Compact destinations are only used, if they save at least one CAN frame
+COMPACT_DESTINATIONS_MIN_SAVING = 8
+
 
 class VersionMismatchError(RuntimeError):
     """
@@ -21,22 +40,139 @@ class CRCMismatchError(RuntimeError):
     """
     pass
 
+class DeviceClassDestination:
+    """
+    Addresses all nodes of the given device class.
+    Such datagrams may omit the device class in flash commands.
+    """
+    def __init__(self, device_class):
+        self.device_class = device_class
+
+    def encode(self):
+        return struct.pack('>I', crc32(self.device_class.encode('ascii')))
+
+    def __eq__(self, other):
+        return isinstance(other, DeviceClassDestination) and self.encode() == other.encode()
+
+class GroupDestination:
+    """
+    Addresses all nodes, whose config contains one of the given group IDs.
+    """
+    def __init__(self, *groups):
+        self.groups = list(groups)
+
+    def encode(self):
+        return bytes(self.groups)
+
+    def __eq__(self, other):
+        return isinstance(other, GroupDestination) and self.groups == other.groups
+
 def is_start_of_datagram(frame):
     """
     Returns true if the given frame has the start of datagram marker.
     """
     return bool(frame.id & START_OF_DATAGRAM_MASK)
 
-def encode_datagram(data, destinations):
+def _destination_ranges(destinations):
+    """
+    Merges the given node IDs into a list of (first, last) tuples.
+    """
+    ranges = []
+    for node in sorted(set(destinations)):
+        if ranges and ranges[-1][1] == node - 1:
+            ranges[-1] = (ranges[-1][0], node)
+        else:
+            ranges.append((node, node))
+    return ranges
+
+def encode_destinations(destinations):
+    """
+    Encodes the destination list in the smallest possible way.
+    Returns a tuple of the datagram version and the encoded destinations,
+    including the format and length bytes.
+
+    The version 1 list is preferred, unless a compact encoding saves
+    at least COMPACT_DESTINATIONS_MIN_SAVING bytes, so that small destination
+    lists remain readable by bootloaders without compact datagram support.
+
+    Device class and group destinations are always encoded in version 2.
+    """
+    if isinstance(destinations, DeviceClassDestination):
+        encoded = destinations.encode()
+        return DATAGRAM_VERSION_COMPACT, bytes([DESTINATION_CLASS, len(encoded)]) + encoded
+
+    if isinstance(destinations, GroupDestination):
+        encoded = destinations.encode()
+        return DATAGRAM_VERSION_COMPACT, bytes([DESTINATION_GROUPS, len(encoded)]) + encoded
+
+    destination_list = (DATAGRAM_VERSION, bytes([len(destinations)] + destinations))
+    encodings = []
+
+    if destinations and all(0 <= node <= MAX_NODE_ID for node in destinations):
+        bitmap = bytearray(max(destinations) // 8 + 1)
+        for node in destinations:
+            bitmap[node // 8] |= 1 << (node % 8)
+        encodings.append((DATAGRAM_VERSION_COMPACT,
+                          bytes([DESTINATION_BITMAP, len(bitmap)]) + bitmap))
+
+        ranges = [node for r in _destination_ranges(destinations) for node in r]
+        encodings.append((DATAGRAM_VERSION_COMPACT,
+                          bytes([DESTINATION_RANGES, len(ranges)] + ranges)))
+
+    if encodings:
+        compact = min(encodings, key=lambda encoding: len(encoding[1]))
+        if len(destination_list[1]) - len(compact[1]) >= COMPACT_DESTINATIONS_MIN_SAVING:
+            return compact
+
+    return destination_list
+
+def decode_destinations(destination_format, destinations):
+    """
+    Decodes compact destinations to the sorted list of addressed node IDs.
+    Group destinations are returned as GroupDestination.
+    The device class hash is returned as raw bytes, since it cannot be reversed.
+    """
+    if destination_format == DESTINATION_LIST:
+        return list(destinations)
+
+    if destination_format == DESTINATION_BITMAP:
+        return [node for node in range(len(destinations) * 8)
+                if destinations[node // 8] & (1 << (node % 8))]
+
+    if destination_format == DESTINATION_RANGES:
+        nodes = set()
+        for first, last in zip(destinations[0::2], destinations[1::2]):
+            nodes.update(range(first, last + 1))
+        return sorted(nodes)
+
+    if destination_format == DESTINATION_GROUPS:
+        return GroupDestination(*destinations)
+
+    if destination_format == DESTINATION_CLASS:
+        return bytes(destinations)
+
+    return []
+
+def encode_datagram(data, destinations, flags=0):
     """
     Encodes the given data and destination list to form a complete datagram.
     This datagram can then be cut into CAN messages by datagram_to_frames.
+
+    The destinations are either a list of node IDs, encoded as list,
+    bitmap or ranges, whichever is the shortest (see encode_destinations),
+    a DeviceClassDestination or a GroupDestination.
+
+    Flags (e.g. FLAG_SLOTTED_REPLY, FLAG_QUIET) require a version 2 datagram.
     """
 
-    version = struct.pack('B', DATAGRAM_VERSION)
-    addresses = bytes([len(destinations)] + destinations)
+    version, addresses = encode_destinations(destinations)
+    if flags:
+        if version == DATAGRAM_VERSION:
+            version, addresses = DATAGRAM_VERSION_COMPACT, bytes([DESTINATION_LIST]) + addresses
+        addresses = bytes([addresses[0] | flags]) + addresses[1:]
+    version = struct.pack('B', version)
     dt = struct.pack('>I', len(data)) + data
-    crc = struct.pack('>I', crc32(addresses + dt))
+    crc = struct.pack('>I', crc32(dt, crc32(addresses)))
 
     return version + crc + addresses + dt
 
@@ -53,18 +189,24 @@ def decode_datagram(data):
 
     try:
         version, data = int(data[0]), data[1:]
-        if version != DATAGRAM_VERSION:
+        if version not in (DATAGRAM_VERSION, DATAGRAM_VERSION_COMPACT):
             raise VersionMismatchError
 
-        header_format = '>IB'
-        header_len = struct.calcsize(header_format)
-        header, data = data[0:header_len], data[header_len:]
-        crc, dst_len = struct.unpack(header_format, header)
+        if version == DATAGRAM_VERSION_COMPACT:
+            header_format = '>IBB'
+            header_len = struct.calcsize(header_format)
+            header, data = data[0:header_len], data[header_len:]
+            crc, destination_format, dst_len = struct.unpack(header_format, header)
+        else:
+            header_format = '>IB'
+            header_len = struct.calcsize(header_format)
+            header, data = data[0:header_len], data[header_len:]
+            crc, dst_len = struct.unpack(header_format, header)
 
         # Decodes the destination list
-        destination_format = '{}s'.format(dst_len)
+        destination_format_string = '{}s'.format(dst_len)
         destinations, data = data[:dst_len], data[dst_len:]
-        destinations = list(struct.unpack(destination_format, destinations)[0])
+        destinations = list(struct.unpack(destination_format_string, destinations)[0])
 
         data_len, data = data[:4], data[4:]
         data_len = struct.unpack('>I', data_len)[0]
@@ -74,6 +216,9 @@ def decode_datagram(data):
             return None
 
         addresses = bytes([len(destinations)] + destinations)
+        if version == DATAGRAM_VERSION_COMPACT:
+            addresses = bytes([destination_format]) + addresses
+            destinations = decode_destinations(destination_format & DESTINATION_FORMAT_MASK, destinations)
         dt = struct.pack('>I', len(data)) + data
 
         if crc32(addresses + dt) != crc:
@@ -83,7 +228,7 @@ def decode_datagram(data):
         # This means that we have not enough bytes to decode a datagram
         return None
     except VersionMismatchError:
-        can.logging.debug("Rejected datagram with incompatible version " + str(version) + " instead of " + str(DATAGRAM_VERSION) + ".")
+        can.logging.debug("Rejected datagram with incompatible version " + str(version) + ".")
         return None
     except CRCMismatchError:
         can.logging.info("Rejected datagram with incorrect CRC.")
@@ -96,18 +241,114 @@ def decode_datagram(data):
 #    print(s)
     return data, destinations
 
+class DatagramDecoder:
+    """
+    Decodes a datagram incrementally from the data of consecutive CAN frames,
+    like can_datagram_input_byte() does in the bootloader.
+
+    Every byte is parsed once and the CRC is updated as the data arrives,
+    instead of decoding the whole datagram again for every frame.
+    """
+
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        """
+        Discards all input, e.g. when a new datagram starts.
+        """
+        self.header = bytearray()
+        self.header_len = 1
+        self.data = None
+        self.data_len = 0
+        self.crc = 0
+        self.done = False
+
+    def _header_complete(self):
+        """
+        Extends the expected header length by the fields which became known.
+        Returns True once the header including the data length was received.
+        """
+        header = self.header
+        version = header[0]
+
+        if version == DATAGRAM_VERSION_COMPACT:
+            dst_len_pos = 6
+        elif version == DATAGRAM_VERSION:
+            dst_len_pos = 5
+        else:
+            raise VersionMismatchError
+
+        if len(header) <= dst_len_pos:
+            self.header_len = dst_len_pos + 1
+            return False
+
+        self.header_len = dst_len_pos + 1 + header[dst_len_pos] + 4
+        return len(header) == self.header_len
+
+    def input(self, data):
+        """
+        Feeds the data of the next frame.
+
+        Returns the tuple (data, destinations) exactly once, when the datagram is complete
+        and valid, None otherwise. Invalid datagrams are ignored until the decoder is reset.
+        """
+        if self.done:
+            return None
+
+        try:
+            while self.data is None and data:
+                count = self.header_len - len(self.header)
+                self.header += data[:count]
+                data = data[count:]
+
+                if len(self.header) == self.header_len and self._header_complete():
+                    self.data_len, = struct.unpack_from('>I', self.header, self.header_len - 4)
+                    self.crc = crc32(self.header[5:])
+                    self.data = bytearray()
+
+            if self.data is None:
+                return None
+
+            data = data[:self.data_len - len(self.data)]
+            self.data += data
+            self.crc = crc32(data, self.crc)
+
+            if len(self.data) < self.data_len:
+                return None
+
+            self.done = True
+            crc, = struct.unpack_from('>I', self.header, 1)
+            if crc != self.crc:
+                raise CRCMismatchError
+
+        except VersionMismatchError:
+            can.logging.debug("Rejected datagram with incompatible version " + str(self.header[0]) + ".")
+            self.done = True
+            return None
+        except CRCMismatchError:
+            can.logging.info("Rejected datagram with incorrect CRC.")
+            return None
+
+        header = self.header
+        if header[0] == DATAGRAM_VERSION_COMPACT:
+            destination_format = header[5]
+            destinations = decode_destinations(destination_format & DESTINATION_FORMAT_MASK,
+                                               header[7:self.header_len - 4])
+        else:
+            destinations = list(header[6:self.header_len - 4])
+
+        can.logging.debug("Datagram successfully decoded.")
+        return bytes(self.data), destinations
+
 def datagram_to_frames(datagram, source):
     """
     Transforms a raw datagram into CAN frames.
     """
     start_bit = START_OF_DATAGRAM_MASK
 
-    while len(datagram) > 8:
-        data, datagram = datagram[:8], datagram[8:]
-
-        yield Frame(id=start_bit + source, data=data)
+    for offset in range(0, max(len(datagram), 1), 8):
+        yield Frame(id=start_bit + source, data=datagram[offset:offset + 8])
 
         start_bit = 0
 
-    yield Frame(id=start_bit + source, data=datagram)
-
@@ -5,15 +5,15 @@ Update microcontroller firmware using CVRA bootloading protocol.
 from sys import exit
 from os.path import exists
 import logging
-from cvra_bootloader import page, commands, utils
+from cvra_bootloader import page, commands, utils, image, scheduler
 from cvra_bootloader.error import Error
+import can
 import msgpack
 from zlib import crc32
 from progressbar import ProgressBar
-from subprocess import Popen, PIPE
-from shlex import split
-from re import search
-from time import sleep
+from time import sleep, time
+from threading import Lock, Thread, local
+from collections import namedtuple
 
 
 #
@@ -28,15 +28,59 @@ ENUMERATION_RETRIES = 3
 #
 ENUMERATION_RESPONSE_DELAY = 0.010
 
+#
+# Number of pages written without replies (see --nack-only)
+# before the nodes are asked for the checksum of these pages
+#
+CHECKPOINT_PAGES = 16
+
+#
+# Resolution of the combined progress bar of several buses (see --bus)
+#
+BUS_PROGRESS_STEPS = 1000
+
+#
+# Number of seconds after the first reply to a command of the per node scheduler,
+# within which the other nodes must reply to stay in the same cohort
+#
+COHORT_WINDOW = 0.01
+
+#
+# Page size for nodes, which don't report their capabilities (see negotiate_transfer)
+#
+DEFAULT_PAGE_SIZE = 2048
+
+#
+# Largest negotiated page size, since larger pages make retransmissions expensive
+#
+MAX_PAGE_SIZE = 8192
+
+#
+# Size of a write command besides data and device class, i.e. MessagePack headers,
+# command index, address and the wrapper of sequenced commands
+#
+WRITE_COMMAND_OVERHEAD = 32
+
+#
+# Reply codes, which give up a node instead of retrying the command
+#
+FATAL_ERRORS = (Error.FLASH_ERASE_ERROR_BEFORE_APP,
+                Error.FLASH_ERASE_ERROR_AFTER_APP,
+                Error.FLASH_ERASE_ERROR_DEVICE_CLASS_MISMATCH,
+                Error.FLASH_WRITE_ERROR_BEFORE_APP,
+                Error.FLASH_WRITE_ERROR_AFTER_APP,
+                Error.FLASH_WRITE_ERROR_DEVICE_CLASS_MISMATCH,
+                Error.FLASH_WRITE_ERROR_NOT_ERASED)
+
 
 def parse_commandline_args(args=None):
     """
     Parses the program commandline arguments.
     Args must be an array containing all arguments.
     """
-    parser = utils.ConnectionArgumentParser(description=__doc__)
+    parser = utils.ConnectionArgumentParser(description=__doc__, multiple_buses=True)
     parser.add_argument('-f', '--file', dest='image_file',
-                        help='Path to the application image to flash',
+                        help='Path to the application image to flash (ELF, Intel HEX or raw binary)',
                         required=True,
                         metavar='FILE')
 
@@ -50,12 +94,49 @@ def parse_commandline_args(args=None):
                         dest='device_class',
                         help='Device class to flash', required=True)
 
+    parser.add_argument('--class-addressing',
+                        dest='class_addressing',
+                        help='Address erase and write commands to all nodes of the device class '
+                             'instead of listing every ID (requires compact datagram support)',
+                        action='store_true')
+
+    parser.add_argument('--slotted-replies',
+                        dest='slotted_replies',
+                        help='Let the nodes reply to erase and write commands one after another '
+                             'instead of all at once (requires compact datagram support)',
+                        action='store_true')
+
+    parser.add_argument('--sequenced',
+                        help='Wrap erase and write commands with sequence tokens, so that retries '
+                             'never execute them twice on nodes whose reply was lost. '
+                             'Enabled automatically, if all nodes support sequenced commands',
+                        action='store_true')
+
+    parser.add_argument('--nack-only',
+                        dest='nack_only',
+                        help='Write pages without waiting for replies, nodes only reply on errors. '
+                             'The written pages are verified by checksum every {} pages '
+                             '(requires compact datagram support)'.format(CHECKPOINT_PAGES),
+                        action='store_true')
+
+    parser.add_argument('--independent',
+                        help='Let every node erase, write and verify at its own pace. '
+                             'Nodes in the same state share multicast commands, '
+                             'lagging nodes are caught up with commands of their own',
+                        action='store_true')
+
+    parser.add_argument('--resume',
+                        help='Resume an interrupted --resume session of the same image, '
+                             'beginning at the first page not written on all nodes',
+                        action='store_true')
+
     parser.add_argument('-r', '--run',
                         help='Run application after flashing',
                         action='store_true')
 
-    parser.add_argument("--page-size", type=int, default=2048,
-                        help="Page size in bytes (default 2048)")
+    parser.add_argument("--page-size", type=int,
+                        help="Page size in bytes (default: the largest page all nodes can receive, "
+                             "{} for nodes not reporting their capabilities)".format(DEFAULT_PAGE_SIZE))
 
     parser.add_argument("ids",
                         metavar='DEVICEID',
@@ -64,31 +145,151 @@ def parse_commandline_args(args=None):
 
     args = parser.parse_args(args)
 
-    if args.image_file[-4:] == ".elf" and args.base_address != None:
-        parser.error("Multiple target addresses. The specified image is an ELF and already contains a target address.")
+    if args.independent and (args.nack_only or args.resume or args.class_addressing):
+        parser.error("--independent cannot be combined with --nack-only, --resume or --class-addressing.")
+
+    if image_has_address(args.image_file) and args.base_address != None:
+        parser.error("Multiple target addresses. The specified image is an ELF or HEX file and already contains a target address.")
 
-    if args.image_file[-4:] != ".elf" and args.base_address is None:
+    if not image_has_address(args.image_file) and args.base_address is None:
         parser.error("Please specify the flash address to which your binary shall be written.")
 
     return args
 
 
+#
+# State of the flash session running in the current thread
+#
+session = local()
+
+
+def progress_bar(maxval):
+    """
+    Returns a started progress bar for the flash session running in the current thread.
+
+    When several buses are flashed at once, it reports to their combined progress bar.
+    """
+    factory = getattr(session, 'progress_bar', ProgressBar)
+    return factory(maxval=maxval).start()
+
+
+class BusProgress:
+    """
+    Shows the combined progress of the flash sessions on several buses in one progress bar.
+
+    Every session shows bars_per_session progress bars one after another,
+    e.g. for erasing and writing, each counting as an equal share of the session.
+    """
+    def __init__(self, buses, bars_per_session):
+        self.bars_per_session = bars_per_session
+        self.lock = Lock()
+        self.bars_started = {bus: 0 for bus in buses}
+        self.progress = {bus: 0. for bus in buses}
+        self.pbar = ProgressBar(maxval=BUS_PROGRESS_STEPS).start()
+
+    def factory(self, bus):
+        """
+        Returns the progress bar factory for the session on the given bus.
+        """
+        return lambda maxval: SessionProgress(self, bus, maxval)
+
+    def update(self, bus, progress):
+        with self.lock:
+            self.progress[bus] = min(progress, 1.)
+            total = sum(self.progress.values()) / len(self.progress)
+            self.pbar.update(int(BUS_PROGRESS_STEPS * total))
+
+    def finish(self):
+        self.pbar.finish()
+
+
+class SessionProgress:
+    """
+    Progress bar of the flash session on one bus, see BusProgress.
+    """
+    def __init__(self, bus_progress, bus, maxval):
+        self.bus_progress = bus_progress
+        self.bus = bus
+        self.maxval = max(maxval, 1)
+
+    def start(self):
+        with self.bus_progress.lock:
+            self.bar = self.bus_progress.bars_started[self.bus]
+            self.bus_progress.bars_started[self.bus] += 1
+        return self
+
+    def update(self, value):
+        share = (self.bar + min(value / self.maxval, 1.)) / self.bus_progress.bars_per_session
+        self.bus_progress.update(self.bus, share)
+
+    def finish(self):
+        self.update(self.maxval)
+
+
 def flash_image(connection, binary, base_address, device_class, destinations,
-                 page_size=2048):
+                 page_size=2048, class_addressing=False, slotted_replies=False, nack_only=False,
+                 resume=False, independent=False, sequenced=False, erase_size=None,
+                 asynchronous=False):
     """
     Writes a full binary to the flash using the given file descriptor.
 
     It also takes the binary image, the base address and the device class as
     parameters.
+
+    With class addressing, erase and write commands are sent to all nodes
+    of the device class and omit the device class argument.
+    Retransmissions are still addressed to the individual nodes.
+
+    With slotted replies, the nodes reply to erase and write commands one after another.
+
+    With nack_only, pages are written by write_pages_quiet. Nodes failing
+    a checkpoint are flashed again, one after another, with acknowledged writes.
+
+    With resume, the flash session of the image is resumed on all destinations
+    and only the pages following the written part are erased and written.
+
+    With independent, the pages are erased, written and verified by
+    flash_pages_independently. The configuration of failed nodes is not updated.
+
+    With sequenced, erase and write commands carry sequence tokens,
+    so that their retransmissions are answered without executing them again.
+
+    Pages are erased in steps of erase_size (default page_size), which must divide page_size.
+
+    With asynchronous, pages are erased and the configuration is saved by asynchronous
+    commands, so that their long execution doesn't time out and trigger retransmissions.
     """
 
     errors_occured = False
+    erase_size = erase_size or page_size
+    group = can.DeviceClassDestination(device_class) if class_addressing else None
+    flags = can.FLAG_SLOTTED_REPLY if slotted_replies else 0
+
+    start = 0
+    if resume:
+        start = resume_offset(connection, binary, base_address, destinations, page_size)
+        if start > 0:
+            print("Resuming at offset {}".format(start))
+
+    if independent:
+        print("Flashing pages...")
+        failed_boards = flash_pages_independently(connection, binary, base_address, device_class,
+                                                  destinations, page_size=page_size, flags=flags,
+                                                  erase_size=erase_size)
+        if failed_boards:
+            msg = ", ".join(str(id) for id in sorted(failed_boards))
+            logging.critical("The following boards failed to flash: {}".format(msg))
+
+        update_application_config(connection, binary,
+                                  [id for id in destinations if id not in failed_boards],
+                                  asynchronous=asynchronous)
+        return
 
     print("Erasing pages...")
-    pbar = ProgressBar(maxval=len(binary)).start()
+    pbar = progress_bar(len(binary))
 
     # First erase all pages
-    for offset in range(0, len(binary), page_size):
+    for offset in range(start, len(binary), erase_size):
         retry = True
         while retry:
             retry = False
@@ -104,7 +305,13 @@ def flash_image(connection, binary, base_address, device_class, destinations,
             # Failing to receive a reply does not need to result in program exit during flash erase.
             # The erase frame might have been received and applied properly.
             # If not, the flash write and checksum process will fail anyway.
-            res = utils.write_command_retry(connection, erase_command, destinations, retry_limit=5, error_exit=False)
+            group_command = commands.encode_erase_flash_page(base_address + offset)
+            if asynchronous:
+                res = utils.write_command_async(connection, erase_command, destinations)
+            else:
+                res = utils.write_command_retry(connection, erase_command, destinations, retry_limit=5, error_exit=False,
+                                                group=group, group_command=group_command, flags=flags,
+                                                sequenced=sequenced)
 
             # Treat the one byte replies of every node as boolean: 1=success, 0=erase failed
             failed_boards = [str(id) for id, status in res.items()
@@ -178,127 +385,465 @@ def flash_image(connection, binary, base_address, device_class, destinations,
 
     pbar.finish()
 
-    print("Writing pages...")
-    pbar = ProgressBar(maxval=len(binary)).start()
+    if resume:
+        # Erasing a flash sector may have erased written pages in front of the first erased page
+        start = min(start, resume_offset(connection, binary, base_address, destinations, page_size,
+                                         verify=False))
+
+    if nack_only:
+        print("Writing pages...")
+        failed_boards = write_pages_quiet(connection, binary, base_address, device_class, destinations,
+                                          page_size=page_size, group=group, flags=flags, start=start)
+
+        # Flash the failed boards again, without relying on the other boards' progress
+        for id in sorted(failed_boards):
+            logging.warning("Board " + str(id) + " failed a checkpoint, flashing it again")
+            flash_image(connection, binary, base_address, device_class, [id],
+                        page_size=page_size, slotted_replies=slotted_replies, sequenced=sequenced,
+                        erase_size=erase_size, asynchronous=asynchronous)
+
+        # Their configuration was updated already
+        destinations = [id for id in destinations if id not in failed_boards]
+    else:
+        print("Writing pages...")
+        pbar = progress_bar(len(binary))
+
+        # Then write all pages in chunks
+        # The commands are encoded once, ahead of their transmission
+        encoded_pages = encode_pages(binary, base_address, device_class, destinations,
+                                     page_size=page_size, start=start, group=group, flags=flags)
+        for offset, command, group_command in utils.prefetch(encoded_pages):
+            if command is None:
+                # Erased pages need not be written
+                continue
+
+            retry = True
+            while retry:
+                retry = False
+
+                # print("Writing {} bytes to address {}".format(page_size, "0x" + hex(base_address + offset)[2:].zfill(8)))
+                res = utils.write_command_retry(connection, command, destinations, retry_limit=0, error_exit=False, retry_forever=True,
+                                                group=group, group_command=group_command, flags=flags,
+                                                sequenced=sequenced)
+
+                failed_boards = [str(id) for id, status in res.items()
+                                 if msgpack.unpackb(status) != 1]
+
+                # Debug the received CAN replies
+                if args.verbose:
+                    node_count = len(res.items())
+                    logging.info("Got replies from " + str(node_count) + " node" + ("s" if node_count != 1 else "") + ": " + ", ".join([str(id) for id, success in res.items()]))
+                    for id, status in res.items():
+                        code = msgpack.unpackb(status)
+                        if code != 1:
+                            continue
+                        msg = "Board " + str(id) + " reports success"
+                        logging.info(msg)
+
+                if failed_boards:
+                    # Print all received error codes
+                    fatal = False
+                    error_message = True
+                    for id, status in res.items():
+                        code = msgpack.unpackb(status)
+                        if code == Error.SUCCESS:
+                            continue
+                        msg = "Board " + str(id) + " reports error " + str(code)
+                        if code == Error.UNSPECIFIED_ERROR:
+                            error = "unspecified error"
+                        elif code == Error.CORRUPT_DATAGRAM:
+                            error = "datagram error"
+                            if not args.verbose:
+                                error_message = False
+                            retry = True
+                        elif code == Error.DATAGRAM_TIMEOUT:
+                            error = "datagram timed out"
+                            # utils.INTER_FRAME_DELAY += 0.001
+                            retry = True
+                        elif code == Error.FLASH_WRITE_ERROR_BEFORE_APP:
+                            error = "illegal attempt to write before app section"
+                            fatal = True
+                        elif code == Error.FLASH_WRITE_ERROR_AFTER_APP:
+                            error = "illegal attempt to write after app section"
+                            fatal = True
+                        elif code == Error.FLASH_WRITE_ERROR_DEVICE_CLASS_MISMATCH:
+                            error = "device class mismatch"
+                            fatal = True
+                        elif code == Error.FLASH_WRITE_ERROR_UNKNOWN_SIZE:
+                            error = "image size not specified"
+                        elif code == Error.FLASH_WRITE_ERROR_NOT_ERASED:
+                            error = "target flash area not erased properly"
+                            fatal = True
+                        else:
+                            error = "unrecognized status code"
+
+                        if error_message:
+                            msg = msg + " (" + error + ")"
+                            logging.error(msg)
+
+                    if fatal:
+                        logging.critical("Exiting due to fatal error.")
+                        exit(1)
+
+                    if not retry:
+                        # Print list of failed boards
+                        msg = ", ".join(failed_boards)
+                        msg = "The following board" + ("s" if len(failed_boards) != 1 else "") + " failed to write flash pages: {}".format(msg)
+                        logging.critical(msg)
+                        errors_occured = True
+
+            pbar.update(offset)
+        pbar.finish()
 
-    # Then write all pages in chunks
-    for offset, chunk in enumerate(page.slice_into_pages(binary, page_size)):
-        offset *= page_size
+    if errors_occured:
+        logging.warn("Errors occured, the flash procedure might have failed on some destinations.")
 
-        retry = True
-        while retry:
-            retry = False
+    # Finally update application CRC and size in config
+    update_application_config(connection, binary, destinations, asynchronous=asynchronous)
 
-            command = commands.encode_write_flash(chunk,
-                                                  base_address + offset,
-                                                  device_class)
 
-            # print("Writing {} bytes to address {}".format(page_size, "0x" + hex(base_address + offset)[2:].zfill(8)))
-            res = utils.write_command_retry(connection, command, destinations, retry_limit=0, error_exit=False, retry_forever=True)
+def update_application_config(connection, binary, destinations, asynchronous=False):
+    """
+    Stores the size and CRC of the flashed application in the configuration of the destinations.
 
-            failed_boards = [str(id) for id, status in res.items()
-                             if msgpack.unpackb(status) != 1]
+    With asynchronous, the configuration is saved by an asynchronous command.
+    """
+    print("Updating bootloader configuration page...")
+    config = dict()
+    config['application_size'] = len(binary)
+    config['application_crc'] = crc32(binary)
+    utils.config_update_and_save(connection, config, destinations, asynchronous=asynchronous)
+    print("Updated.")
 
-            # Debug the received CAN replies
-            if args.verbose:
-                node_count = len(res.items())
-                logging.info("Got replies from " + str(node_count) + " node" + ("s" if node_count != 1 else "") + ": " + ", ".join([str(id) for id, success in res.items()]))
-                for id, status in res.items():
-                    code = msgpack.unpackb(status)
-                    if code != 1:
-                        continue
-                    msg = "Board " + str(id) + " reports success"
-                    logging.info(msg)
 
-            if failed_boards:
-                # Print all received error codes
-                fatal = False
-                error_message = True
-                for id, status in res.items():
-                    code = msgpack.unpackb(status)
-                    if code == Error.SUCCESS:
-                        continue
-                    msg = "Board " + str(id) + " reports error " + str(code)
-                    if code == Error.UNSPECIFIED_ERROR:
-                        error = "unspecified error"
-                    elif code == Error.CORRUPT_DATAGRAM:
-                        error = "datagram error"
-                        if not args.verbose:
-                            error_message = False
-                        retry = True
-                    elif code == Error.DATAGRAM_TIMEOUT:
-                        error = "datagram timed out"
-                        # utils.INTER_FRAME_DELAY += 0.001
-                        retry = True
-                    elif code == Error.FLASH_WRITE_ERROR_BEFORE_APP:
-                        error = "illegal attempt to write before app section"
-                        fatal = True
-                    elif code == Error.FLASH_WRITE_ERROR_AFTER_APP:
-                        error = "illegal attempt to write after app section"
-                        fatal = True
-                    elif code == Error.FLASH_WRITE_ERROR_DEVICE_CLASS_MISMATCH:
-                        error = "device class mismatch"
-                        fatal = True
-                    elif code == Error.FLASH_WRITE_ERROR_UNKNOWN_SIZE:
-                        error = "image size not specified"
-                    elif code == Error.FLASH_WRITE_ERROR_NOT_ERASED:
-                        error = "target flash area not erased properly"
-                        fatal = True
-                    else:
-                        error = "unrecognized status code"
+def resume_offset(connection, binary, base_address, destinations, page_size=2048, verify=True):
+    """
+    Begins or resumes the flash session of the image on all destinations.
 
-                    if error_message:
-                        msg = msg + " (" + error + ")"
-                        logging.error(msg)
+    Returns the offset of the first page, which is not written on all destinations.
+    With verify, the written part is confirmed by its checksum,
+    otherwise the image is written from the beginning.
+    """
+    command = commands.encode_flash_session(base_address, len(binary), crc32(binary))
+    res = utils.write_command_retry(connection, command, destinations, error_exit=False)
+    if len(res) < len(destinations):
+        return 0
 
-                if fatal:
-                    logging.critical("Exiting due to fatal error.")
-                    exit(1)
+    written = min(msgpack.unpackb(status) for status in res.values())
+    offset = (written // page_size) * page_size
+    if offset == 0 or not verify:
+        return offset
 
-                if not retry:
-                    # Print list of failed boards
-                    msg = ", ".join(failed_boards)
-                    msg = "The following board" + ("s" if len(failed_boards) != 1 else "") + " failed to write flash pages: {}".format(msg)
-                    logging.critical(msg)
-                    errors_occured = True
+    expected_crc = crc32(binary[:offset])
+    command = commands.encode_crc_region(base_address, offset)
+    res = utils.write_command_retry(connection, command, destinations, error_exit=False)
+    for id in destinations:
+        if id not in res or msgpack.unpackb(res[id]) != expected_crc:
+            logging.warning("Written part of the image does not match on board " + str(id) + ", starting over")
+            return 0
 
-        pbar.update(offset)
-    pbar.finish()
+    return offset
 
-    if errors_occured:
-        logging.warn("Errors occured, the flash procedure might have failed on some destinations.")
 
-    # Finally update application CRC and size in config
-    print("Updating bootloader configuration page...")
-    config = dict()
-    config['application_size'] = len(binary)
-    config['application_crc'] = crc32(binary)
-    utils.config_update_and_save(connection, config, destinations)
-    print("Updated.")
+def encode_pages(binary, base_address, device_class, destinations, page_size=2048, start=0,
+                 group=None, flags=0):
+    """
+    Yields the offset, the write command and the write command for the group (if any)
+    of every page from offset start on. The commands are None for erased pages.
+
+    The datagrams to the group or the destinations are added to the datagram cache,
+    such that they are ready for transmission and retransmissions.
+    """
+    for index, chunk in enumerate(page.slice_into_pages(binary, page_size)):
+        offset = index * page_size
+        if offset < start:
+            continue
+
+        if image.is_erased(chunk):
+            yield offset, None, None
+            continue
+
+        address = base_address + offset
+        command = commands.encode_write_flash(chunk, address, device_class)
+        group_command = None
+        if group is not None:
+            group_command = commands.encode_write_flash(chunk, address)
+            utils.datagram_cache.frames(group_command, group, flags=flags)
+        else:
+            utils.datagram_cache.frames(command, destinations, flags=flags)
 
+        yield offset, command, group_command
 
-def verify_flash_write(connection, binary, base_address, destinations):
+
+def receive_error_replies(connection, reader):
     """
-    Check that the binary was correctly written to all destinations.
+    Returns the IDs of all nodes whose replies to quiet commands were received so far.
 
-    Returns a list of all nodes which are passing the test.
+    Nodes only reply to quiet commands, if the command failed.
     """
+    failed_boards = set()
+    while not connection.rx_queue.empty():
+        dt = next(reader)
+        if dt is None:
+            continue
 
-    # Calculate checksum on local binary
-    logging.info("Generating checksum of input file...")
+        answer, _, src = dt
+        logging.error("Board " + str(src) + " reports error " + str(msgpack.unpackb(answer)))
+        failed_boards.add(src)
+
+    return failed_boards
+
+
+def write_pages_quiet(connection, binary, base_address, device_class, destinations,
+                      page_size=2048, checkpoint_pages=CHECKPOINT_PAGES, group=None, flags=0, start=0):
+    """
+    Writes all pages from offset start on with can.FLAG_QUIET, so that only failing nodes reply.
+
+    After every checkpoint_pages pages, the nodes are asked for the checksum
+    of these pages. Nodes reporting an error or a wrong checksum are no longer
+    addressed. Returns the set of those nodes.
+    """
+    reader = utils.read_can_datagrams(connection)
+    pages = list(page.slice_into_pages(binary, page_size))
+    failed_boards = set()
+    pbar = progress_bar(len(binary))
+
+    encoded_pages = utils.prefetch(encode_pages(binary, base_address, device_class, destinations,
+                                                page_size=page_size, start=start, group=group,
+                                                flags=flags | can.FLAG_QUIET))
+
+    for first in range(start // page_size, len(pages), checkpoint_pages):
+        for index in range(first, min(first + checkpoint_pages, len(pages))):
+            _, command, group_command = next(encoded_pages)
+            if command is None:
+                continue
+
+            # The group includes the failed boards, so it is only used until the first failure
+            if group is not None and not failed_boards:
+                utils.write_command(connection, group_command, group, flags=flags | can.FLAG_QUIET)
+            else:
+                nodes = [id for id in destinations if id not in failed_boards]
+                utils.write_command(connection, command, nodes, flags=flags | can.FLAG_QUIET)
+
+            failed_boards |= receive_error_replies(connection, reader)
+            pbar.update(index * page_size)
+
+        # Checkpoint: Compare the checksum of the pages written since the last checkpoint
+        start = first * page_size
+        end = min(len(binary), (first + checkpoint_pages) * page_size)
+        expected_crc = crc32(binary[start:end])
+        nodes = [id for id in destinations if id not in failed_boards]
+        if not nodes:
+            break
+
+        command = commands.encode_crc_region(base_address + start, end - start)
+        res = utils.write_command_retry(connection, command, nodes, error_exit=False, flags=flags)
+
+        for id in nodes:
+            if id not in res or msgpack.unpackb(res[id]) != expected_crc:
+                logging.error("Board " + str(id) + " failed checkpoint at " + format(base_address + start, "#010x"))
+                failed_boards.add(id)
+
+    pbar.finish()
+    return failed_boards
+
+
+def encode_step(request, binary, base_address, device_class, page_size=2048):
+    """
+    Returns the command for a step of the per node scheduler.
+    """
+    if request.step == scheduler.ERASE:
+        return commands.encode_erase_flash_page(base_address + request.offset, device_class)
+    if request.step == scheduler.WRITE:
+        chunk = memoryview(binary)[request.offset:request.offset + page_size]
+        return commands.encode_write_flash(chunk, base_address + request.offset, device_class)
+    return commands.encode_crc_region(base_address, len(binary))
+
+
+def flash_pages_independently(connection, binary, base_address, device_class, destinations,
+                              page_size=2048, flags=0, timeout=None, window=COHORT_WINDOW,
+                              erase_size=None, timer=None):
+    """
+    Erases, writes and verifies the image with a scheduler.FlashScheduler,
+    so that every node progresses at its own pace.
+
+    The commands of all idle cohorts are sent at once and the replies are collected
+    as they arrive. The nodes replying within window seconds of the first reply
+    to a command advance together, the others once they replied.
+    Pages are erased in steps of erase_size (default page_size).
+
+    Nodes are given the retransmission timeout of the step to reply (see utils.RetransmissionTimer),
+    or timeout seconds if given. After that, no command is sent to them for another timeout,
+    so that a late reply is passed to the scheduler for the step it belongs to,
+    instead of being taken for the reply to a retransmission or to the next step.
+    Nodes which didn't reply by then are sent the command again.
+
+    Returns the set of nodes, which reported a fatal error or didn't complete a step.
+    """
+    timer = timer or utils.retransmission_timer
+    pages = list(page.slice_into_pages(binary, page_size))
+    erase_offsets = list(range(0, len(binary), erase_size or page_size))
+    write_offsets = [index * page_size for index, chunk in enumerate(pages) if not image.is_erased(chunk)]
     expected_crc = crc32(binary)
-    print("Expecting checksum: " + format(expected_crc, '#08x'))
 
-    # Instruct the target nodes to calculate a checksum on their flash content
-    logging.info("Encoding request to calculate checksum for address range " + format(base_address, "#010x") + "-" + format(base_address + len(binary), "#010x"))
-    command = commands.encode_crc_region(base_address, len(binary))
+    sched = scheduler.FlashScheduler(destinations, erase_offsets, write_offsets)
+    reader = utils.read_can_datagrams(connection)
+    pending = dict()        # Request by node ID, until the node replied
+    outstanding = dict()    # Replies not yet passed to the scheduler, deadline, time of first reply,
+                            # time sent, command type and timeout
+    late = dict()           # Timed out request and end of the wait for a late reply by node ID
+    pbar = progress_bar(100)
+
+    def release(request, answers, nodes):
+        """
+        Passes the replies of the given nodes to the scheduler.
+        """
+        success = expected_crc if request.step == scheduler.VERIFY else Error.SUCCESS
+        succeeded = [id for id in nodes if answers.get(id) == success]
+        if request.step == scheduler.VERIFY:
+            fatal = [id for id in nodes if id in answers and answers[id] != success]
+        else:
+            fatal = [id for id in nodes if answers.get(id) in FATAL_ERRORS]
+
+        for id in nodes:
+            if id in answers and answers[id] != success:
+                logging.error("Board {} reports {} at {:#010x} failed with {}".format(
+                    id, request.step, base_address + request.offset, answers[id]))
+            answers.pop(id, None)
+            pending.pop(id, None)
+
+        sched.completed(request, succeeded, fatal, nodes)
+
+    while not sched.done():
+        for request in sched.next_requests():
+            command = encode_step(request, binary, base_address, device_class, page_size)
+            nodes = list(request.nodes)
+            utils.write_command(connection, command, nodes, flags=flags)
+            timer.sent(nodes)
+
+            step_timeout = timer.timeout(nodes, command, flags) if timeout is None else timeout
+            now = time()
+            outstanding[request] = [dict(), now + step_timeout, None, now, utils.command_type(command),
+                                    step_timeout]
+            for id in request.nodes:
+                pending[id] = request
+
+        dt = next(reader)
+        now = time()
+        if dt is not None:
+            answer, _, src = dt
+            if src in late:
+                # No other command is outstanding for the node, so the reply is unambiguous
+                logging.debug("Late reply of board {}".format(src))
+                request, _ = late.pop(src)
+                release(request, {src: msgpack.unpackb(answer)}, [src])
+            elif src in pending:
+                request = pending.pop(src)
+                entry = outstanding[request]
+                entry[0][src] = msgpack.unpackb(answer)
+                if entry[2] is None:
+                    entry[2] = now
+
+                # Replies to retransmitted commands are ambiguous (see RetransmissionTimer)
+                if sched.nodes[src].attempts == 0:
+                    timer.sample(src, entry[4], now - entry[3])
+
+        for id, (request, until) in list(late.items()):
+            if now >= until:
+                del late[id]
+                release(request, {}, [id])
+
+        for request, (answers, deadline, first_reply, _, kind, step_timeout) in list(outstanding.items()):
+            waiting = [id for id in request.nodes if pending.get(id) is request]
+            if now >= deadline:
+                release(request, answers, list(answers))
+                timer.lost(waiting, kind)
+                for id in waiting:
+                    pending.pop(id)
+                    late[id] = (request, now + step_timeout)
+            elif answers and (not waiting or now >= first_reply + window):
+                release(request, answers, list(answers))
+                outstanding[request][2] = None
+
+            if not [id for id in request.nodes if pending.get(id) is request]:
+                del outstanding[request]
+
+        pbar.update(int(100 * sched.progress()))
+
+    pbar.finish()
+    return sched.failed()
+
+
+#
+# Transfer parameters negotiated with the nodes of a bus, see negotiate_transfer()
+#
+Transfer = namedtuple('Transfer', ['page_size', 'erase_size', 'delay', 'sequenced', 'asynchronous'])
+
+
+def negotiate_transfer(connection, destinations, device_class, page_size=None):
+    """
+    Returns the page size, the erase size, the inter frame delay and whether commands
+    can be sequenced or executed asynchronously for flashing the destinations,
+    according to their capabilities.
+
+    Unless a page size is given, the largest power of two up to MAX_PAGE_SIZE is chosen,
+    whose write command fits into the input buffer of every destination.
+    Pages are erased in steps of the smallest flash page of the destinations.
+    Frames are sent without delay, if every destination buffers a whole write command,
+    and at least MAX_INTER_FRAME_DELAY apart otherwise.
+    Commands are sequenced, if every destination supports sequenced commands.
+    Erase, checksum and config save commands are executed asynchronously,
+    if every destination supports asynchronous commands.
+
+    If a destination doesn't report its capabilities, e.g. since its bootloader is older,
+    DEFAULT_PAGE_SIZE and the current frame delay are used.
+    """
+    delay = utils.INTER_FRAME_DELAY
+    capabilities = utils.read_capabilities(connection, destinations)
+    if len(capabilities) < len(destinations):
+        page_size = page_size or DEFAULT_PAGE_SIZE
+        return Transfer(page_size, page_size, delay, False, False)
+
+    overhead = WRITE_COMMAND_OVERHEAD + len(device_class)
+    if page_size is None:
+        limit = min(c['input_buffer'] for c in capabilities.values()) - overhead
+        limit = max(1, min(limit, MAX_PAGE_SIZE))
+        page_size = 1 << (limit.bit_length() - 1)
+
+    erase_size = min([page_size] + [c['flash_page'] for c in capabilities.values() if c['flash_page']])
+
+    frames = utils.datagram_frame_count(page_size + overhead, len(destinations))
+    if all(c['rx_frames'] >= frames for c in capabilities.values()):
+        delay = 0.
+    else:
+        # Adapters which send without delay by themselves (see open_connection)
+        # would otherwise overrun the nodes
+        delay = max(delay, utils.MAX_INTER_FRAME_DELAY)
+
+    sequenced = all(commands.CommandType.Sequenced in c.get('commands', ())
+                    for c in capabilities.values())
+    asynchronous = all(commands.CommandType.SubmitAsync in c.get('commands', ())
+                       for c in capabilities.values())
+
+    return Transfer(page_size, erase_size, delay, sequenced, asynchronous)
+
+
+def read_checksums(connection, command, destinations, asynchronous=False):
+    """
+    Sends the checksum command to the destinations and yields the answer and ID of every reply.
+
+    With asynchronous, the command is executed asynchronously and destinations
+    which didn't finish it in time are skipped.
+    """
+    if asynchronous:
+        for src, answer in utils.write_command_async(connection, command, destinations).items():
+            yield answer, src
+        return
+
     utils.write_command(connection, command, destinations)
 
     # Read all the nodes' replies
     reader = utils.read_can_datagrams(connection)
-
-    # Compare all the replied checksums to our checksum
-    valid_nodes = []
     boards_checked = 0
     while boards_checked < len(destinations):
         dt = next(reader)
@@ -307,7 +852,31 @@ def verify_flash_write(connection, binary, base_address, destinations):
             continue
 
         answer, _, src = dt
+        yield answer, src
+        boards_checked += 1
+
+
+def verify_flash_write(connection, binary, base_address, destinations, asynchronous=False):
+    """
+    Check that the binary was correctly written to all destinations.
 
+    With asynchronous, the checksum is calculated by an asynchronous command.
+
+    Returns a list of all nodes which are passing the test.
+    """
+
+    # Calculate checksum on local binary
+    logging.info("Generating checksum of input file...")
+    expected_crc = crc32(binary)
+    print("Expecting checksum: " + format(expected_crc, '#08x'))
+
+    # Instruct the target nodes to calculate a checksum on their flash content
+    logging.info("Encoding request to calculate checksum for address range " + format(base_address, "#010x") + "-" + format(base_address + len(binary), "#010x"))
+    command = commands.encode_crc_region(base_address, len(binary))
+
+    # Compare all the replied checksums to our checksum
+    valid_nodes = []
+    for answer, src in read_checksums(connection, command, destinations, asynchronous):
         crc = msgpack.unpackb(answer)
         print("Node " + str(src) + " reports checksum: " + format(crc, '#08x'))
 
@@ -320,8 +889,6 @@ def verify_flash_write(connection, binary, base_address, destinations):
         elif crc == 32:
             logging.error("Node replied with status code: 32 (illegal address)")
 
-        boards_checked += 1
-
     # Return list of nodes with matching checksum
     return valid_nodes
 
@@ -384,53 +951,92 @@ def enumerate_online_nodes(connection, boards):
     return online_boards
 
 
-def image_is_elf(filename):
-    return filename[-4:] == ".elf"
+def map_nodes_to_buses(connections, ids):
+    """
+    Returns the IDs of the nodes on every bus, given as dict of utils.Bus and connection.
 
+    Buses given without IDs are searched for the nodes, which are not on any other bus.
+    """
+    nodes = {bus: [id for id in ids if id in bus.ids] for bus in connections if bus.ids}
 
-def elf_convert_to_binary(infile, outfile):
-    logging.info("Converting ELF to binary: " + infile + " -> " + outfile)
-    # Run objcopy to convert ELF to binary
-    cmd = "arm-none-eabi-objcopy -O binary " + infile + " " + outfile
-    Popen(split(cmd)).wait()
+    unassigned = [id for id in ids if not any(id in n for n in nodes.values())]
+    for bus, connection in connections.items():
+        if bus.ids:
+            continue
+        online = enumerate_online_nodes(connection, unassigned) if unassigned else set()
+        nodes[bus] = [id for id in unassigned if id in online]
+        unassigned = [id for id in unassigned if id not in online]
 
+    return nodes
 
-def elf_extract_start_address(filename):
-    # Run objdump to list the ELF's sections
-    logging.info("Invoking arm-none-eabi-objdump to list ELF sections...")
-    cmd = "arm-none-eabi-objdump -h " + filename
-    lines = Popen(split(cmd), stdout=PIPE).communicate()[0].decode("utf-8")
-#    lines = lines.split("\n")
 
-    # Search for vector table or code section
-    logging.info("Parsing section table...")
-    find_section_names = [".vector", ".vectors", ".isr_vector", ".isr_vector_table", ".vector_table", ".text"]
-    for section in find_section_names:
-        # Search for section name in objdump output using regular expressions
-        # ID  Name  Size  VMA ...
-        section_escaped = section.replace(".", "\.")
-        m = search("[ \t0-9]*" + section_escaped + "\s+[x0-9a-fA-F]*\s+([x0-9a-fA-F]*)", lines)
-        if m is None:
-            # not found
-            continue
-        # found
-        logging.info("Found section: " + section)
-        address = m.group(1)
-        if address is None:
-            logging.error("Encountered illegal address for section " + section)
-            continue
-        if address[:2] != "0x" and address[:2] != "0X":
-            address = "0x" + address.zfill(8)
-        logging.info("Extracted target address: " + address)
-        address = int(address, 16)
-        if address is None:
-            logging.error("Failed to convert address to integer: " + section)
-            continue
-        return address
+def flash_buses(args, binary):
+    """
+    Flashes the nodes on all buses given with --bus concurrently, one thread per bus,
+    such that the total time is set by the slowest bus.
+
+    Returns the set of nodes which failed, including the nodes of buses whose session was aborted.
+    """
+    connections = {bus: utils.open_connection(utils.bus_args(args, bus)) for bus in args.buses}
+    nodes = map_nodes_to_buses(connections, args.ids)
+
+    offline_boards = set(args.ids)
+    for bus, ids in nodes.items():
+        if ids:
+            offline_boards -= enumerate_online_nodes(connections[bus], ids)
+    if offline_boards:
+        print("The following boards are offline: {}".format(", ".join(str(i) for i in sorted(offline_boards))) + ". Aborting.")
+        exit(3)
 
-    # Address could not be extracted.
-    logging.critical("Flash address could not be extracted from ELF.")
-    return
+    buses = [bus for bus in args.buses if nodes[bus]]
+    for bus in buses:
+        print("Bus {}: nodes {}".format(bus.device, ", ".join(str(id) for id in nodes[bus])))
+
+    # The frame delay is shared by all buses, hence the slowest bus sets it
+    transfer = {bus: negotiate_transfer(connections[bus], nodes[bus], args.device_class, args.page_size)
+                for bus in buses}
+    utils.INTER_FRAME_DELAY = max(t.delay for t in transfer.values())
+
+    progress = BusProgress(buses, bars_per_session=1 if args.independent else 2)
+    failed_boards = set()
+
+    def flash_bus(bus):
+        session.progress_bar = progress.factory(bus)
+        connection = connections[bus]
+        page_size, erase_size, _, sequenced, asynchronous = transfer[bus]
+        try:
+            flash_image(connection, binary, args.base_address, args.device_class, nodes[bus],
+                        page_size=page_size,
+                        erase_size=erase_size,
+                        class_addressing=args.class_addressing,
+                        slotted_replies=args.slotted_replies,
+                        nack_only=args.nack_only,
+                        resume=args.resume,
+                        independent=args.independent,
+                        sequenced=args.sequenced or sequenced,
+                        asynchronous=asynchronous)
+            valid_nodes = verify_flash_write(connection, binary, args.base_address, nodes[bus],
+                                             asynchronous=asynchronous)
+        except SystemExit:
+            logging.critical("Flashing aborted on bus " + bus.device)
+            valid_nodes = []
+
+        failed_boards.update(set(nodes[bus]) - set(valid_nodes))
+        if args.run and set(valid_nodes) == set(nodes[bus]):
+            run_application(connection, nodes[bus])
+
+    threads = [Thread(target=flash_bus, args=(bus,)) for bus in buses]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    progress.finish()
+    return failed_boards
+
+
+def image_has_address(filename):
+    return filename.endswith((".elf", ".hex", ".ihex"))
 
 
 def main():
@@ -447,28 +1053,26 @@ def main():
         logging.critical("File not found: " + args.image_file)
         exit(1)
 
-    # Determine input file format
-    if image_is_elf(args.image_file):
-        logging.info("File format: ELF image")
+    # Read the image, gaps between the segments of ELF and HEX files are left erased
+    try:
+        address, binary = image.load(args.image_file)
+    except image.ImageFormatError as e:
+        logging.critical("Invalid image file: " + str(e))
+        exit(2)
 
-        # Parse ELF sections
-        elf_filename = args.image_file
-        args.base_address = elf_extract_start_address(elf_filename)
-        if args.base_address == 0:
-            exit(2)
-
-        # Convert ELF to binary
-        binary_filename = elf_filename[:-4] + ".bin"
-        elf_convert_to_binary(elf_filename, binary_filename)
-        args.image_file = binary_filename
-    else:
-        logging.info("File format: Binary image")
+    if address is not None:
+        args.base_address = address
 
     logging.info("Flashing to address: " + format(args.base_address, "#010x"))
 
-    # Read binary to variable
-    with open(args.image_file, 'rb') as input_file:
-        binary = input_file.read()
+    if args.buses:
+        print("Flashing firmware on {} buses, size: {} bytes".format(len(args.buses), len(binary)))
+        failed_boards = flash_buses(args, binary)
+        utils.log_loss_rates()
+        if failed_boards:
+            verification_failed(failed_boards)
+        print("Done.")
+        return
 
     # Open CAN connection
     can_connection = utils.open_connection(args)
@@ -482,14 +1086,28 @@ def main():
         print("The following boards are offline: {}".format(", ".join(offline_boards)) + ". Aborting.")
         exit(3)
 
+    page_size, erase_size, utils.INTER_FRAME_DELAY, sequenced, asynchronous = negotiate_transfer(
+        can_connection, args.ids, args.device_class, args.page_size)
+    logging.info("Page size {} bytes, erase size {} bytes, frame delay {} ms, sequenced {}, asynchronous {}".format(
+        page_size, erase_size, utils.INTER_FRAME_DELAY * 1000, args.sequenced or sequenced, asynchronous))
+
     print("Flashing firmware, size: {} bytes".format(len(binary)))
     flash_image(can_connection, binary, args.base_address, args.device_class,
-                 args.ids, page_size=args.page_size)
+                 args.ids, page_size=page_size, erase_size=erase_size,
+                 class_addressing=args.class_addressing,
+                 slotted_replies=args.slotted_replies,
+                 nack_only=args.nack_only,
+                 resume=args.resume,
+                 independent=args.independent,
+                 sequenced=args.sequenced or sequenced,
+                 asynchronous=asynchronous)
 
     print("Verifying firmware...")
     valid_nodes_set = set(verify_flash_write(can_connection, binary,
-                                       args.base_address, args.ids))
+                                       args.base_address, args.ids,
+                                       asynchronous=asynchronous))
     nodes_set = set(args.ids)
+    utils.log_loss_rates()
 
     if valid_nodes_set == nodes_set:
         if len(args.ids) > 1:
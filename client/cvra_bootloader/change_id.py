@@ -1,5 +1,6 @@
 #!/usr/bin/env python3
 from cvra_bootloader import commands, utils
+import asyncio
 
 
 def parse_commandline_args():
@@ -7,20 +8,31 @@ def parse_commandline_args():
     parser.add_argument("old", type=int, help="Old device ID")
     parser.add_argument("new", type=int, help="New device ID")
 
-    return parser.parse_args()
+    args = parser.parse_args()
+    if not 0 < args.new < utils.MIN_CLIENT_ID:
+        parser.error("The new ID must be between 1 and {}, higher IDs are reserved for clients.".format(
+            utils.MIN_CLIENT_ID - 1))
 
+    return args
 
-def main():
-    args = parse_commandline_args()
-    connection = utils.open_connection(args)
 
+async def change_id(args):
+    transport = utils.open_transport(args)
+
+    # The node replies with its new ID already
     config = {"ID": args.new}
-    utils.write_command_retry(connection,
+    await utils.request_retry(transport,
                               commands.encode_update_config(config),
-                              [args.old])
-    utils.write_command_retry(connection,
+                              [args.old], sources=[args.new])
+    await utils.request_retry(transport,
                               commands.encode_save_config(),
                               [args.new])
+    transport.close()
+
+
+def main():
+    args = parse_commandline_args()
+    asyncio.run(change_id(args))
 
 if __name__ == "__main__":
     main()
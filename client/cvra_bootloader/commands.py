@@ -13,6 +13,34 @@ class CommandType:
     SaveConfig = 8
     ReadConfig = 9
     GetStatus = 10
+    GetStats = 11
+    SubmitAsync = 12
+    GetBootTrace = 13
+    FlashSession = 14
+    Sequenced = 15
+    GetCapabilities = 16
+
+
+class JobState:
+    """
+    States of asynchronously executed commands as defined in command_queue.h
+    """
+    UNKNOWN = 0
+    QUEUED = 1
+    RUNNING = 2
+    DONE = 3
+
+
+class Capability:
+    """
+    Feature flags reported by the capabilities command as defined in command.h
+    """
+    COMPACT_DATAGRAMS = 1 << 0
+    REPLY_FLAGS = 1 << 1
+    RX_BUFFER = 1 << 2
+    FRAME_FILTERS = 1 << 3
+    BOOT_TRACE = 1 << 4
+
 
 def encode_command(command_code, *arguments):
     """
@@ -28,17 +56,25 @@ def encode_crc_region(address, length):
     """
     return encode_command(CommandType.CRCRegion, address, length)
 
-def encode_erase_flash_page(address, device_class):
+def encode_erase_flash_page(address, device_class=None):
     """
     Encodes the command to erase the flash page at given address.
+
+    The device class may only be omitted in datagrams addressed by device class.
     """
+    if device_class is None:
+        return encode_command(CommandType.Erase, address)
     return encode_command(CommandType.Erase, address, device_class)
 
-def encode_write_flash(data, address, device_class):
+def encode_write_flash(data, address, device_class=None):
     """
     Encodes the command to write the given data at the given address in a
     messagepack byte object.
+
+    The device class may only be omitted in datagrams addressed by device class.
     """
+    if device_class is None:
+        return encode_command(CommandType.Write, address, data)
     return encode_command(CommandType.Write, address, device_class, data)
 
 def encode_read_flash(aderess, length):
@@ -77,8 +113,52 @@ def encode_ping():
     """
     return encode_command(CommandType.Ping)
 
-def encode_get_status():
+def encode_get_status(token=None):
     """
     Encodes a get status command.
+    If a token is given, the state of the corresponding asynchronous command is requested.
+    """
+    if token is None:
+        return encode_command(CommandType.GetStatus)
+    return encode_command(CommandType.GetStatus, token)
+
+def encode_get_stats(reset=False):
+    """
+    Encodes a command requesting the profiling statistics,
+    optionally clearing them afterwards.
+    """
+    return encode_command(CommandType.GetStats, reset)
+
+def encode_submit_async(token, command):
+    """
+    Encodes a command, which wraps another encoded command
+    for asynchronous execution under the given request token.
+    """
+    return encode_command(CommandType.SubmitAsync, token, command)
+
+def encode_get_boot_trace():
+    """
+    Encodes a command requesting the boot phase trace.
+    """
+    return encode_command(CommandType.GetBootTrace)
+
+def encode_flash_session(address, size, crc):
+    """
+    Encodes a command beginning or resuming the flash session of the given image.
+    """
+    return encode_command(CommandType.FlashSession, address, size, crc)
+
+def encode_sequenced(token, command):
+    """
+    Encodes a command, which wraps another encoded command with a sequence token.
+
+    A node executes it only once and answers retransmissions carrying
+    the same token with the reply of the first execution.
+    """
+    return encode_command(CommandType.Sequenced, token, command)
+
+def encode_get_capabilities():
+    """
+    Encodes a command requesting the buffer sizes, flash geometry and features of a node.
     """
-    return encode_command(CommandType.GetStatus)
+    return encode_command(CommandType.GetCapabilities)
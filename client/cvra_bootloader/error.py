@@ -27,3 +27,9 @@ class Error:
     CRC_ERROR_ADDRESS_UNSPECIFIED = 30
     CRC_ERROR_LENGTH_UNSPECIFIED = 31
     CRC_ERROR_ILLEGAL_ADDRESS = 32
+
+    ASYNC_ERROR_MALFORMED = 40
+    ASYNC_ERROR_TOO_LARGE = 41
+    ASYNC_ERROR_QUEUE_FULL = 42
+
+    CONFIG_ERROR_RESERVED_ID = 50
@@ -0,0 +1,139 @@
+"""
+Reads application images from ELF, Intel HEX and raw binary files.
+
+An image is read as list of segments, i.e. (address, data) tuples,
+which flatten() turns into a single binary as the bootloader sees it in flash.
+"""
+import struct
+
+#
+# Value of erased flash memory bytes
+#
+ERASED_BYTE = 0xff
+
+ELF_MAGIC = b'\x7fELF'
+ELF_CLASS_32 = 1
+ELF_DATA_LITTLE_ENDIAN = 1
+ELF_PT_LOAD = 1
+
+HEX_DATA = 0
+HEX_END_OF_FILE = 1
+HEX_EXTENDED_SEGMENT_ADDRESS = 2
+HEX_EXTENDED_LINEAR_ADDRESS = 4
+
+
+class ImageFormatError(ValueError):
+    """
+    Error raised when an image file cannot be parsed.
+    """
+    pass
+
+
+def read_elf(data):
+    """
+    Returns the loadable segments of a 32 bit ELF file at their load (physical) address.
+
+    Segments without file content (e.g. .bss) are skipped.
+    """
+    if data[:4] != ELF_MAGIC:
+        raise ImageFormatError("Not an ELF file")
+
+    if data[4] != ELF_CLASS_32:
+        raise ImageFormatError("Only 32 bit ELF files are supported")
+
+    endian = '<' if data[5] == ELF_DATA_LITTLE_ENDIAN else '>'
+    phoff, = struct.unpack_from(endian + 'I', data, 28)
+    phentsize, phnum = struct.unpack_from(endian + 'HH', data, 42)
+
+    segments = []
+    for i in range(phnum):
+        p_type, p_offset, _, p_paddr, p_filesz = struct.unpack_from(endian + '5I', data, phoff + i * phentsize)
+        if p_type == ELF_PT_LOAD and p_filesz > 0:
+            segments.append((p_paddr, bytes(data[p_offset:p_offset + p_filesz])))
+
+    return segments
+
+
+def read_intel_hex(text):
+    """
+    Returns the data records of an Intel HEX file as segments.
+    """
+    segments = []
+    base = 0
+
+    for number, line in enumerate(text.splitlines(), 1):
+        line = line.strip()
+        if not line:
+            continue
+
+        try:
+            if line[0] != ':':
+                raise ValueError
+            record = bytes.fromhex(line[1:])
+        except ValueError:
+            raise ImageFormatError("Line {}: Not an Intel HEX record".format(number))
+
+        if len(record) < 5 or len(record) != record[0] + 5:
+            raise ImageFormatError("Line {}: Invalid record length".format(number))
+
+        if sum(record) & 0xff:
+            raise ImageFormatError("Line {}: Checksum mismatch".format(number))
+
+        address, record_type = struct.unpack_from('>HB', record, 1)
+        payload = record[4:-1]
+
+        if record_type == HEX_DATA:
+            segments.append((base + address, payload))
+        elif record_type == HEX_END_OF_FILE:
+            break
+        elif record_type == HEX_EXTENDED_SEGMENT_ADDRESS:
+            base = int.from_bytes(payload, 'big') << 4
+        elif record_type == HEX_EXTENDED_LINEAR_ADDRESS:
+            base = int.from_bytes(payload, 'big') << 16
+        # Start address records are irrelevant for flashing
+
+    return segments
+
+
+def flatten(segments):
+    """
+    Returns the lowest address and a binary spanning all segments,
+    with the gaps between them filled with erased bytes.
+    """
+    if not segments:
+        raise ImageFormatError("The image contains no data")
+
+    start = min(address for address, _ in segments)
+    end = max(address + len(data) for address, data in segments)
+
+    binary = bytearray([ERASED_BYTE]) * (end - start)
+    for address, data in segments:
+        binary[address - start:address - start + len(data)] = data
+
+    return start, bytes(binary)
+
+
+def is_erased(data):
+    """
+    Returns True, if the data consists of erased bytes only, thus need not be written.
+    """
+    return bytes(data).count(ERASED_BYTE) == len(data)
+
+
+def load(filename):
+    """
+    Reads an image file and returns its address and binary.
+
+    ELF (.elf) and Intel HEX (.hex, .ihex) files contain the address,
+    for all other files it is None, since they are read as raw binaries.
+    """
+    with open(filename, 'rb') as f:
+        data = f.read()
+
+    if filename.endswith('.elf'):
+        return flatten(read_elf(data))
+
+    if filename.endswith('.hex') or filename.endswith('.ihex'):
+        return flatten(read_intel_hex(data.decode('ascii')))
+
+    return None, data
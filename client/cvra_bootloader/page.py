@@ -1,8 +1,9 @@
 def slice_into_pages(data, page_size):
     """
     Slices data into chunks that are at max page_size big.
+
+    The chunks are memoryviews of data, so no data is copied.
     """
-    while len(data) > page_size:
-        yield data[:page_size]
-        data = data[page_size:]
-    yield data
+    view = memoryview(data)
+    for offset in range(0, max(len(view), 1), page_size):
+        yield view[offset:offset + page_size]
@@ -1,8 +1,12 @@
 #!/usr/bin/env python3
 from cvra_bootloader import commands, utils
+import asyncio
 import msgpack
 import json
 
+# Number of seconds to wait for further ping replies during network discovery
+DISCOVERY_TIMEOUT = 1.
+
 
 def parse_commandline_args():
     """
@@ -29,24 +33,20 @@ def parse_commandline_args():
     return parser.parse_args()
 
 
-def main():
-    # Parse console arguments
-    args = parse_commandline_args()
-
+async def read_configs(args):
     # Open connection to CAN device
-    connection = utils.open_connection(args)
+    transport = utils.open_transport(args)
 
     # Retrieve config from all devices on bus?
     if args.all:
         scan_queue = list()
 
         # Broadcast ping command
-        utils.write_command(connection, commands.encode_ping(), list(range(1, 128)))
+        transport.send(commands.encode_ping(), list(range(1, 128)))
 
-        # Parse the replied CAN datagrams
-        reader = utils.read_can_datagrams(connection)
+        # Collect the replies until the bus stays silent
         while True:
-            dt = next(reader)
+            dt = await transport.receive(timeout=DISCOVERY_TIMEOUT)
             if dt is None:
                 break
 
@@ -60,9 +60,18 @@ def main():
         scan_queue = args.ids
 
     # Broadcast ask for config
-    configs = utils.write_command_retry(connection,
+    configs = await utils.request_retry(transport,
                                         commands.encode_read_config(),
                                         scan_queue)
+    transport.close()
+    return configs
+
+
+def main():
+    # Parse console arguments
+    args = parse_commandline_args()
+
+    configs = asyncio.run(read_configs(args))
 
     # Parse received configs
     count = len(configs.items())
@@ -72,7 +81,7 @@ def main():
         ",".join([str(i) for i in configs.keys()])
         )
     for id, raw_config in configs.items():
-        configs[id] = msgpack.unpackb(raw_config, encoding='ascii')
+        configs[id] = msgpack.unpackb(raw_config, raw=False)
 
     # Print parsed configs
     print(json.dumps(configs, indent=4, sort_keys=True))
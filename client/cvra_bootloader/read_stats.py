@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+from cvra_bootloader import commands, utils
+from cvra_bootloader.commands import CommandType
+import asyncio
+import msgpack
+
+PHASES = ["reassembly", "execution", "crc", "flash erase", "flash write", "reply"]
+
+BOOT_PHASES = ["reset", "clock", "can init", "config", "listen", "app crc", "jump"]
+
+
+def parse_commandline_args():
+    """
+    Parses the program commandline arguments.
+    """
+    DESCRIPTION = "Read the per-command profiling statistics or boot phase trace of board(s)"
+    parser = utils.ConnectionArgumentParser(description=DESCRIPTION)
+
+    parser.add_argument(
+        "ids",
+        metavar="DEVICEID",
+        nargs="+",
+        type=int,
+        help="Device IDs to query"
+        )
+
+    parser.add_argument(
+        "-r",
+        "--reset",
+        help="Clear the statistics after reading them",
+        action="store_true"
+        )
+
+    parser.add_argument(
+        "-b",
+        "--boot-trace",
+        help="Print the duration of the boot phases instead",
+        action="store_true"
+        )
+
+    return parser.parse_args()
+
+
+def command_name(index):
+    """
+    Returns the human readable name of a command index.
+    """
+    for name, value in vars(CommandType).items():
+        if value == index and not name.startswith("_"):
+            return name
+    return "-" if index == 0 else str(index)
+
+
+def format_stats(stats):
+    """
+    Formats the statistics reply of one board as table with durations in microseconds.
+    """
+    frequency = stats["frequency"]
+    if frequency is None:
+        return "Profiling unavailable, the board does not run a cycle counter."
+
+    lines = ["{:<14}{:<14}{:>8}{:>12}{:>12}{:>12}".format(
+        "command", "phase", "count", "min [us]", "avg [us]", "max [us]")]
+
+    for index, phase, count, min_, avg, max_ in stats["stats"]:
+        phase_name = PHASES[phase] if phase < len(PHASES) else str(phase)
+        us = [1e6 * c / frequency for c in (min_, avg, max_)]
+        lines.append("{:<14}{:<14}{:>8}{:>12.1f}{:>12.1f}{:>12.1f}".format(
+            command_name(index), phase_name, count, *us))
+
+    return "\n".join(lines)
+
+
+def format_boot_trace(trace):
+    """
+    Formats the boot trace reply of one board as table of phase durations in microseconds.
+    """
+    frequency = trace["frequency"]
+    if frequency is None:
+        return "Boot trace unavailable, the board does not run a cycle counter."
+
+    lines = ["{:<14}{:>12}{:>12}".format("phase", "took [us]", "at [us]")]
+
+    previous = None
+    for phase, cycles in trace["trace"]:
+        phase_name = BOOT_PHASES[phase] if phase < len(BOOT_PHASES) else str(phase)
+        # The counter is 32 bits wide and may wrap around
+        took = 0 if previous is None else (cycles - previous) & 0xffffffff
+        previous = cycles
+        lines.append("{:<14}{:>12.1f}{:>12.1f}".format(
+            phase_name, 1e6 * took / frequency, 1e6 * cycles / frequency))
+
+    return "\n".join(lines)
+
+
+async def request(args, command):
+    transport = utils.open_transport(args)
+    replies = await utils.request_retry(transport, command, args.ids)
+    transport.close()
+    return replies
+
+
+def main():
+    args = parse_commandline_args()
+
+    if args.boot_trace:
+        command = commands.encode_get_boot_trace()
+        format_reply = format_boot_trace
+    else:
+        command = commands.encode_get_stats(args.reset)
+        format_reply = format_stats
+
+    replies = asyncio.run(request(args, command))
+
+    for id, raw_reply in sorted(replies.items()):
+        reply = msgpack.unpackb(raw_reply, raw=False)
+        print("Board {}:".format(id))
+        print(format_reply(reply))
+
+
+if __name__ == "__main__":
+    main()
@@ -1,5 +1,6 @@
 #!/usr/bin/env python3
 from cvra_bootloader import commands, utils
+import asyncio
 
 def parse_commandline_args():
     parser = utils.ConnectionArgumentParser(description='Send a jump to application command.')
@@ -10,15 +11,19 @@ def parse_commandline_args():
 
     return parser.parse_args()
 
+async def jump(args, ids):
+    transport = utils.open_transport(args)
+    transport.send(commands.encode_jump_to_main(), ids)
+    transport.close()
+
 def main():
     args = parse_commandline_args()
-    connection = utils.open_connection(args)
     if args.all is True:
         ids = list(range(1, 128))
     else:
         ids = args.ids
 
-    utils.write_command(connection, commands.encode_jump_to_main(), ids)
+    asyncio.run(jump(args, ids))
 
 if __name__ == "__main__":
     main()
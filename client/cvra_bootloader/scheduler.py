@@ -0,0 +1,112 @@
+"""
+Schedules the erase, write and verify steps of a flash session per node.
+
+Every node advances through its own pipeline of steps. Idle nodes waiting
+for the same step form a cohort and share one multicast command, so nodes
+progressing at the same pace stay together. A slow or retrying node only
+delays itself: it drops out of its cohort and is caught up with commands
+addressed to it alone (or to the other nodes at its pace), while the others continue.
+"""
+from collections import namedtuple, defaultdict
+
+ERASE = 'erase'
+WRITE = 'write'
+VERIFY = 'verify'
+
+#
+# Number of times a step is attempted on a node before the node is given up
+#
+MAX_ATTEMPTS = 6
+
+#
+# A command for one step, sent to all nodes of a cohort
+#
+Request = namedtuple('Request', ['step', 'offset', 'nodes'])
+
+
+class Node:
+    def __init__(self, id, steps):
+        self.id = id
+        self.steps = steps
+        self.position = 0
+        self.attempts = 0
+        self.busy = False
+        self.failed = False
+
+    @property
+    def finished(self):
+        return self.failed or self.position == len(self.steps)
+
+
+class FlashScheduler:
+    def __init__(self, destinations, erase_offsets, write_offsets, verify=True,
+                 max_attempts=MAX_ATTEMPTS):
+        """
+        Every destination erases the pages at erase_offsets,
+        then writes the pages at write_offsets and finally verifies the image.
+        """
+        steps = [(ERASE, offset) for offset in erase_offsets]
+        steps += [(WRITE, offset) for offset in write_offsets]
+        if verify:
+            steps.append((VERIFY, 0))
+
+        self.nodes = {id: Node(id, steps) for id in destinations}
+        self.max_attempts = max_attempts
+
+    def next_requests(self):
+        """
+        Returns one request for every cohort of idle nodes waiting for the same step.
+
+        The nodes of a request are busy, until it is completed.
+        """
+        cohorts = defaultdict(list)
+        for node in self.nodes.values():
+            if not node.busy and not node.finished:
+                cohorts[node.steps[node.position]].append(node.id)
+
+        requests = []
+        for (step, offset), ids in sorted(cohorts.items(), key=lambda c: -len(c[1])):
+            for id in ids:
+                self.nodes[id].busy = True
+            requests.append(Request(step, offset, tuple(sorted(ids))))
+
+        return requests
+
+    def completed(self, request, succeeded, fatal=(), nodes=None):
+        """
+        Records the outcome of a request for the given nodes, all nodes of the request by default.
+        The other nodes stay busy, e.g. while their reply is still expected.
+
+        Nodes in succeeded advance to their next step, nodes in fatal are given up.
+        All other nodes, e.g. whose reply was lost, attempt the step again.
+        """
+        for id in request.nodes if nodes is None else nodes:
+            node = self.nodes[id]
+            node.busy = False
+
+            if id in succeeded:
+                node.position += 1
+                node.attempts = 0
+                continue
+
+            node.attempts += 1
+            if id in fatal or node.attempts >= self.max_attempts:
+                node.failed = True
+
+    def done(self):
+        return all(node.finished for node in self.nodes.values())
+
+    def failed(self):
+        """
+        Returns the set of nodes which were given up.
+        """
+        return {id for id, node in self.nodes.items() if node.failed}
+
+    def progress(self):
+        """
+        Returns the fraction of all steps, which are completed or given up.
+        """
+        total = sum(len(node.steps) for node in self.nodes.values())
+        completed = sum(len(node.steps) if node.failed else node.position
+                        for node in self.nodes.values())
+        return completed / total if total else 1.
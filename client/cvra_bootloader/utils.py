@@ -1,13 +1,20 @@
 
-from time import sleep
+from time import sleep, time
 import argparse
+import asyncio
 import logging
+import random
+import msgpack
 from sys import exit
-from collections import defaultdict
+from collections import defaultdict, namedtuple, OrderedDict
+from queue import Queue
+from threading import Lock, Thread
 
 from cvra_bootloader import commands
+from cvra_bootloader.commands import JobState
 
 import can
+import can.aio
 from can.adapters.slcan import SLCANInterface
 from can.adapters.socketcan import SocketCANInterface
 from can.adapters.peak_pcan import PeakPCANInterface
@@ -21,10 +28,394 @@ from can.adapters.peak_pcan import PeakPCANInterface
 #
 INTER_FRAME_DELAY = 0.004
 
+#
+# Upper bound of INTER_FRAME_DELAY, when frames are paced because of losses (see adapt_pacing)
+#
+MAX_INTER_FRAME_DELAY = 0.004
+
+#
+# Inter frame delay, with which pacing starts on adapters sending without delay
+#
+PACING_STEP = 0.0005
+
+#
+# Fraction of lost transmissions, above which the frames are paced for the rest of the session,
+# and the number of transmissions this fraction is determined over
+#
+PACING_LOSS_RATE = 0.05
+PACING_WINDOW = 20
+
 #
 # Number of seconds to wait before retrying a failed CAN datagram transmission
 #
+# The delay is doubled with every retry (up to MAX_RETRY_BACKOFF times)
+# and randomized, so that retries of several clients don't collide again.
+#
 RETRY_DELAY = 0.010
+MAX_RETRY_BACKOFF = 6
+
+#
+# Number of seconds to wait for a reply, before a node has replied for the first time,
+# and the bounds of the adapted retransmission timeout (see RetransmissionTimer)
+#
+INITIAL_RETRANSMISSION_TIMEOUT = 3.0
+MIN_RETRANSMISSION_TIMEOUT = 0.020
+MAX_RETRANSMISSION_TIMEOUT = 10.0
+
+#
+# Lower bound of the timeout of commands, which must not be executed twice,
+# unless they are sequenced (see --sequenced). As the one second floor of RFC 6298,
+# it keeps host and adapter jitter from retransmitting commands which succeeded.
+#
+UNSEQUENCED_MIN_RETRANSMISSION_TIMEOUT = 1.0
+
+#
+# Command types, which fail or corrupt data when executed twice
+#
+NON_IDEMPOTENT_COMMANDS = (commands.CommandType.Erase,
+                           commands.CommandType.Write,
+                           commands.CommandType.SaveConfig)
+
+#
+# Number of seconds a full CAN frame occupies the bus at 1 Mbit/s, including stuff bits
+#
+FRAME_DURATION = 0.00013
+
+#
+# Number of seconds of one reply slot, when replies are requested in slots
+# (see can.FLAG_SLOTTED_REPLY). Must match REPLY_SLOT_DURATION_US of the bootloader:
+# REPLY_SLOT_FRAMES frames, each sent CAN_INTER_FRAME_DELAY + 1 ms after the previous one,
+# plus 500 us margin.
+#
+BOOTLOADER_FRAME_DELAY = 0.004
+REPLY_SLOT_FRAMES = 2
+REPLY_SLOT_DURATION = (BOOTLOADER_FRAME_DELAY + 0.001) * REPLY_SLOT_FRAMES + 0.0005
+
+#
+# Source IDs of clients: 0 and the IDs reserved for concurrently running tools,
+# which the bootloader reassembles and answers separately (see PROTOCOL.markdown)
+#
+MIN_CLIENT_ID = 0x78
+CLIENT_IDS = [0] + list(range(MIN_CLIENT_ID, 0x80))
+
+#
+# Source ID of the datagrams sent by this tool (see --source)
+#
+SOURCE_ID = 0
+
+#
+# Number of encoded datagrams kept for retransmissions (see DatagramCache)
+#
+DATAGRAM_CACHE_SIZE = 16
+
+#
+# Number of items encoded ahead by prefetch()
+#
+PREFETCH_DEPTH = 4
+
+#
+# Number of seconds to wait between status requests for asynchronous commands
+#
+ASYNC_POLL_INTERVAL = 0.050
+
+#
+# Tokens identifying asynchronous and sequenced requests, randomly seeded
+# so that requests of consecutive client runs don't collide
+#
+_next_token = random.getrandbits(31)
+
+
+def next_token():
+    """
+    Returns a new token for an asynchronous or sequenced request.
+    """
+    global _next_token
+    _next_token = (_next_token + 1) & 0xffffffff
+    return _next_token
+
+
+class DatagramCache:
+    """
+    Keeps the CAN frames of the most recently encoded datagrams,
+    so that retransmissions of a command need not encode it again.
+
+    Datagrams are identified by command, encoded destinations, source and flags.
+    """
+
+    def __init__(self, size=DATAGRAM_CACHE_SIZE):
+        self.size = size
+        self.entries = OrderedDict()
+        self.lock = Lock()
+
+    def frames(self, command, destinations, source=0, flags=0):
+        """
+        Returns the list of CAN frames of the datagram, encoding it if necessary.
+        """
+        key = (bytes(command), can.encode_destinations(destinations), source, flags)
+
+        with self.lock:
+            frames = self.entries.get(key)
+            if frames is not None:
+                self.entries.move_to_end(key)
+                return frames
+
+        datagram = can.encode_datagram(command, destinations, flags)
+        frames = list(can.datagram_to_frames(datagram, source))
+
+        with self.lock:
+            self.entries[key] = frames
+            while len(self.entries) > self.size:
+                self.entries.popitem(last=False)
+
+        return frames
+
+
+datagram_cache = DatagramCache()
+
+
+def datagram_frame_count(length, destination_count):
+    """
+    Returns the approximate number of CAN frames of a datagram with a command of the given length,
+    i.e. version, CRC, destinations, length and command.
+    """
+    return (10 + destination_count + length) // 8 + 1
+
+
+def command_type(command):
+    """
+    Returns the command type of an encoded command, which follows the version.
+
+    Sequenced commands are of the type of the command they wrap.
+    """
+    if not command:
+        return None
+
+    if command[1] == commands.CommandType.Sequenced:
+        unpacker = msgpack.Unpacker(raw=True)
+        unpacker.feed(command)
+        _, _, (_, command) = unpacker
+        return command[1]
+
+    return command[1]
+
+
+def is_sequenced(command):
+    """
+    Returns True, if the encoded command is wrapped by a sequenced command.
+    """
+    return bool(command) and command[1] == commands.CommandType.Sequenced
+
+
+class RetransmissionTimer:
+    """
+    Estimates the round trip time of each node per command type,
+    like TCP estimates the round trip time of a connection (see RFC 6298).
+
+    The timeout is the smoothed round trip time plus four times its variation.
+    It is doubled on each loss, and only replies to commands sent once are
+    sampled, since replies to retransmitted commands are ambiguous (Karn's algorithm).
+    Commands which must not be executed twice wait at least unsequenced_minimum,
+    unless they are sequenced.
+
+    Also counts the transmissions and losses of every node.
+    """
+    ALPHA = 1 / 8
+    BETA = 1 / 4
+    K = 4
+
+    def __init__(self, initial=INITIAL_RETRANSMISSION_TIMEOUT,
+                 minimum=MIN_RETRANSMISSION_TIMEOUT, maximum=MAX_RETRANSMISSION_TIMEOUT,
+                 unsequenced_minimum=UNSEQUENCED_MIN_RETRANSMISSION_TIMEOUT):
+        self.initial = initial
+        self.minimum = minimum
+        self.maximum = maximum
+        self.unsequenced_minimum = unsequenced_minimum
+
+        # (srtt, rttvar, rto) by (node, command type)
+        self.estimates = dict()
+
+        self.transmissions = defaultdict(int)
+        self.losses = defaultdict(int)
+
+        # Transmissions and losses since pacing was last adapted
+        self.window = [0, 0]
+
+        self.lock = Lock()
+
+    def rto(self, node, kind):
+        with self.lock:
+            estimate = self.estimates.get((node, kind))
+        return self.initial if estimate is None else estimate[2]
+
+    def timeout(self, nodes, command, flags=0):
+        """
+        Returns the number of seconds to wait for the replies of all nodes to the command,
+        i.e. the longest timeout of the nodes plus the transmission of the command
+        and, with can.FLAG_SLOTTED_REPLY, their reply slots.
+        """
+        nodes = list(nodes)
+        kind = command_type(command)
+        timeout = max((self.rto(node, kind) for node in nodes), default=self.initial)
+
+        if kind in NON_IDEMPOTENT_COMMANDS and not is_sequenced(command):
+            timeout = max(timeout, self.unsequenced_minimum)
+
+        timeout += transmission_time(command, len(nodes))
+
+        if flags & can.FLAG_SLOTTED_REPLY:
+            timeout += REPLY_SLOT_DURATION * len(nodes)
+
+        return timeout
+
+    def sample(self, node, kind, rtt):
+        """
+        Updates the estimate with the round trip time of a reply to a command sent once.
+        """
+        with self.lock:
+            estimate = self.estimates.get((node, kind))
+            if estimate is None or estimate[0] is None:
+                # First sample, possibly after losses backed off the initial timeout
+                srtt, rttvar = rtt, rtt / 2
+            else:
+                srtt, rttvar, _ = estimate
+                rttvar = (1 - self.BETA) * rttvar + self.BETA * abs(srtt - rtt)
+                srtt = (1 - self.ALPHA) * srtt + self.ALPHA * rtt
+
+            rto = min(self.maximum, max(self.minimum, srtt + self.K * rttvar))
+            self.estimates[(node, kind)] = (srtt, rttvar, rto)
+
+    def sent(self, nodes):
+        with self.lock:
+            for node in nodes:
+                self.transmissions[node] += 1
+                self.window[0] += 1
+
+    def lost(self, nodes, kind):
+        """
+        Records that the given nodes didn't reply in time and backs off their timeout.
+        """
+        with self.lock:
+            for node in nodes:
+                self.losses[node] += 1
+                self.window[1] += 1
+
+                srtt, rttvar, rto = self.estimates.get((node, kind), (None, None, self.initial))
+                self.estimates[(node, kind)] = (srtt, rttvar, min(self.maximum, 2 * rto))
+
+    def loss_rate(self, node):
+        with self.lock:
+            sent = self.transmissions[node]
+            return self.losses[node] / sent if sent else 0.
+
+    def nodes(self):
+        with self.lock:
+            return sorted(self.transmissions)
+
+
+retransmission_timer = RetransmissionTimer()
+
+
+def transmission_time(command, destination_count):
+    """
+    Returns the number of seconds needed to send a command to the given number of nodes.
+    """
+    frames = datagram_frame_count(len(command or b''), destination_count)
+    return frames * (FRAME_DURATION + INTER_FRAME_DELAY)
+
+
+def adapt_pacing(timer=None):
+    """
+    Paces the frames for the rest of the session, i.e. increases INTER_FRAME_DELAY
+    up to MAX_INTER_FRAME_DELAY, when too many of the recent transmissions were lost.
+
+    Returns True, if the pacing was changed.
+    """
+    global INTER_FRAME_DELAY
+    timer = timer or retransmission_timer
+
+    with timer.lock:
+        sent, lost = timer.window
+        if sent < PACING_WINDOW:
+            return False
+        timer.window = [0, 0]
+
+    if lost / sent <= PACING_LOSS_RATE or INTER_FRAME_DELAY >= MAX_INTER_FRAME_DELAY:
+        return False
+
+    INTER_FRAME_DELAY = min(MAX_INTER_FRAME_DELAY, max(PACING_STEP, 2 * INTER_FRAME_DELAY))
+    logging.warning("Lost {} of {} transmissions, pacing frames by {:.1f} ms".format(
+        lost, sent, INTER_FRAME_DELAY * 1000))
+    return True
+
+
+def log_loss_rates(timer=None):
+    """
+    Logs the loss rate of every node, which lost transmissions.
+    """
+    timer = timer or retransmission_timer
+    for node in timer.nodes():
+        rate = timer.loss_rate(node)
+        if rate > 0:
+            logging.info("Node {}: {:.1f} % of transmissions lost".format(node, rate * 100))
+
+
+def retry_delay(retry_count):
+    """
+    Returns the randomized, exponentially increasing delay before the given retry.
+    """
+    delay = RETRY_DELAY * 2 ** min(retry_count, MAX_RETRY_BACKOFF)
+    return random.uniform(delay / 2, delay)
+
+
+def prefetch(iterable, depth=PREFETCH_DEPTH):
+    """
+    Iterates over iterable in a background thread, keeping up to depth items ready.
+
+    Allows encoding the next commands, while the current one is being transmitted.
+    """
+    queue = Queue(maxsize=depth)
+    done = object()
+
+    def produce():
+        try:
+            for item in iterable:
+                queue.put((item, None))
+        except Exception as e:
+            queue.put((done, e))
+        else:
+            queue.put((done, None))
+
+    Thread(target=produce, daemon=True).start()
+
+    while True:
+        item, error = queue.get()
+        if error is not None:
+            raise error
+        if item is done:
+            return
+        yield item
+
+
+#
+# A CAN bus given with --bus: the serial port or interface and the IDs of its nodes (None if unknown)
+#
+Bus = namedtuple('Bus', ['device', 'ids'])
+
+
+def parse_bus(spec):
+    """
+    Parses a bus given as DEVICE[=IDS], where IDS is a comma separated list of IDs
+    and ranges of IDs, e.g. 'can1=1,4-6'.
+    """
+    device, _, ids = spec.partition('=')
+    if not ids:
+        return Bus(device, None)
+
+    nodes = []
+    for part in ids.split(','):
+        first, _, last = part.partition('-')
+        nodes += range(int(first), int(last or first) + 1)
+    return Bus(device, tuple(nodes))
 
 
 class ConnectionArgumentParser(argparse.ArgumentParser):
@@ -32,10 +423,12 @@ class ConnectionArgumentParser(argparse.ArgumentParser):
     Subclass of ArgumentParser with default arguments for connection handling (SocketCAN or serial port).
 
     It also checks that the user provides at least one connection method.
+    With multiple_buses, several buses may be given with --bus instead.
     """
 
-    def __init__(self, *args, **kwargs):
+    def __init__(self, *args, multiple_buses=False, **kwargs):
         super(ConnectionArgumentParser, self).__init__(*args, **kwargs)
+        self.multiple_buses = multiple_buses
 
         # Disable line-wrapping in description and epilog
         self.formatter_class = argparse.RawDescriptionHelpFormatter
@@ -50,6 +443,26 @@ class ConnectionArgumentParser(argparse.ArgumentParser):
                           help="SocketCAN interface, e.g 'can0' (Linux only)",
                           metavar='INTERFACE')
 
+        if multiple_buses:
+            self.add_argument('--bus',
+                              dest='buses',
+                              help="Serial port or interface of one of several CAN buses, "
+                                   "optionally followed by the IDs of its nodes, e.g. 'can1=1,4-6'. "
+                                   "Buses without IDs are searched for the nodes. Can be repeated",
+                              metavar='DEVICE[=IDS]',
+                              type=parse_bus,
+                              action='append',
+                              default=[])
+
+        self.add_argument('--source',
+                          dest='source',
+                          help="Source ID of this tool, 0 (default) or one of 120-127 "
+                               "to run several tools concurrently",
+                          type=int,
+                          choices=CLIENT_IDS,
+                          default=0,
+                          metavar='ID')
+
         self.add_argument("-v", "--verbose",
                           dest="verbose",
                           help="Print debug messages",
@@ -63,8 +476,11 @@ class ConnectionArgumentParser(argparse.ArgumentParser):
     def parse_args(self, *args, **kwargs):
         args = super(ConnectionArgumentParser, self).parse_args(*args, **kwargs)
 
-        if args.serial_device is None and \
-           args.can_interface is None:
+        if self.multiple_buses and args.buses:
+            if args.serial_device or args.can_interface:
+                self.error("Use either --bus or a single CAN interface.")
+        elif args.serial_device is None and \
+             args.can_interface is None:
             self.error("You must specify, which CAN interface to use.")
 
         if args.can_interface and args.serial_device:
@@ -79,35 +495,92 @@ class ConnectionArgumentParser(argparse.ArgumentParser):
         return args
 
 
-def open_connection(args):
+def open_connection(args, reader_thread=True):
     """
     Open a connection based on commandline arguments.
 
     Returns a file like object which will be the connection handle.
+    Without reader thread, frames must be read with read_frames(), see open_transport().
     """
 
+    global INTER_FRAME_DELAY, SOURCE_ID
+
     # Propagate loglevel to CAN logging
     can.logging.getLogger().setLevel(logging.getLogger().level)
 
+    SOURCE_ID = getattr(args, 'source', 0)
+
     if args.can_interface:
         if args.can_interface[:4] == "pcan":
             logging.info("Selected Peak PCAN interface.")
+            if not reader_thread:
+                logging.critical("The PCAN interface can only be read by its reader thread.")
+                exit(1)
             return PeakPCANInterface()
         else:
             logging.info("Selected SocketCAN interface.")
-            return SocketCANInterface(args.can_interface)
+            # The socket waits for buffer space itself, so frames need no pacing
+            INTER_FRAME_DELAY = 0.0
+            return SocketCANInterface(args.can_interface, reply_ids(args), reader_thread=reader_thread)
     elif args.serial_device:
         logging.info("Selected SLCAN interface.")
-        return SLCANInterface(args)
+        # Writes block on the flow control of the serial port, so frames need no pacing
+        INTER_FRAME_DELAY = 0.0
+        return SLCANInterface(args, reader_thread=reader_thread)
+
+
+def open_transport(args):
+    """
+    Opens a connection based on commandline arguments, which is read
+    by the running asyncio event loop instead of a reader thread.
+
+    Returns a can.aio.Transport, whose requests are awaitables with their own deadline.
+    """
+    return can.aio.Transport(open_connection(args, reader_thread=False), source=SOURCE_ID)
+
+
+def bus_args(args, bus):
+    """
+    Returns a copy of the commandline arguments with the given bus as the only CAN interface,
+    to open it with open_connection().
+
+    Devices starting with '/' or 'COM' are serial ports, all others CAN interfaces.
+    """
+    args = argparse.Namespace(**vars(args))
+    serial = bus.device.startswith(('/', 'COM'))
+    args.serial_device = bus.device if serial else None
+    args.can_interface = None if serial else bus.device
+    args.ids = list(bus.ids) if bus.ids else args.ids
+    return args
 
 
-def read_can_datagrams(connection, ids=None):
-    buf = defaultdict(lambda: bytes())
+def reply_ids(args):
+    """
+    Returns the IDs of the nodes addressed on the command line,
+    or None, if replies from any node are expected.
+    """
+    if getattr(args, 'all', False):
+        return None
+    return getattr(args, 'ids', None) or None
+
+
+def read_can_datagrams(connection, ids=None, timeout=None):
+    """
+    Yields the received datagrams as (data, destinations, source) tuples,
+    or None if no frame arrived in time.
+
+    The optional timeout is a function returning the number of seconds
+    to wait for the next frame, the adapter's default otherwise.
+    """
+    decoders = defaultdict(can.DatagramDecoder)
     while True:
         datagram = None
         while datagram is None:
             # Receive from socket
-            frame = connection.receive_frame()
+            if timeout is None:
+                frame = connection.receive_frame()
+            else:
+                frame = connection.receive_frame(max(0., timeout()))
 
             if frame is None:
                 # Did not receive a CAN frame
@@ -129,19 +602,16 @@ def read_can_datagrams(connection, ids=None):
                     continue
 
             # Datagram start bit set?
-            if (len(buf) > 0) and (src in buf.keys()) and (frame.id & 0x080 > 0):
+            if (src in decoders) and can.is_start_of_datagram(frame):
                 # Begin new datagram
-                del buf[src]
-
-            # Append frame bytes to the buffer of the corresponding ID
-            buf[src] += frame.data[:frame.data_length]
+                del decoders[src]
 
-            # Attempt to decode buffer as datagram
-            datagram = can.decode_datagram(buf[src])
+            # Feed the frame bytes to the decoder of the corresponding ID
+            datagram = decoders[src].input(frame.data[:frame.data_length])
 
             if datagram is not None:
                 # Begin new datagram
-                del buf[src]
+                del decoders[src]
                 # Save decoded datagram
                 data, dst = datagram
 
@@ -182,7 +652,7 @@ def get_status(connection, destination):
     Returns the destination node's last response code or None
     """
     logging.info("Requesting status code from node " + str(destination) + "...")
-    write_command(connection, commands.get_status(), [destination])
+    write_command(connection, commands.encode_get_status(), [destination])
 
     reader = read_can_datagrams(connection, [destination])
     answer = next(reader)
@@ -199,6 +669,36 @@ def get_status(connection, destination):
     return data, code
 
 
+
+def read_capabilities(connection, destinations):
+    """
+    Returns the capabilities of the destinations as dictionary of node ID and capability map.
+
+    Nodes whose bootloader doesn't know the capabilities command are missing.
+    """
+    answers = write_command_retry(connection, commands.encode_get_capabilities(), destinations,
+                                  error_exit=False)
+
+    capabilities = dict()
+    for id, data in answers.items():
+        reply = msgpack.unpackb(data, raw=False)
+        if isinstance(reply, dict):
+            capabilities[id] = reply
+
+    return capabilities
+
+
+def supports_command(connection, destinations, command_type):
+    """
+    Returns whether every destination lists the given command type in its capabilities.
+    """
+    capabilities = read_capabilities(connection, destinations)
+    if len(capabilities) < len(destinations):
+        return False
+
+    return all(command_type in c.get('commands', ()) for c in capabilities.values())
+
+
 #
 # Determines whether all IDs in set 'boards'
 # are present in set 'online_boards' or not
@@ -207,36 +707,76 @@ def all_boards_online(boards, online_boards):
     return (not (False in [id in online_boards for id in boards]))
 
 
-def write_command(connection, command, destinations, source=0):
+def write_command(connection, command, destinations, source=None, flags=0):
     """
-    Writes the given encoded command to the CAN bridge.
+    Writes the given encoded command to the CAN bridge,
+    with SOURCE_ID as source unless another one is given.
     """
     logging.debug("Transmitting command...")
-    datagram = can.encode_datagram(command, destinations)
-    frames = can.datagram_to_frames(datagram, source)
+    if source is None:
+        source = SOURCE_ID
+    frames = datagram_cache.frames(command, destinations, source, flags)
+
+    if INTER_FRAME_DELAY <= 0.0:
+        connection.send_frames(frames)
+        return
 
     for frame in frames:
         connection.send_frame(frame)
-        if INTER_FRAME_DELAY > 0.0:
-            sleep(INTER_FRAME_DELAY)
+        sleep(INTER_FRAME_DELAY)
 
 
-def write_command_retry(connection, command, destinations, source=0, retry_limit=3, error_exit=True, retry_forever=False):
+def write_command_retry(connection, command, destinations, source=None, retry_limit=3, error_exit=True, retry_forever=False,
+                        group=None, group_command=None, flags=0, timer=None, sequenced=False):
     """
     Writes a command, retries as long as there is no answer and returns a dictionary containing
     a map of each board ID and its answer.
+
+    If a group destination (see can.DeviceClassDestination) is given, the first transmission
+    sends group_command (or command) to the group instead of the destination list.
+    The answers are still expected from all destinations,
+    retransmissions to the nodes which did not answer are sent to their IDs.
+
+    With the flag can.FLAG_SLOTTED_REPLY, the nodes reply one after another,
+    within REPLY_SLOT_DURATION times the number of destinations.
+
+    The replies are awaited as long as the retransmission timeout of the nodes
+    for this command type (see RetransmissionTimer), retries are delayed by retry_delay().
+
+    If sequenced is set, the command is wrapped with a new sequence token, so that nodes
+    which executed it already, but whose reply was lost, answer retries without executing it again.
     """
+    timer = timer or retransmission_timer
+    kind = command_type(command)
+    if source is None:
+        source = SOURCE_ID
+
+    if sequenced:
+        token = next_token()
+        command = commands.encode_sequenced(token, command)
+        if group_command is not None:
+            group_command = commands.encode_sequenced(token, group_command)
+
     logging.info("Initiating transmission (attempt 1/" + str(1 + retry_limit) + ")...")
 
-    # Instantiate a datagram yielder
-    reader = read_can_datagrams(connection)
+    # Instantiate a datagram yielder, which waits until the deadline of the current transmission
+    deadline = time() + timer.timeout(destinations, command, flags)
+    reader = read_can_datagrams(connection, timeout=lambda: deadline - time())
 
     # Clear reception buffer
     while not connection.rx_queue.empty():
         dt = next(reader)
 
     # Transmit command datagram
-    write_command(connection, command, destinations, source)
+    sent_at = time()
+    if group is not None:
+        write_command(connection, group_command or command, group, source, flags)
+    else:
+        write_command(connection, command, destinations, source, flags)
+    timer.sent(destinations)
+
+    # Nodes whose reply would be ambiguous, since the command was retransmitted to them
+    retransmitted = set()
 
     answers = dict()
     retry_count = 0
@@ -248,20 +788,11 @@ def write_command_retry(connection, command, destinations, source=0, retry_limit
         if dt is None:
             # If there's a timeout, determine which boards didn't answer.
             timedout_boards = list(set(destinations) - set(answers))
-            msg = "Did not receive a valid response datagram from the following targets: {}".format(", ".join(str(t) for t in timedout_boards))
+            timer.lost(timedout_boards, kind)
+            msg = "Did not receive a valid response datagram from the following targets: {}".format(
+                ", ".join("{} ({:.0f} % lost)".format(t, 100 * timer.loss_rate(t)) for t in timedout_boards))
             logging.warning(msg)
-
-            # Ask timed-out boards again for their status
-#            for id in timedout_boards:
-#                data, code = get_status(connection, id)
-#                if code is None:
-#                    continue
-#                if code == Error.SUCCESS:
-#                    # The datagram was actually received properly. Don't resend to this destination.
-#                    answers[id] = data
-
-            # Re-calculate list of get_status() invokations
-#            timedout_boards = list(set(destinations) - set(answers))
+            adapt_pacing(timer)
 
             if len(timedout_boards) > 0:
                 if retry_forever:
@@ -282,24 +813,133 @@ def write_command_retry(connection, command, destinations, source=0, retry_limit
 
                 # Resend the command datagram
                 if RETRY_DELAY > 0.0:
-                    sleep(RETRY_DELAY)
+                    sleep(retry_delay(retry_count))
                 logging.info("Retrying transmission (attempt " + str(retry_count + 2) + "/" + str(1 + retry_limit) + ")...")
-                write_command(connection, command, timedout_boards, source)
+                deadline = time() + timer.timeout(timedout_boards, command, flags)
+                write_command(connection, command, timedout_boards, source, flags)
+                timer.sent(timedout_boards)
+                retransmitted.update(timedout_boards)
                 retry_count += 1
 
             continue
 
         data, _, src = dt
+        if src in CLIENT_IDS:
+            # The command of another client addressing the same nodes.
+            # Replies of other nodes are kept, e.g. of a node whose ID was just changed.
+            continue
+
         answers[src] = data
 
+        if src in destinations and src not in retransmitted:
+            rtt = time() - sent_at - transmission_time(command, len(destinations))
+            timer.sample(src, kind, max(0., rtt))
+
     logging.debug("Transmission succeeded.")
     return answers
 
 
-def config_update_and_save(connection, config, destinations):
+async def request_retry(transport, command, destinations, retry_limit=3, timer=None, sources=None):
+    """
+    Sends a command with the given can.aio.Transport, retries as long as there is no answer
+    and returns a dictionary containing a map of each board ID and its answer.
+
+    Every transmission is awaited until its own deadline, the retransmission timeout
+    of the nodes which did not answer yet (see RetransmissionTimer).
+    Boards which did not answer after retry_limit retries are missing.
+
+    If sources are given, their answers are awaited instead of the destinations' ones
+    and retransmissions are sent to all destinations.
+    """
+    timer = timer or retransmission_timer
+    kind = command_type(command)
+
+    answers = dict()
+    pending = list(destinations if sources is None else sources)
+    for retry_count in range(1 + retry_limit):
+        if retry_count > 0:
+            await asyncio.sleep(retry_delay(retry_count - 1))
+            logging.info("Retrying transmission (attempt " + str(retry_count + 1) + "/" + str(1 + retry_limit) + ")...")
+
+        targets = pending if sources is None else destinations
+        timer.sent(targets)
+        replies = await transport.request(command, targets, timeout=timer.timeout(targets, command),
+                                          sources=None if sources is None else pending)
+        answers.update(replies)
+
+        pending = [id for id in pending if id not in replies]
+        if not pending:
+            break
+
+        timer.lost(pending, kind)
+        logging.warning("Did not receive a valid response datagram from the following targets: {}".format(
+            ", ".join(str(id) for id in pending)))
+
+    return answers
+
+
+def write_command_async(connection, command, destinations, source=None, timeout=10.0):
+    """
+    Submits a command for asynchronous execution and polls the destinations
+    until the command has finished.
+
+    Since the submission is acknowledged immediately, retransmissions only happen,
+    if a datagram was actually lost. A retransmitted submission carries the same token
+    and is therefore not executed twice.
+
+    Returns a dictionary mapping each board ID to its MessagePack encoded result,
+    like write_command_retry(). Boards which rejected the command or didn't finish it
+    within the timeout are missing.
+    """
+    if source is None:
+        source = SOURCE_ID
+
+    token = next_token()
+    submit = commands.encode_submit_async(token, command)
+
+    answers = write_command_retry(connection, submit, destinations, source)
+
+    pending = list()
+    for id, data in answers.items():
+        state = msgpack.unpackb(data)
+        if state in (JobState.QUEUED, JobState.RUNNING, JobState.DONE):
+            pending.append(id)
+        else:
+            logging.error("Node " + str(id) + " rejected asynchronous command: " + str(state))
+
+    results = dict()
+    deadline = time() + timeout
+    while len(pending) > 0:
+        if time() > deadline:
+            logging.error("Asynchronous command did not finish on nodes: " + \
+                          ", ".join(str(i) for i in pending))
+            break
+
+        sleep(ASYNC_POLL_INTERVAL)
+        replies = write_command_retry(connection, commands.encode_get_status(token),
+                                      list(pending), source, error_exit=False)
+
+        for id, data in replies.items():
+            reply_token, state, result = msgpack.unpackb(data, raw=False)
+            if reply_token != token:
+                continue
+            if state == JobState.DONE:
+                results[id] = msgpack.packb(result, use_bin_type=True)
+                pending.remove(id)
+            elif state == JobState.UNKNOWN:
+                logging.error("Node " + str(id) + " lost asynchronous command.")
+                pending.remove(id)
+
+    return results
+
+
+def config_update_and_save(connection, config, destinations, asynchronous=False):
     """
     Updates the config of the given destinations.
     Keys not in the given config are left unchanged.
+
+    If asynchronous is set, the nodes acknowledge the save request immediately
+    and the client polls for its completion.
     """
     # First send the updated config
     logging.info("Encoding config udpate: " + str(config))
@@ -308,4 +948,7 @@ def config_update_and_save(connection, config, destinations):
 
     # Then save the config to flash
     logging.info("Requesting config write to flash...")
-    write_command_retry(connection, commands.encode_save_config(), destinations)
+    if asynchronous:
+        write_command_async(connection, commands.encode_save_config(), destinations)
+    else:
+        write_command_retry(connection, commands.encode_save_config(), destinations)
@@ -3,7 +3,7 @@
 from sys import exit, stdin
 from json import loads as json_from_string
 
-from cvra_bootloader import utils
+from cvra_bootloader import commands, utils
 
 
 def parse_commandline_args():
@@ -56,7 +56,8 @@ def main():
         exit(1)
 
     connection = utils.open_connection(args)
-    utils.config_update_and_save(connection, config, args.ids)
+    asynchronous = utils.supports_command(connection, args.ids, commands.CommandType.SubmitAsync)
+    utils.config_update_and_save(connection, config, args.ids, asynchronous=asynchronous)
 
     # TODO: Perform CRC on written config to verify success
 
@@ -28,6 +28,7 @@ setup(
             'bootloader_flash=cvra_bootloader.bootloader_flash:main',
             'bootloader_change_id=cvra_bootloader.change_id:main',
             'bootloader_read_config=cvra_bootloader.read_config:main',
+            'bootloader_read_stats=cvra_bootloader.read_stats:main',
             'bootloader_run_app=cvra_bootloader.run_application:main',
             'bootloader_write_config=cvra_bootloader.write_config:main',
             'bootloader_invoke=cvra_bootloader.invoke:main',
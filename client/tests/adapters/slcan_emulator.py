@@ -0,0 +1,69 @@
+"""
+Emulates an SLCAN adapter on a pseudo terminal.
+
+Configuration commands are acknowledged and transmitted frames are
+acknowledged and looped back, as if another node echoed them on the bus.
+"""
+import os
+import threading
+import tty
+
+
+class SLCANEmulator:
+    def __init__(self, loopback=True):
+        self.master, self.slave = os.openpty()
+        tty.setraw(self.slave)
+        self.device = os.ttyname(self.slave)
+        self.loopback = loopback
+
+        # Frame messages received from the host, without carriage return
+        self.frames = []
+        self.condition = threading.Condition()
+
+        t = threading.Thread(target=self.run)
+        t.daemon = True
+        t.start()
+
+    def run(self):
+        part = b''
+        while True:
+            try:
+                data = os.read(self.master, 4096)
+            except OSError:
+                # Pseudo terminal was closed
+                return
+
+            messages = (part + data).split(b'\r')
+            messages, part = messages[:-1], messages[-1]
+
+            frames = [m for m in messages if m[:1] in (b't', b'T')]
+            replies = b''
+            for message in messages:
+                if message in frames:
+                    replies += b'z\r' + (message + b'\r' if self.loopback else b'')
+                else:
+                    replies += b'\r'
+
+            with self.condition:
+                self.frames += frames
+                self.condition.notify_all()
+
+            if replies:
+                os.write(self.master, replies)
+
+    def send(self, messages):
+        """
+        Sends the given frame messages to the host, as if received from the bus.
+        """
+        os.write(self.master, b''.join(m + b'\r' for m in messages))
+
+    def wait_frames(self, count, timeout=5.):
+        """
+        Waits until count frames were received from the host.
+        """
+        with self.condition:
+            return self.condition.wait_for(lambda: len(self.frames) >= count, timeout)
+
+    def close(self):
+        os.close(self.master)
+        os.close(self.slave)
@@ -0,0 +1,68 @@
+from unittest import TestCase
+from unittest.mock import *
+
+from argparse import Namespace
+
+import can
+from can import Frame
+from can.adapters.slcan import SLCANInterface
+from .slcan_emulator import SLCANEmulator
+
+
+class SLCANFrameTestCase(TestCase):
+    def setUp(self):
+        with patch('serial.Serial'), patch('threading.Thread'):
+            self.slcan = SLCANInterface(Namespace(serial_device='/dev/null', ids=[]))
+
+    def test_decode_standard_frame(self):
+        frame = self.slcan.decode_frame(b't02a4deadbeef')
+        self.assertEqual(Frame(id=42, data=b'\xde\xad\xbe\xef'), frame)
+        self.assertFalse(frame.extended)
+
+    def test_decode_extended_frame(self):
+        frame = self.slcan.decode_frame(b'T0000002a1ff')
+        self.assertEqual(Frame(id=42, data=b'\xff', extended=True), frame)
+
+    def test_acknowledgement_is_ignored(self):
+        self.assertIsNone(self.slcan.decode_frame(b'z'))
+        self.assertIsNone(self.slcan.decode_frame(b''))
+
+    def test_truncated_frame_is_ignored(self):
+        self.assertIsNone(self.slcan.decode_frame(b't02a4dead'))
+
+    def test_encode_frame(self):
+        self.assertEqual('t02a4deadbeef', self.slcan.encode_frame(Frame(id=42, data=b'\xde\xad\xbe\xef')))
+        self.assertEqual('T0000002a0', self.slcan.encode_frame(Frame(id=42, extended=True)))
+
+    def test_frames_are_coalesced_into_one_write(self):
+        self.slcan.port = Mock()
+
+        self.slcan.send_frames([Frame(id=1, data=b'\x01'), Frame(id=2)])
+
+        self.slcan.port.write.assert_called_once_with(b't001101\rt0020\r')
+
+
+class SLCANLoopbackTestCase(TestCase):
+    def setUp(self):
+        self.emulator = SLCANEmulator()
+        self.slcan = SLCANInterface(Namespace(serial_device=self.emulator.device, ids=[]))
+
+    def tearDown(self):
+        self.slcan.port.close()
+        self.emulator.close()
+
+    def test_datagram_is_looped_back(self):
+        datagram = can.encode_datagram(bytes(range(100)), [1, 2, 3])
+        frames = list(can.datagram_to_frames(datagram, 0))
+
+        self.slcan.send_frames(frames)
+
+        received = [self.slcan.receive_frame() for _ in frames]
+        self.assertEqual(frames, received)
+
+    def test_frames_split_across_reads(self):
+        self.emulator.send([b't0011ab'])
+        self.emulator.send([b't00211c'])
+
+        self.assertEqual(Frame(id=1, data=b'\xab'), self.slcan.receive_frame())
+        self.assertEqual(Frame(id=2, data=b'\x1c'), self.slcan.receive_frame())
@@ -5,9 +5,10 @@ except ImportError:
     from mock import *
 
 
+import errno
 import socket
 import struct
-from can.adapters import SocketCANConnection
+from can.adapters.socketcan import SocketCANInterface
 from can import Frame
 
 # SocketCAN compatibility shims for OSX
@@ -18,59 +19,133 @@ except ImportError:
     socket.CAN_RAW = "CAN_RAW"
 
 
+def can_frame(id, data):
+    # See <linux/can.h> for format
+    # Data field must be zero padded
+    return struct.pack("=IB3x8s", id, len(data), data.ljust(8, b'\x00'))
+
+
+@patch('threading.Thread')
 @patch('socket.socket')
 class SocketCANTestCase(TestCase):
-    def test_can_open_connection(self, socket_create):
+    def test_can_open_connection(self, socket_create, thread):
         """
         Checks that we can correctly open a connection.
         """
-        SocketCANConnection('vcan0')
+        SocketCANInterface('vcan0')
 
         socket_create.assert_any_call(socket.AF_CAN,
                                       socket.SOCK_RAW,
                                       socket.CAN_RAW)
 
         socket_create.return_value.bind.assert_any_call(('vcan0', ))
-        socket_create.return_value.settimeout.assert_any_call(ANY)
-        socket_create.return_value.setsockopt.assert_any_call(socket.SOL_SOCKET, socket.SO_SNDBUF, 4096)
+        socket_create.return_value.setblocking.assert_any_call(False)
+        socket_create.return_value.setsockopt.assert_any_call(socket.SOL_SOCKET, socket.SO_SNDBUF,
+                                                              SocketCANInterface.SOCKET_BUFFER_SIZE)
+        socket_create.return_value.setsockopt.assert_any_call(socket.SOL_SOCKET, socket.SO_RCVBUF,
+                                                              SocketCANInterface.SOCKET_BUFFER_SIZE)
+
+    def test_no_filter_without_ids(self, socket_create, thread):
+        SocketCANInterface('vcan0')
+
+        for args, _ in socket_create.return_value.setsockopt.call_args_list:
+            self.assertNotEqual(SocketCANInterface.SOL_CAN_RAW, args[0])
+
+    def test_filter_from_ids(self, socket_create, thread):
+        SocketCANInterface('vcan0', ids=[2, 1])
+
+        # Standard data frames only, with or without start of datagram bit
+        mask = 0x80000000 | 0x40000000 | 0x77f
+        expected = struct.pack("=IIII", 1, mask, 2, mask)
+        socket_create.return_value.setsockopt.assert_any_call(SocketCANInterface.SOL_CAN_RAW,
+                                                              SocketCANInterface.CAN_RAW_FILTER,
+                                                              expected)
+
+    def test_can_send_frame(self, socket_create, thread):
+        s = SocketCANInterface('vcan0')
+        s.socket = Mock()
 
+        frame = Frame(id=42, data=bytes((0xde, 0xad, 0xbe, 0xef)))
 
-    def test_can_send_frame(self, socket_create):
-        s = SocketCANConnection('vcan0')
+        s.send_frame(frame)
+
+        s.socket.send.assert_any_call(can_frame(42, bytes((0xde, 0xad, 0xbe, 0xef))))
+
+    def test_send_frames_in_order(self, socket_create, thread):
+        s = SocketCANInterface('vcan0')
         s.socket = Mock()
 
-        frame = Frame(id=42, data=bytes((0xde, 0xad, 0xbe, 0xef)))
+        frames = [Frame(id=i, data=bytes([i])) for i in range(3)]
+        s.send_frames(frames)
 
-        # See <linux/can.h> for format
-        # Data field must be zero padded
-        can_frame = struct.pack("=IB3x8s", 42, 4,
-                                bytes((0xde, 0xad, 0xbe, 0xef,
-                                       0x0, 0x0, 0x0, 0x0)))
+        expected = [call(can_frame(i, bytes([i]))) for i in range(3)]
+        self.assertEqual(expected, s.socket.send.call_args_list)
 
-        s.send_frame(frame)
+    @patch('select.select')
+    def test_send_waits_for_writable_socket(self, select, socket_create, thread):
+        s = SocketCANInterface('vcan0')
+        s.socket = Mock()
+        s.socket.send.side_effect = [BlockingIOError, None]
+
+        s.send_frame(Frame(id=42))
 
-        s.socket.send.assert_any_call(can_frame)
+        self.assertEqual(2, s.socket.send.call_count)
+        select.assert_any_call([], [s.socket], [], ANY)
 
-    def test_receive_frame(self, socket_create):
-        s = SocketCANConnection('vcan0')
+    @patch('time.sleep')
+    def test_send_retries_on_full_interface_queue(self, sleep, socket_create, thread):
+        s = SocketCANInterface('vcan0')
         s.socket = Mock()
+        s.socket.send.side_effect = [OSError(errno.ENOBUFS, 'No buffer space'),
+                                     OSError(errno.ENOBUFS, 'No buffer space'),
+                                     None]
 
-        expected_frame = Frame(id=42, data=bytes((0xde, 0xad, 0xbe, 0xef)))
+        s.send_frame(Frame(id=42))
 
-        can_frame = struct.pack("=IB3x8s", 42, 4,
-                                bytes((0xde, 0xad, 0xbe, 0xef,
-                                       0x0, 0x0, 0x0, 0x0)))
+        self.assertEqual(3, s.socket.send.call_count)
+        delays = [args[0] for args, _ in sleep.call_args_list]
+        self.assertLess(delays[0], delays[1])
 
+    @patch('time.monotonic')
+    @patch('time.sleep')
+    def test_send_gives_up_after_timeout(self, sleep, monotonic, socket_create, thread):
+        s = SocketCANInterface('vcan0')
+        s.socket = Mock()
+        s.socket.send.side_effect = OSError(errno.ENOBUFS, 'No buffer space')
+        monotonic.side_effect = [0, 1, SocketCANInterface.SEND_TIMEOUT]
 
-        s.socket.recvfrom.return_value = (can_frame, ('vcan0'))
+        with self.assertRaises(SystemExit):
+            s.send_frame(Frame(id=42))
+
+    @patch('select.select')
+    def test_receive_drains_several_frames(self, select, socket_create, thread):
+        s = SocketCANInterface('vcan0')
+        s.socket = Mock()
+        select.return_value = ([s.socket], [], [])
+        s.socket.recv.side_effect = [can_frame(42, b'\xde\xad'),
+                                     can_frame(43, b'\xbe\xef'),
+                                     BlockingIOError]
+
+        frames = s.receive_frames()
+
+        self.assertEqual([Frame(id=42, data=b'\xde\xad'), Frame(id=43, data=b'\xbe\xef')], frames)
+
+    @patch('select.select')
+    def test_receive_batch_is_limited(self, select, socket_create, thread):
+        s = SocketCANInterface('vcan0')
+        s.socket = Mock()
+        select.return_value = ([s.socket], [], [])
+        s.socket.recv.return_value = can_frame(42, b'')
 
-        actual_frame = s.receive_frame()
+        frames = s.receive_frames()
 
-        self.assertEqual(expected_frame, actual_frame)
+        self.assertEqual(SocketCANInterface.RECEIVE_BATCH_SIZE, len(frames))
 
-    def test_receive_frame_timeout(self, socket_create):
-        s = SocketCANConnection('vcan0')
+    @patch('select.select')
+    def test_receive_frame_timeout(self, select, socket_create, thread):
+        s = SocketCANInterface('vcan0')
         s.socket = Mock()
-        s.socket.recvfrom.side_effect = [socket.timeout]
+        select.return_value = ([], [], [])
 
-        s.receive_frame()
+        self.assertEqual([], s.receive_frames())
+        s.socket.recv.assert_not_called()
@@ -0,0 +1,125 @@
+"""
+Loopback benchmark of the frame throughput of the CAN adapters.
+
+SLCAN is measured against an emulated adapter on a pseudo terminal,
+SocketCAN against a second socket on a virtual CAN interface, if one is given:
+
+    python -m tests.benchmark_adapters [vcan0]
+"""
+import socket
+import struct
+import sys
+from argparse import Namespace
+from timeit import default_timer as timer
+
+import can
+import serial
+from can.adapters.slcan import SLCANInterface
+from can.adapters.socketcan import SocketCANInterface
+from tests.adapters.slcan_emulator import SLCANEmulator
+
+FRAME_COUNT = 10000
+
+# Frames of a datagram writing a 2 KiB page are sent as one burst
+BURST_SIZE = 260
+
+
+class LegacySLCANInterface(SLCANInterface):
+    """
+    Reads byte by byte and writes frame by frame, flushing around every write.
+    """
+    def spin(self):
+        part = ''
+        while self.port.is_open:
+            try:
+                part += self.port.read(1).decode('ascii')
+            except serial.serialutil.SerialException:
+                continue
+            if '\r' not in part:
+                continue
+
+            data = part.split('\r')
+            data, part = data[:-1], data[-1]
+            for frame in data:
+                frame = self.decode_frame(frame.encode('ascii'))
+                if frame:
+                    self.rx_queue.put(frame)
+
+    def send_frames(self, frames):
+        for frame in frames:
+            self.port.flushOutput()
+            self.port.write((self.encode_frame(frame) + '\r').encode('ascii'))
+            self.port.flushOutput()
+
+
+def frames():
+    return [can.Frame(id=0x80 * (i % BURST_SIZE == 0), data=struct.pack('<Q', i)) for i in range(FRAME_COUNT)]
+
+
+def send(adapter, wait):
+    all_frames = frames()
+    start = timer()
+    for i in range(0, FRAME_COUNT, BURST_SIZE):
+        adapter.send_frames(all_frames[i:i + BURST_SIZE])
+    wait()
+    return FRAME_COUNT / (timer() - start)
+
+
+def receive(adapter, peer_send):
+    start = timer()
+    peer_send(frames())
+    for _ in range(FRAME_COUNT):
+        if adapter.receive_frame() is None:
+            raise RuntimeError("Frames were lost")
+    return FRAME_COUNT / (timer() - start)
+
+
+def measure_slcan(cls):
+    emulator = SLCANEmulator(loopback=False)
+    adapter = cls(Namespace(serial_device=emulator.device, ids=[]))
+
+    tx = send(adapter, lambda: emulator.wait_frames(FRAME_COUNT, timeout=60))
+    rx = receive(adapter, lambda f: emulator.send([adapter.encode_frame(frame).encode('ascii') for frame in f]))
+
+    adapter.port.close()
+    emulator.close()
+    return tx, rx
+
+
+def measure_socketcan(interface):
+    adapter = SocketCANInterface(interface)
+    peer = socket.socket(socket.AF_CAN, socket.SOCK_RAW, socket.CAN_RAW)
+    peer.bind((interface,))
+    peer.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, SocketCANInterface.SOCKET_BUFFER_SIZE)
+
+    def wait():
+        for _ in range(FRAME_COUNT):
+            peer.recv(SocketCANInterface.CAN_FRAME_SIZE)
+
+    def peer_send(frames):
+        for frame in frames:
+            peer.send(adapter.encode_frame(frame))
+
+    tx = send(adapter, wait)
+    rx = receive(adapter, peer_send)
+
+    peer.close()
+    return tx, rx
+
+
+def report(name, rates):
+    print("  {:<14} {:>9.0f} {:>9.0f}".format(name, *rates))
+
+
+def main():
+    print("Frames per second, {} frames in bursts of {}:".format(FRAME_COUNT, BURST_SIZE))
+    print("  {:<14} {:>9} {:>9}".format("adapter", "transmit", "receive"))
+    report("SLCAN legacy", measure_slcan(LegacySLCANInterface))
+    report("SLCAN", measure_slcan(SLCANInterface))
+
+    if len(sys.argv) > 1:
+        report("SocketCAN", measure_socketcan(sys.argv[1]))
+
+
+if __name__ == '__main__':
+    main()
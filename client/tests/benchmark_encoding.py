@@ -0,0 +1,74 @@
+"""
+Micro-benchmark of slicing and encoding a 1 MiB image into write datagrams.
+
+Run with python -m tests.benchmark_encoding
+"""
+from timeit import default_timer as timer
+
+import can
+from cvra_bootloader import commands, page, utils
+
+IMAGE_SIZE = 1 << 20
+PAGE_SIZE = 2048
+DESTINATIONS = list(range(1, 31))
+ATTEMPTS = 3
+
+
+def legacy_slice_into_pages(data, page_size):
+    while len(data) > page_size:
+        yield data[:page_size]
+        data = data[page_size:]
+    yield data
+
+
+def legacy_datagram_to_frames(datagram, source):
+    start_bit = can.START_OF_DATAGRAM_MASK
+    while len(datagram) > 8:
+        data, datagram = datagram[:8], datagram[8:]
+        yield can.Frame(id=start_bit + source, data=data)
+        start_bit = 0
+    yield can.Frame(id=start_bit + source, data=datagram)
+
+
+def legacy(binary):
+    """
+    Slices by copying and encodes every page again for each attempt.
+    """
+    for offset, chunk in enumerate(legacy_slice_into_pages(binary, PAGE_SIZE)):
+        for _ in range(ATTEMPTS):
+            command = commands.encode_write_flash(chunk, offset * PAGE_SIZE, 'dummy')
+            datagram = can.encode_datagram(command, DESTINATIONS)
+            list(legacy_datagram_to_frames(datagram, 0))
+
+
+def cached(binary):
+    """
+    Slices memoryviews and encodes every page once.
+    """
+    cache = utils.DatagramCache()
+    for offset, chunk in enumerate(page.slice_into_pages(binary, PAGE_SIZE)):
+        command = commands.encode_write_flash(chunk, offset * PAGE_SIZE, 'dummy')
+        for _ in range(ATTEMPTS):
+            cache.frames(command, DESTINATIONS)
+
+
+def measure(function, *args):
+    start = timer()
+    function(*args)
+    return timer() - start
+
+
+def main():
+    binary = bytes(range(256)) * (IMAGE_SIZE // 256)
+
+    print("Slicing {} KiB into {} byte pages:".format(IMAGE_SIZE // 1024, PAGE_SIZE))
+    print("  copying:     {:.3f} s".format(measure(lambda: list(legacy_slice_into_pages(binary, PAGE_SIZE)))))
+    print("  memoryview:  {:.3f} s".format(measure(lambda: list(page.slice_into_pages(binary, PAGE_SIZE)))))
+
+    print("Encoding all pages, {} attempts each:".format(ATTEMPTS))
+    print("  per attempt: {:.3f} s".format(measure(legacy, binary)))
+    print("  cached:      {:.3f} s".format(measure(cached, binary)))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,44 @@
+"""
+Simulated flash session times of lockstep and per node scheduled sessions.
+
+Run with python -m tests.benchmark_flash_session
+"""
+from unittest.mock import patch
+
+from tests.simulator import BusSimulation, NodeModel
+
+PAGES = 64
+
+
+def fleets():
+    uniform = {id: NodeModel(0.02, 0.05, 0.03, 0.) for id in range(1, 12)}
+
+    flaky = dict(uniform)
+    flaky[11] = NodeModel(0.02, 0.05, 0.03, 0.05)
+
+    # Nodes with small, fast erasing pages, nodes with slowly erased sectors and a flaky node
+    mixed = {id: NodeModel(0.02, 0.05, 0.03, 0.) for id in range(1, 9)}
+    mixed.update({id: NodeModel(0.25, 0.015, 0.01, 0.) for id in range(9, 11)})
+    mixed[11] = NodeModel(0.02, 0.05, 0.03, 0.05)
+
+    return [("uniform", uniform), ("one flaky", flaky), ("mixed", mixed)]
+
+
+def main():
+    bus = BusSimulation()
+    print("Flash sessions of {} pages, total (mean node) seconds and commands:".format(PAGES))
+    print("  {:<10} {:>20} {:>20}".format("fleet", "lockstep", "independent"))
+
+    # SocketCAN and SLCAN connections don't delay frames
+    with patch('cvra_bootloader.utils.INTER_FRAME_DELAY', 0.0):
+        for name, fleet in fleets():
+            columns = []
+            for independent in (False, True):
+                result = bus.flash_session(fleet, PAGES, independent)
+                mean = sum(result.finish_times.values()) / len(result.finish_times)
+                columns.append("{:.2f} ({:.2f}) {:>4}".format(result.duration, mean, result.commands))
+            print("  {:<10} {:>20} {:>20}".format(name, *columns))
+
+
+if __name__ == '__main__':
+    main()
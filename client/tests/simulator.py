@@ -0,0 +1,319 @@
+"""
+Virtual time simulation of bootloader nodes replying on a shared CAN bus.
+
+The bus arbitrates like CAN: whenever it becomes idle, the pending frame
+with the lowest ID is transmitted. The client side models a CAN adapter
+with a small receive buffer, which is drained at a fixed rate,
+so that bursts of replies can overflow it and frames get lost.
+"""
+import heapq
+import itertools
+import random
+from collections import deque, namedtuple
+
+import can
+import msgpack
+
+from cvra_bootloader import commands, utils, scheduler
+
+
+ReplyResult = namedtuple('ReplyResult', [
+    'duration',             # Seconds until the last frame was transmitted
+    'received',             # Set of node IDs whose reply was received completely
+    'dropped_frames',       # Frames lost in the client's receive buffer
+    'arbitration_losses',   # Number of times a pending frame lost arbitration
+    'bus_time',             # Seconds the bus was busy
+])
+
+FlashResult = namedtuple('FlashResult', [
+    'duration',             # Seconds until all pages were written and acknowledged
+    'reply_time',           # Seconds spent waiting for replies
+])
+
+SessionResult = namedtuple('SessionResult', [
+    'duration',             # Seconds until all nodes completed or were given up
+    'finish_times',         # Seconds until each node completed, by node ID
+    'commands',             # Number of commands sent
+])
+
+NodeModel = namedtuple('NodeModel', [
+    'erase_time',           # Seconds to erase a page
+    'write_time',           # Seconds to write a page
+    'verify_time',          # Seconds to compute the checksum of the image
+    'loss',                 # Probability that a command to the node is lost
+])
+
+CommandResult = namedtuple('CommandResult', [
+    'duration',             # Seconds until all replies were received
+    'rounds',               # Number of transmissions including retries
+    'bus_time',             # Seconds the bus was busy with replies
+])
+
+
+def frame_time(frame, bitrate):
+    """
+    Returns the transmission time of a standard frame in seconds,
+    including interframe space and typical bit stuffing.
+    """
+    bits = 47 + 8 * len(frame.data)
+    bits += (34 + 8 * len(frame.data)) // 5
+    return bits / bitrate
+
+
+class Adapter:
+    """
+    Client side CAN adapter, which buffers up to buffer_size frames
+    and hands one frame to the host every frame_interval seconds.
+    """
+    def __init__(self, buffer_size, frame_interval):
+        self.buffer_size = buffer_size
+        self.frame_interval = frame_interval
+        self.done = deque()
+
+    def receive(self, time):
+        """
+        Returns False, if the frame arriving at the given time is dropped.
+        """
+        while self.done and self.done[0] <= time:
+            self.done.popleft()
+
+        if len(self.done) >= self.buffer_size:
+            return False
+
+        start = self.done[-1] if self.done else time
+        self.done.append(max(start, time) + self.frame_interval)
+        return True
+
+
+class LockstepScheduler(scheduler.FlashScheduler):
+    """
+    Advances all nodes together, like flash_image() without independent:
+    a step is sent again to the nodes which didn't complete it, until all did.
+    """
+    def next_requests(self):
+        nodes = [node for node in self.nodes.values() if not node.finished]
+        if not nodes or any(node.busy for node in nodes):
+            return []
+
+        position = min(node.position for node in nodes)
+        lagging = [node for node in nodes if node.position == position]
+        for node in lagging:
+            node.busy = True
+
+        step, offset = lagging[0].steps[position]
+        return [scheduler.Request(step, offset, tuple(sorted(node.id for node in lagging)))]
+
+
+class BusSimulation:
+    def __init__(self, bitrate=1000000, rx_buffer_size=8, rx_frame_interval=0.0002,
+                 reply=msgpack.packb(1)):
+        self.bitrate = bitrate
+        self.rx_buffer_size = rx_buffer_size
+        self.rx_frame_interval = rx_frame_interval
+        self.reply = reply
+
+    def replies(self, ready_times):
+        """
+        Simulates the reply datagrams of all nodes,
+        each becoming ready for transmission at ready_times[id].
+        """
+        adapter = Adapter(self.rx_buffer_size, self.rx_frame_interval)
+        pending = {}
+        for node, ready in ready_times.items():
+            datagram = can.encode_datagram(self.reply, [0])
+            pending[node] = [ready, deque(can.datagram_to_frames(datagram, node))]
+
+        time, bus_time, losses = 0.0, 0.0, 0
+        dropped = 0
+        incomplete = set()
+
+        while pending:
+            ready = [node for node, (t, _) in pending.items() if t <= time]
+            if not ready:
+                time = min(t for t, _ in pending.values())
+                continue
+
+            winner = min(ready, key=lambda node: pending[node][1][0].id)
+            losses += len(ready) - 1
+
+            frame = pending[winner][1].popleft()
+            duration = frame_time(frame, self.bitrate)
+            time += duration
+            bus_time += duration
+
+            if not adapter.receive(time):
+                dropped += 1
+                incomplete.add(winner)
+
+            pending[winner][0] = time
+            if not pending[winner][1]:
+                del pending[winner]
+
+        return ReplyResult(duration=time,
+                           received=set(ready_times) - incomplete,
+                           dropped_frames=dropped,
+                           arbitration_losses=losses,
+                           bus_time=bus_time)
+
+    def command(self, nodes, slotted, execution_time=0.001, jitter=20e-6,
+                timeout=0.1, seed=0):
+        """
+        Simulates a multicast command to the given nodes, including retries
+        to the nodes whose reply was lost, and returns the total duration.
+        """
+        rng = random.Random(seed)
+        missing = sorted(nodes)
+        start, rounds, bus_time = 0.0, 0, 0.0
+
+        while missing:
+            rounds += 1
+            ready_times = {}
+            for slot, node in enumerate(missing):
+                ready = start + execution_time + rng.uniform(0, jitter)
+                if slotted:
+                    ready += slot * utils.REPLY_SLOT_DURATION
+                ready_times[node] = ready
+
+            result = self.replies(ready_times)
+            bus_time += result.bus_time
+            missing = sorted(set(missing) - result.received)
+
+            if missing:
+                # The client only notices lost replies by timing out
+                start = result.duration + timeout
+            else:
+                start = result.duration
+
+        return CommandResult(duration=start, rounds=rounds, bus_time=bus_time)
+
+    def page_time(self, nodes, page_size):
+        """
+        Returns the transmission time of a write command for one page,
+        including the client's delay between frames.
+        """
+        command = commands.encode_write_flash(bytes(page_size), 0, 'dummy')
+        frames = can.datagram_to_frames(can.encode_datagram(command, nodes), 0)
+        return sum(max(frame_time(frame, self.bitrate), utils.INTER_FRAME_DELAY)
+                   for frame in frames)
+
+    def flash(self, nodes, pages, nack_only, slotted=False, page_size=2048,
+              checkpoint_pages=16, seed=0):
+        """
+        Simulates writing the given number of pages to all nodes.
+
+        Acknowledged writes wait for the replies of all nodes after every page.
+        NACK-only writes only wait for the checksum replies at every checkpoint.
+        """
+        page_time = self.page_time(nodes, page_size)
+        duration, reply_time = 0.0, 0.0
+
+        for index in range(pages):
+            duration += page_time
+
+            checkpoint = (index + 1) % checkpoint_pages == 0 or index == pages - 1
+            if not nack_only or checkpoint:
+                # Checkpoints are sent with the same reply mode as acknowledged writes
+                result = self.command(nodes, slotted, seed=seed + index)
+                duration += result.duration
+                reply_time += result.duration
+
+        return FlashResult(duration=duration, reply_time=reply_time)
+
+    def command_time(self, step, nodes, page_size):
+        """
+        Returns the transmission time of the command for a flash session step.
+        """
+        if step == scheduler.WRITE:
+            return self.page_time(list(nodes), page_size)
+
+        if step == scheduler.ERASE:
+            command = commands.encode_erase_flash_page(0, 'dummy')
+        else:
+            command = commands.encode_crc_region(0, 0)
+        frames = can.datagram_to_frames(can.encode_datagram(command, list(nodes)), 0)
+        return sum(max(frame_time(frame, self.bitrate), utils.INTER_FRAME_DELAY)
+                   for frame in frames)
+
+    def flash_session(self, fleet, pages, independent, page_size=2048, timeout=0.1,
+                      window=0.01, seed=0):
+        """
+        Simulates erasing, writing and verifying the given number of pages
+        on a fleet of nodes, given as dict of node ID and NodeModel.
+
+        Independent sessions use the per node scheduler of the flash tool:
+        the nodes replying within window seconds of the first reply advance together.
+        Otherwise all nodes advance in lockstep. Commands and replies share the bus,
+        nodes which didn't reply timeout seconds after the command are sent it again.
+        """
+        rng = random.Random(seed)
+        offsets = [index * page_size for index in range(pages)]
+        cls = scheduler.FlashScheduler if independent else LockstepScheduler
+        sched = cls(sorted(fleet), offsets, offsets)
+
+        reply_frames = can.datagram_to_frames(can.encode_datagram(self.reply, [0]), 0)
+        reply_time = sum(frame_time(frame, self.bitrate) for frame in reply_frames)
+        command_times = {}
+
+        events, sequence = [], itertools.count()
+        waiting = {}        # Nodes expected to reply, by request
+        replied = {}        # Nodes which replied, but weren't passed to the scheduler yet
+        finish_times = {}
+        bus_free, sent = 0.0, 0
+
+        def issue(now):
+            nonlocal bus_free, sent
+            for request in sched.next_requests():
+                key = (request.step, len(request.nodes))
+                if key not in command_times:
+                    command_times[key] = self.command_time(request.step, request.nodes, page_size)
+
+                bus_free = max(now, bus_free) + command_times[key]
+                sent += 1
+                waiting[request] = set(request.nodes)
+                replied[request] = set()
+                heapq.heappush(events, (bus_free + timeout, next(sequence), 'timeout', request, None))
+
+                for id in request.nodes:
+                    node = fleet[id]
+                    if rng.random() < node.loss:
+                        continue
+                    execution = {scheduler.ERASE: node.erase_time,
+                                 scheduler.WRITE: node.write_time,
+                                 scheduler.VERIFY: node.verify_time}[request.step]
+                    heapq.heappush(events, (bus_free + execution, next(sequence), 'ready', request, id))
+
+        def release(request, nodes, now):
+            sched.completed(request, replied[request], nodes=nodes)
+            waiting[request] -= set(nodes)
+            replied[request] -= set(nodes)
+            for id in nodes:
+                if sched.nodes[id].finished:
+                    finish_times[id] = now
+            if not waiting[request]:
+                del waiting[request], replied[request]
+            issue(now)
+
+        issue(0.0)
+        while not sched.done():
+            now, _, kind, request, id = heapq.heappop(events)
+            if request not in waiting:
+                # Completed already
+                continue
+
+            if kind == 'timeout':
+                release(request, list(waiting[request]), now)
+            elif kind == 'window':
+                if replied[request]:
+                    release(request, list(replied[request]), now)
+            elif id in waiting[request]:
+                # Replies are transmitted in the order they become ready
+                bus_free = max(now, bus_free) + reply_time
+                if independent and not replied[request]:
+                    heapq.heappush(events, (bus_free + window, next(sequence), 'window', request, None))
+                replied[request].add(id)
+                if replied[request] == waiting[request]:
+                    release(request, list(replied[request]), bus_free)
+
+        return SessionResult(duration=max(finish_times.values()),
+                             finish_times=finish_times,
+                             commands=sent)
@@ -0,0 +1,155 @@
+import asyncio
+import socket
+import unittest
+from argparse import Namespace
+
+import can
+from can.aio import Transport
+from can.adapters.slcan import SLCANInterface
+from tests.adapters.slcan_emulator import SLCANEmulator
+
+
+class FakeAdapter:
+    """
+    Adapter whose nodes reply to every datagram addressed to them
+    with their ID, unless they are mute. Renamed nodes reply with their new ID.
+    """
+    def __init__(self, nodes, mute=(), renamed=None):
+        self.nodes = nodes
+        self.mute = mute
+        self.renamed = renamed or {}
+        self.sent = []
+        self.rx = []
+        self.reader, self.writer = socket.socketpair()
+        self.reader.setblocking(False)
+
+    def fileno(self):
+        return self.reader.fileno()
+
+    def read_frames(self):
+        try:
+            self.reader.recv(4096)
+        except BlockingIOError:
+            pass
+        frames, self.rx = self.rx, []
+        return frames
+
+    def receive(self, frames):
+        self.rx += frames
+        self.writer.send(b'x')
+
+    def send_frames(self, frames):
+        self.sent += frames
+        data, destinations = can.decode_datagram(b''.join(f.data for f in frames))
+        for id in destinations:
+            if id in self.nodes and id not in self.mute:
+                reply = can.encode_datagram(bytes([id]) + data, [0])
+                self.receive(list(can.datagram_to_frames(reply, self.renamed.get(id, id))))
+
+    def close(self):
+        self.reader.close()
+        self.writer.close()
+
+
+class TransportTestCase(unittest.TestCase):
+    def run_with_transport(self, adapter, coroutine):
+        async def main():
+            transport = Transport(adapter)
+            try:
+                return await coroutine(transport)
+            finally:
+                transport.close()
+
+        try:
+            return asyncio.run(main())
+        finally:
+            adapter.close()
+
+    def test_request_returns_replies(self):
+        adapter = FakeAdapter([1, 2])
+
+        replies = self.run_with_transport(adapter, lambda t: t.request(b'cmd', [1, 2]))
+
+        self.assertEqual({1: b'\x01cmd', 2: b'\x02cmd'}, replies)
+
+    def test_request_returns_early(self):
+        adapter = FakeAdapter([1])
+
+        async def request(transport):
+            start = asyncio.get_running_loop().time()
+            await transport.request(b'cmd', [1], timeout=10.)
+            return asyncio.get_running_loop().time() - start
+
+        self.assertLess(self.run_with_transport(adapter, request), 1.)
+
+    def test_request_deadline(self):
+        adapter = FakeAdapter([1, 2], mute=[2])
+
+        replies = self.run_with_transport(adapter, lambda t: t.request(b'cmd', [1, 2], timeout=0.05))
+
+        self.assertEqual({1: b'\x01cmd'}, replies)
+
+    def test_request_awaits_given_sources(self):
+        adapter = FakeAdapter([1], renamed={1: 5})
+
+        replies = self.run_with_transport(adapter, lambda t: t.request(b'cmd', [1], timeout=1.,
+                                                                       sources=[5]))
+
+        self.assertEqual({5: b'\x01cmd'}, replies)
+
+    def test_concurrent_requests_to_different_nodes(self):
+        adapter = FakeAdapter([1, 2])
+
+        async def requests(transport):
+            return await asyncio.gather(transport.request(b'a', [1]),
+                                        transport.request(b'b', [2]))
+
+        replies = self.run_with_transport(adapter, requests)
+
+        self.assertEqual([{1: b'\x01a'}, {2: b'\x02b'}], replies)
+
+    def test_concurrent_request_to_same_node_is_rejected(self):
+        adapter = FakeAdapter([1], mute=[1])
+
+        async def requests(transport):
+            first = asyncio.ensure_future(transport.request(b'a', [1], timeout=0.05))
+            await asyncio.sleep(0)
+            with self.assertRaises(RuntimeError):
+                await transport.request(b'b', [1])
+            await first
+
+        self.run_with_transport(adapter, requests)
+
+    def test_unsolicited_datagram_is_queued(self):
+        adapter = FakeAdapter([])
+        datagram = can.encode_datagram(b'hello', [0])
+
+        async def receive(transport):
+            adapter.receive(list(can.datagram_to_frames(datagram, 5)))
+            return await transport.receive(timeout=1.)
+
+        self.assertEqual((b'hello', [0], 5), self.run_with_transport(adapter, receive))
+
+    def test_receive_timeout(self):
+        adapter = FakeAdapter([])
+
+        self.assertIsNone(self.run_with_transport(adapter, lambda t: t.receive(timeout=0.01)))
+
+
+class SLCANTransportTestCase(unittest.TestCase):
+    def test_looped_back_datagram_is_received(self):
+        emulator = SLCANEmulator()
+        adapter = SLCANInterface(Namespace(serial_device=emulator.device, ids=[]), reader_thread=False)
+
+        async def main():
+            transport = Transport(adapter)
+            transport.send(bytes(range(100)), [1, 2])
+            datagram = await transport.receive(timeout=1.)
+            transport.close()
+            return datagram
+
+        try:
+            self.assertEqual((bytes(range(100)), [1, 2], 0), asyncio.run(main()))
+        finally:
+            adapter.port.close()
+            emulator.close()
@@ -179,10 +179,123 @@ class CanDatagramTestCase(unittest.TestCase):
         with self.assertRaises(CRCMismatchError):
             decode_datagram(dt)
 
-    def test_that_datagram_start_is_detected_correctly(self):
+    def test_small_destination_list_keeps_version_1(self):
+        """
+        Checks that the list encoding is used, if it is not longer than a compact one.
+        """
+        dt = encode_datagram(self.data, [1, 2, 3])
+        self.assertEqual(DATAGRAM_VERSION, dt[0])
+
+    def test_consecutive_destinations_are_encoded_as_range(self):
+        """
+        Checks that addressing all nodes only takes one range.
+        """
+        dt = encode_datagram(self.data, list(range(1, 128)))
+        self.assertEqual(DATAGRAM_VERSION_COMPACT, dt[0])
+        self.assertEqual(bytes([DESTINATION_RANGES, 2, 1, 127]), dt[5:9])
+
+    def test_scattered_destinations_are_encoded_as_bitmap(self):
+        """
+        Checks that scattered node IDs are encoded as bitmap.
+        """
+        dt = encode_datagram(self.data, list(range(1, 128, 2)))
+        self.assertEqual(DATAGRAM_VERSION_COMPACT, dt[0])
+        self.assertEqual(bytes([DESTINATION_BITMAP, 16]), dt[5:7])
+        self.assertEqual(bytes([0xaa] * 16), dt[7:23])
+
+    def test_crc_covers_destination_format(self):
+        """
+        Checks that the CRC of a compact datagram includes the format byte.
+        """
+        dt = encode_datagram(self.data, list(range(1, 128)))
+        expected = pack('>I', crc32(dt[5:]))
+        self.assertEqual(expected, dt[1:5])
+
+    def test_receive_compact_datagram(self):
+        """
+        Checks that compact destinations are decoded into a list.
+        """
+        destinations = list(range(1, 128, 2))
+        data, dst = decode_datagram(encode_datagram(self.data, destinations))
+        self.assertEqual(dst, destinations)
+        self.assertEqual(data, self.data)
+
+    def test_device_class_destination(self):
+        """
+        Checks that a device class is addressed by its CRC32.
+        """
+        dt = encode_datagram(self.data, DeviceClassDestination("CVRA.motor.v1"))
+        self.assertEqual(DATAGRAM_VERSION_COMPACT, dt[0])
+        self.assertEqual(bytes([DESTINATION_CLASS, 4, 0xa1, 0x73, 0xee, 0xdb]), dt[5:11])
+
+    def test_group_destination(self):
+        """
+        Checks that groups are encoded and decoded.
+        """
+        dt = encode_datagram(self.data, GroupDestination(3, 5))
+        self.assertEqual(bytes([DESTINATION_GROUPS, 2, 3, 5]), dt[5:9])
+
+        _, dst = decode_datagram(dt)
+        self.assertEqual(dst, GroupDestination(3, 5))
+
+
         """
         This test checks that the start of datagram marker on a frame is
         detected correctly.
         """
         self.assertFalse(is_start_of_datagram(Frame(id=2)))
         self.assertTrue(is_start_of_datagram(Frame(id=2 + (1 << 7))))
+
+
+class DatagramDecoderTestCase(unittest.TestCase):
+    data = bytes(range(100))
+
+    def feed(self, datagram, chunk_size=8):
+        decoder = DatagramDecoder()
+        results = [decoder.input(datagram[i:i + chunk_size])
+                   for i in range(0, len(datagram), chunk_size)]
+        return [r for r in results if r is not None], results[-1]
+
+    def test_decode_frame_by_frame(self):
+        decoded, last = self.feed(encode_datagram(self.data, [1, 2]))
+
+        self.assertEqual([(self.data, [1, 2])], decoded)
+        self.assertIsNotNone(last)
+
+    def test_decode_byte_by_byte(self):
+        decoded, _ = self.feed(encode_datagram(self.data, [1, 2]), chunk_size=1)
+
+        self.assertEqual([(self.data, [1, 2])], decoded)
+
+    def test_decode_compact_datagram(self):
+        destinations = list(range(1, 40))
+        decoded, _ = self.feed(encode_datagram(self.data, destinations, FLAG_SLOTTED_REPLY))
+
+        self.assertEqual([(self.data, destinations)], decoded)
+
+    def test_datagram_is_emitted_once(self):
+        decoder = DatagramDecoder()
+        datagram = encode_datagram(self.data, [1])
+
+        self.assertIsNotNone(decoder.input(datagram))
+        self.assertIsNone(decoder.input(datagram))
+
+    def test_wrong_crc_is_rejected(self):
+        datagram = bytearray(encode_datagram(self.data, [1]))
+        datagram[-1] ^= 0xff
+
+        decoded, _ = self.feed(bytes(datagram))
+        self.assertEqual([], decoded)
+
+    def test_wrong_version_is_rejected(self):
+        datagram = bytes([42]) + encode_datagram(self.data, [1])[1:]
+
+        decoded, _ = self.feed(datagram)
+        self.assertEqual([], decoded)
+
+    def test_reset_begins_new_datagram(self):
+        decoder = DatagramDecoder()
+        decoder.input(encode_datagram(self.data, [1])[:8])
+        decoder.reset()
+
+        self.assertEqual((b'', [2]), decoder.input(encode_datagram(b'', [2])))
@@ -11,16 +11,16 @@ import cvra_bootloader.commands
 
 
 class BootloaderChangeIdTestCase(unittest.TestCase):
-    @patch('cvra_bootloader.utils.write_command_retry')
-    @patch('cvra_bootloader.utils.open_connection')
-    def test_integration(self, open_connection, write_command):
+    @patch('cvra_bootloader.utils.request_retry', new_callable=AsyncMock)
+    @patch('cvra_bootloader.utils.open_transport')
+    def test_integration(self, open_transport, request_retry):
         sys.argv = "test.py -p /dev/ttyUSB0 1 2".split()
-        open_connection.return_value = object()
 
         main()
 
+        # The node replies to the update with its new ID
         command = cvra_bootloader.commands.encode_update_config({'ID': 2})
-        write_command.assert_any_call(open_connection.return_value, command, [1])
+        request_retry.assert_any_call(open_transport.return_value, command, [1], sources=[2])
 
         command = cvra_bootloader.commands.encode_save_config()
-        write_command.assert_any_call(open_connection.return_value, command, [2])
+        request_retry.assert_any_call(open_transport.return_value, command, [2])
@@ -112,6 +112,15 @@ class EraseCommandTestCase(unittest.TestCase):
         """
         self.assertEqual(self.command[1][1].decode('ascii'), "LivewareProblem")
 
+    def test_erase_command_without_device_class(self):
+        """
+        Checks that the device class can be omitted for class addressed datagrams.
+        """
+        unpacker = Unpacker()
+        unpacker.feed(encode_erase_flash_page(0x1000))
+        command = list(unpacker)[1:]
+        self.assertEqual(command[1], [0x1000])
+
 class JumpToApplicationMainTestCase(unittest.TestCase):
     """
     Tests for the jump to application main command.
@@ -142,3 +151,63 @@ class PingTestCase(unittest.TestCase):
     def test_ping(self):
         self.assertEqual(self.command[0], 5)
 
+
+
+class GetStatsTestCase(unittest.TestCase):
+    """
+    Checks that the profiling statistics command is properly encoded.
+    """
+
+    def setUp(self):
+        raw_packet = encode_get_stats(True)
+        unpacker = Unpacker()
+        unpacker.feed(raw_packet)
+        self.command = list(unpacker)[1:]
+
+    def test_get_stats(self):
+        self.assertEqual(self.command, [11, [True]])
+
+
+class FlashSessionTestCase(unittest.TestCase):
+    """
+    Checks that the flash session command is properly encoded.
+    """
+
+    def setUp(self):
+        raw_packet = encode_flash_session(0x1000, 2048, 0xdeadbeef)
+        unpacker = Unpacker()
+        unpacker.feed(raw_packet)
+        self.command = list(unpacker)[1:]
+
+    def test_flash_session(self):
+        self.assertEqual(self.command, [14, [0x1000, 2048, 0xdeadbeef]])
+
+
+class SequencedTestCase(unittest.TestCase):
+    """
+    Checks that the sequenced command wraps the encoded command.
+    """
+
+    def setUp(self):
+        raw_packet = encode_sequenced(42, encode_ping())
+        unpacker = Unpacker()
+        unpacker.feed(raw_packet)
+        self.command = list(unpacker)[1:]
+
+    def test_sequenced(self):
+        self.assertEqual(self.command, [15, [42, encode_ping()]])
+
+
+class GetCapabilitiesTestCase(unittest.TestCase):
+    """
+    Checks that the capabilities command is properly encoded.
+    """
+
+    def setUp(self):
+        raw_packet = encode_get_capabilities()
+        unpacker = Unpacker()
+        unpacker.feed(raw_packet)
+        self.command = list(unpacker)[1:]
+
+    def test_get_capabilities(self):
+        self.assertEqual(self.command, [16, []])
@@ -6,14 +6,16 @@ except ImportError:
     from mock import *
 
 from cvra_bootloader.write_config import main
+from cvra_bootloader.commands import CommandType
 from io import StringIO
 import sys
 
 class WriteConfigToolTestCase(unittest.TestCase):
+    @patch('cvra_bootloader.utils.supports_command', return_value=False)
     @patch('cvra_bootloader.utils.config_update_and_save')
     @patch('cvra_bootloader.utils.open_connection')
     @patch('builtins.open')
-    def test_integration(self, open_mock, open_conn, config_save):
+    def test_integration(self, open_mock, open_conn, config_save, supports):
         sys.argv = "test.py -c test.json -p /dev/ttyUSB0 1 2 3".split()
         config_file = '{"foo":12}'
 
@@ -23,7 +25,24 @@ class WriteConfigToolTestCase(unittest.TestCase):
         main()
 
         open_mock.assert_any_call('test.json')
-        config_save.assert_any_call(open_conn.return_value, {'foo':12}, [1, 2, 3])
+        config_save.assert_any_call(open_conn.return_value, {'foo':12}, [1, 2, 3],
+                                    asynchronous=False)
+
+    @patch('cvra_bootloader.utils.supports_command', return_value=True)
+    @patch('cvra_bootloader.utils.config_update_and_save')
+    @patch('cvra_bootloader.utils.open_connection')
+    @patch('builtins.open')
+    def test_config_is_saved_asynchronously_if_supported(self, open_mock, open_conn, config_save,
+                                                         supports):
+        sys.argv = "test.py -c test.json -p /dev/ttyUSB0 1 2 3".split()
+        open_mock.return_value = StringIO('{"foo":12}')
+
+        main()
+
+        supports.assert_called_once_with(open_conn.return_value, [1, 2, 3],
+                                         CommandType.SubmitAsync)
+        config_save.assert_any_call(open_conn.return_value, {'foo':12}, [1, 2, 3],
+                                    asynchronous=True)
 
     @patch('builtins.open')
     @patch('builtins.print')
@@ -6,6 +6,7 @@ except ImportError:
 
 import can
 from cvra_bootloader.utils import read_can_datagrams
+from timeit import default_timer as timer
 
 class CANDatagramReaderTestCase(unittest.TestCase):
     """
@@ -158,3 +159,56 @@ class CANDatagramReaderTestCase(unittest.TestCase):
         self.assertEqual(dt.decode('ascii'), 'Hello world')
         self.assertEqual(dst, [1])
         self.assertEqual(src, 42)
+
+
+class LargeReplyThroughputTestCase(unittest.TestCase):
+    """
+    Decodes 8 KiB replies, as sent for read flash or read config.
+    """
+    size = 8192
+    replies = 10
+
+    def setUp(self):
+        data = bytes(range(256)) * (self.size // 256)
+        self.data = data
+        self.frames = list(can.datagram_to_frames(can.encode_datagram(data, [0]), source=1))
+
+    def legacy_decode(self):
+        """
+        Decodes the whole buffer again after every frame, as the reader used to.
+        """
+        buf = bytes()
+        for frame in self.frames:
+            buf += frame.data
+            datagram = can.decode_datagram(buf)
+            if datagram is not None:
+                return datagram
+
+    def incremental_decode(self):
+        decoder = can.DatagramDecoder()
+        for frame in self.frames:
+            datagram = decoder.input(frame.data)
+            if datagram is not None:
+                return datagram
+
+    def measure(self, decode):
+        start = timer()
+        for _ in range(self.replies):
+            data, _ = decode()
+        self.assertEqual(self.data, data)
+        return timer() - start
+
+    def test_large_replies_are_decoded_faster(self):
+        legacy = self.measure(self.legacy_decode)
+        incremental = self.measure(self.incremental_decode)
+
+        self.assertLess(incremental, legacy / 2)
+
+    def test_large_reply_is_read(self):
+        fdesc = Mock()
+        fdesc.receive_frame.side_effect = self.frames
+
+        data, dst, src = next(read_can_datagrams(fdesc))
+
+        self.assertEqual(self.data, data)
+        self.assertEqual(1, src)
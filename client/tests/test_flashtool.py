@@ -13,6 +13,7 @@ from cvra_bootloader.utils import *
 import msgpack
 
 from io import BytesIO
+import threading
 
 import sys
 
@@ -217,6 +218,442 @@ class ConfigTestCase(unittest.TestCase):
 
         self.assertEqual([1], valid_nodes)
 
+class QuietWriteTestCase(unittest.TestCase):
+    def setUp(self):
+        mock = lambda m: patch(m).start()
+        self.progressbar = mock('cvra_bootloader.bootloader_flash.ProgressBar')
+        self.write = mock('cvra_bootloader.utils.write_command')
+        self.write_retry = mock('cvra_bootloader.utils.write_command_retry')
+        self.reader = mock('cvra_bootloader.utils.read_can_datagrams')
+
+        self.conn = Mock()
+        self.conn.rx_queue.empty.return_value = True
+
+        self.binary = bytes(range(20)) * 10
+        self.write_retry.return_value = {1: msgpack.packb(crc32(self.binary)),
+                                         2: msgpack.packb(crc32(self.binary))}
+
+    def tearDown(self):
+        patch.stopall()
+
+    def test_pages_are_written_quietly(self):
+        failed = write_pages_quiet(self.conn, self.binary, 0x1000, 'dummy', [1, 2], page_size=100)
+
+        command = encode_write_flash(self.binary[100:], 0x1064, 'dummy')
+        self.write.assert_any_call(self.conn, command, [1, 2], flags=can.FLAG_QUIET)
+        self.assertEqual(set(), failed)
+
+    def test_erased_pages_are_not_written(self):
+        binary = bytes([0xff] * 100) + self.binary[100:]
+        write_pages_quiet(self.conn, binary, 0x1000, 'dummy', [1, 2], page_size=100)
+
+        self.assertEqual(1, self.write.call_count)
+
+    def test_checkpoint_verifies_checksum(self):
+        write_pages_quiet(self.conn, self.binary, 0x1000, 'dummy', [1, 2], page_size=100)
+
+        command = encode_crc_region(0x1000, len(self.binary))
+        self.write_retry.assert_called_once_with(self.conn, command, [1, 2], error_exit=False, flags=0)
+
+    def test_wrong_checksum_fails_board(self):
+        self.write_retry.return_value[2] = msgpack.packb(0xdead)
+
+        failed = write_pages_quiet(self.conn, self.binary, 0x1000, 'dummy', [1, 2], page_size=100)
+
+        self.assertEqual({2}, failed)
+
+    def test_error_reply_fails_board(self):
+        self.conn.rx_queue.empty.side_effect = [False, True, True]
+        self.reader.return_value = iter([(msgpack.packb(22), [0], 2)])
+        self.write_retry.return_value = {1: msgpack.packb(crc32(self.binary[:100]))}
+
+        failed = write_pages_quiet(self.conn, self.binary, 0x1000, 'dummy', [1, 2],
+                                   page_size=100, checkpoint_pages=1)
+
+        # The failed board is no longer addressed
+        command = encode_write_flash(self.binary[100:], 0x1064, 'dummy')
+        self.write.assert_any_call(self.conn, command, [1], flags=can.FLAG_QUIET)
+        self.assertEqual({2}, failed)
+
+
+class IndependentFlashTestCase(unittest.TestCase):
+    def setUp(self):
+        mock = lambda m: patch(m).start()
+        self.progressbar = mock('cvra_bootloader.bootloader_flash.ProgressBar')
+        self.write = mock('cvra_bootloader.utils.write_command')
+        self.reader = mock('cvra_bootloader.utils.read_can_datagrams')
+        patch('cvra_bootloader.utils.retransmission_timer', RetransmissionTimer()).start()
+
+        self.binary = bytes(range(20)) * 10
+        self.crc_command = encode_crc_region(0x1000, len(self.binary))
+
+        # Nodes reply to every command, unless they are mute
+        self.mute = set()
+        self.corrupt = set()
+        self.replies = []
+        self.write.side_effect = self.reply
+        self.reader.return_value = iter(self.next_reply, 'end')
+
+    def tearDown(self):
+        patch.stopall()
+
+    def reply(self, conn, command, destinations, flags=0):
+        for id in destinations:
+            status = 1
+            if command == self.crc_command:
+                status = 0xdead if id in self.corrupt else crc32(self.binary)
+            if id not in self.mute:
+                self.replies.append((msgpack.packb(status), [0], id))
+
+    def next_reply(self):
+        return self.replies.pop(0) if self.replies else None
+
+    def commands_to(self, id):
+        return [call[0][1] for call in self.write.call_args_list if id in call[0][2]]
+
+    def test_all_steps_are_sent_to_cohort(self):
+        failed = flash_pages_independently('conn', self.binary, 0x1000, 'dummy', [1, 2], page_size=100)
+
+        expected = [encode_erase_flash_page(0x1000, 'dummy'),
+                    encode_erase_flash_page(0x1064, 'dummy'),
+                    encode_write_flash(self.binary[:100], 0x1000, 'dummy'),
+                    encode_write_flash(self.binary[100:], 0x1064, 'dummy'),
+                    self.crc_command]
+        self.assertEqual(expected, [call[0][1] for call in self.write.call_args_list])
+        self.write.assert_any_call('conn', self.crc_command, [1, 2], flags=0)
+        self.assertEqual(set(), failed)
+
+    def test_erased_pages_are_not_written(self):
+        self.binary = bytes([0xff] * 100) + self.binary[100:]
+        self.crc_command = encode_crc_region(0x1000, len(self.binary))
+
+        flash_pages_independently('conn', self.binary, 0x1000, 'dummy', [1], page_size=100)
+
+        self.assertNotIn(encode_write_flash(self.binary[:100], 0x1000, 'dummy'), self.commands_to(1))
+
+    def test_pages_are_erased_in_erase_size_steps(self):
+        flash_pages_independently('conn', self.binary, 0x1000, 'dummy', [1], page_size=100, erase_size=50)
+
+        erased = [command for command in self.commands_to(1) if command[1] == CommandType.Erase]
+        self.assertEqual([encode_erase_flash_page(0x1000 + offset, 'dummy') for offset in (0, 50, 100, 150)],
+                         erased)
+
+    def test_unresponsive_node_does_not_stall_others(self):
+        self.mute.add(2)
+
+        failed = flash_pages_independently('conn', self.binary, 0x1000, 'dummy', [1, 2],
+                                           page_size=100, timeout=0.)
+
+        self.assertEqual({2}, failed)
+        self.assertEqual(5, len(self.commands_to(1)))
+        self.assertEqual([encode_erase_flash_page(0x1000, 'dummy')] * scheduler.MAX_ATTEMPTS,
+                         self.commands_to(2))
+
+    def test_late_reply_is_not_taken_for_next_step(self):
+        """
+        Checks that a reply arriving after the timeout completes the step it belongs to,
+        without a retransmission, whose reply would be taken for the next step's.
+        """
+        self.write.side_effect = None
+        erase = encode_erase_flash_page(0x1000, 'dummy')
+        replies = iter([None, None, (msgpack.packb(1), [0], 1)])
+        self.reader.return_value = iter(lambda: next(replies, None), 'end')
+
+        # Sent at 0 s, timed out at 1 s, replied at 1.2 s
+        with patch('cvra_bootloader.bootloader_flash.time') as clock:
+            clock.side_effect = [0., 0., 1., 1.2]
+            with self.assertRaises(StopIteration):
+                flash_pages_independently('conn', self.binary, 0x1000, 'dummy', [1],
+                                          page_size=100, timeout=0.5)
+
+        self.assertEqual([erase, encode_erase_flash_page(0x1064, 'dummy')], self.commands_to(1))
+
+    def test_late_node_drops_out_of_cohort(self):
+        failed = flash_pages_independently('conn', self.binary, 0x1000, 'dummy', [1, 2],
+                                           page_size=100, window=0.)
+
+        # Node 1's reply is read first and it advances without waiting for node 2
+        self.write.assert_any_call('conn', encode_erase_flash_page(0x1064, 'dummy'), [1], flags=0)
+        self.write.assert_any_call('conn', encode_erase_flash_page(0x1064, 'dummy'), [2], flags=0)
+        self.assertEqual(set(), failed)
+
+    @patch('logging.error')
+    def test_checksum_mismatch_fails_node(self, error):
+        self.corrupt.add(2)
+
+        failed = flash_pages_independently('conn', self.binary, 0x1000, 'dummy', [1, 2], page_size=100)
+
+        self.assertEqual({2}, failed)
+
+
+class MultipleBusesTestCase(unittest.TestCase):
+    def setUp(self):
+        mock = lambda m: patch(m).start()
+        self.print = mock('builtins.print')
+        self.progressbar = mock('cvra_bootloader.bootloader_flash.ProgressBar')
+        self.open_conn = mock('cvra_bootloader.utils.open_connection')
+        self.open_conn.side_effect = lambda args: args.can_interface
+        self.flash = mock('cvra_bootloader.bootloader_flash.flash_image')
+        self.verify = mock('cvra_bootloader.bootloader_flash.verify_flash_write')
+        self.verify.side_effect = lambda conn, binary, address, nodes, asynchronous: nodes
+        self.run = mock('cvra_bootloader.bootloader_flash.run_application')
+        self.negotiate = mock('cvra_bootloader.bootloader_flash.negotiate_transfer')
+        self.negotiate.return_value = Transfer(2048, 2048, 0., False, False)
+        patch('cvra_bootloader.utils.INTER_FRAME_DELAY', 0.004).start()
+
+        # Nodes 1 and 2 are on can0, nodes 3 and 4 on can1
+        self.online = {'can0': {1, 2}, 'can1': {3, 4}}
+        self.enumerate = mock('cvra_bootloader.bootloader_flash.enumerate_online_nodes')
+        self.enumerate.side_effect = lambda conn, ids: self.online[conn] & set(ids)
+
+        self.args = parse_commandline_args("-f test.bin -a 0x1000 -c dummy --bus can0 --bus can1 "
+                                           "1 2 3 4".split())
+
+    def tearDown(self):
+        patch.stopall()
+
+    def test_nodes_are_discovered(self):
+        nodes = map_nodes_to_buses({Bus('can0', None): 'can0', Bus('can1', None): 'can1'}, [1, 2, 3, 4])
+
+        self.assertEqual({Bus('can0', None): [1, 2], Bus('can1', None): [3, 4]}, nodes)
+
+    def test_given_nodes_are_not_searched(self):
+        nodes = map_nodes_to_buses({Bus('can0', (1, 2)): 'can0', Bus('can1', None): 'can1'}, [1, 2, 3, 4])
+
+        self.assertEqual([3, 4], nodes[Bus('can1', None)])
+        self.enumerate.assert_called_once_with('can1', [3, 4])
+
+    def test_every_bus_is_flashed_with_its_nodes(self):
+        failed = flash_buses(self.args, b'binary')
+
+        self.flash.assert_any_call('can0', b'binary', 0x1000, 'dummy', [1, 2], page_size=ANY,
+                                   erase_size=ANY, class_addressing=False, slotted_replies=False, nack_only=False,
+                                   resume=False, independent=False, sequenced=False,
+                                   asynchronous=False)
+        self.flash.assert_any_call('can1', b'binary', 0x1000, 'dummy', [3, 4], page_size=ANY,
+                                   erase_size=ANY, class_addressing=False, slotted_replies=False, nack_only=False,
+                                   resume=False, independent=False, sequenced=False,
+                                   asynchronous=False)
+        self.assertEqual(set(), failed)
+
+    def test_buses_are_flashed_concurrently(self):
+        barrier = threading.Barrier(2, timeout=5)
+        self.flash.side_effect = lambda *args, **kwargs: barrier.wait()
+
+        flash_buses(self.args, b'binary')
+
+        self.assertFalse(barrier.broken)
+
+    def test_offline_node_aborts(self):
+        self.online['can1'] = {3}
+
+        with self.assertRaises(SystemExit):
+            flash_buses(self.args, b'binary')
+
+        self.flash.assert_not_called()
+
+    @patch('logging.critical')
+    def test_aborted_bus_fails_its_nodes(self, critical):
+        def flash(conn, *args, **kwargs):
+            if conn == 'can1':
+                exit(1)
+        self.flash.side_effect = flash
+
+        self.assertEqual({3, 4}, flash_buses(self.args, b'binary'))
+
+    def test_progress_is_combined(self):
+        progress = BusProgress(['can0', 'can1'], bars_per_session=2)
+        erase = progress.factory('can0')(maxval=100).start()
+        erase.finish()
+        write = progress.factory('can0')(maxval=100).start()
+        write.update(50)
+
+        # Bus can0 is 75% done, can1 didn't start
+        progress.pbar.update.assert_called_with(int(0.375 * BUS_PROGRESS_STEPS))
+
+
+class NegotiateTransferTestCase(unittest.TestCase):
+    def setUp(self):
+        self.read = patch('cvra_bootloader.utils.read_capabilities').start()
+        patch('cvra_bootloader.utils.INTER_FRAME_DELAY', 0.004).start()
+
+    def tearDown(self):
+        patch.stopall()
+
+    def capabilities(self, input_buffer=32768, flash_page=0, rx_frames=2000):
+        return {'input_buffer': input_buffer, 'output_buffer': 8192, 'flash_page': flash_page,
+                'rx_frames': rx_frames, 'frame_delay': 4, 'commands': [], 'features': 0}
+
+    def test_largest_page_fitting_all_nodes(self):
+        self.read.return_value = {1: self.capabilities(), 2: self.capabilities(input_buffer=4096)}
+
+        page_size, erase_size, _, _, _ = negotiate_transfer('conn', [1, 2], 'dummy')
+
+        # The write command must fit besides the data
+        self.assertEqual(2048, page_size)
+        self.assertEqual(2048, erase_size)
+
+    def test_page_size_is_limited(self):
+        self.read.return_value = {1: self.capabilities()}
+
+        page_size, _, _, _, _ = negotiate_transfer('conn', [1], 'dummy')
+
+        self.assertEqual(MAX_PAGE_SIZE, page_size)
+
+    def test_given_page_size_is_used(self):
+        self.read.return_value = {1: self.capabilities()}
+
+        page_size, _, _, _, _ = negotiate_transfer('conn', [1], 'dummy', page_size=1024)
+
+        self.assertEqual(1024, page_size)
+
+    def test_erase_size_is_smallest_flash_page(self):
+        self.read.return_value = {1: self.capabilities(flash_page=1024),
+                                  2: self.capabilities(flash_page=2048)}
+
+        page_size, erase_size, _, _, _ = negotiate_transfer('conn', [1, 2], 'dummy')
+
+        self.assertEqual(1024, erase_size)
+
+    def test_buffering_nodes_need_no_frame_delay(self):
+        self.read.return_value = {1: self.capabilities()}
+
+        _, _, delay, _, _ = negotiate_transfer('conn', [1], 'dummy')
+
+        self.assertEqual(0., delay)
+
+    def test_nodes_without_rx_buffer_keep_frame_delay(self):
+        self.read.return_value = {1: self.capabilities(), 2: self.capabilities(rx_frames=3)}
+
+        _, _, delay, _, _ = negotiate_transfer('conn', [1, 2], 'dummy')
+
+        self.assertEqual(0.004, delay)
+
+    @patch('cvra_bootloader.utils.SocketCANInterface')
+    def test_small_rx_buffer_is_paced_after_socketcan_open(self, socketcan):
+        args = argparse.Namespace(can_interface='can0', serial_device=None, ids=[1])
+        utils.open_connection(args)
+        self.assertEqual(0., utils.INTER_FRAME_DELAY)
+
+        self.read.return_value = {1: self.capabilities(rx_frames=3)}
+
+        _, _, delay, _, _ = negotiate_transfer('conn', [1], 'dummy')
+
+        self.assertEqual(MAX_INTER_FRAME_DELAY, delay)
+
+    def test_defaults_without_capabilities(self):
+        self.read.return_value = {1: self.capabilities()}
+
+        page_size, erase_size, delay, _, _ = negotiate_transfer('conn', [1, 2], 'dummy')
+
+        self.assertEqual((DEFAULT_PAGE_SIZE, DEFAULT_PAGE_SIZE, 0.004), (page_size, erase_size, delay))
+
+    def test_commands_are_sequenced_if_all_nodes_support_it(self):
+        supported = self.capabilities()
+        supported['commands'] = [commands.CommandType.Sequenced]
+        self.read.return_value = {1: supported, 2: dict(supported)}
+
+        self.assertTrue(negotiate_transfer('conn', [1, 2], 'dummy').sequenced)
+
+        self.read.return_value = {1: supported, 2: self.capabilities()}
+
+        self.assertFalse(negotiate_transfer('conn', [1, 2], 'dummy').sequenced)
+
+    def test_commands_are_asynchronous_if_all_nodes_support_it(self):
+        supported = self.capabilities()
+        supported['commands'] = [commands.CommandType.SubmitAsync]
+        self.read.return_value = {1: supported, 2: dict(supported)}
+
+        self.assertTrue(negotiate_transfer('conn', [1, 2], 'dummy').asynchronous)
+
+        self.read.return_value = {1: supported, 2: self.capabilities()}
+
+        self.assertFalse(negotiate_transfer('conn', [1, 2], 'dummy').asynchronous)
+
+
+class ResumeTestCase(unittest.TestCase):
+    def setUp(self):
+        self.write_retry = patch('cvra_bootloader.utils.write_command_retry').start()
+        self.binary = bytes(range(200))
+
+    def tearDown(self):
+        patch.stopall()
+
+    def replies(self, *values):
+        return [{1: msgpack.packb(v1), 2: msgpack.packb(v2)} for v1, v2 in values]
+
+    def test_session_is_begun_for_image(self):
+        self.write_retry.side_effect = self.replies((0, 0))
+
+        self.assertEqual(0, resume_offset('port', self.binary, 0x1000, [1, 2], page_size=64))
+
+        command = encode_flash_session(0x1000, len(self.binary), crc32(self.binary))
+        self.write_retry.assert_called_once_with('port', command, [1, 2], error_exit=False)
+
+    def test_resumes_at_first_page_not_written_on_all_boards(self):
+        crc = crc32(self.binary[:64])
+        self.write_retry.side_effect = self.replies((150, 100), (crc, crc))
+
+        self.assertEqual(64, resume_offset('port', self.binary, 0x1000, [1, 2], page_size=64))
+
+        command = encode_crc_region(0x1000, 64)
+        self.write_retry.assert_called_with('port', command, [1, 2], error_exit=False)
+
+    def test_starts_over_if_written_part_does_not_match(self):
+        self.write_retry.side_effect = self.replies((128, 128), (crc32(self.binary[:128]), 0xdead))
+
+        self.assertEqual(0, resume_offset('port', self.binary, 0x1000, [1, 2], page_size=64))
+
+    def test_starts_over_without_replies(self):
+        self.write_retry.side_effect = [{1: msgpack.packb(128)}]
+
+        self.assertEqual(0, resume_offset('port', self.binary, 0x1000, [1, 2], page_size=64))
+
+
+class AsynchronousFlashTestCase(unittest.TestCase):
+    def setUp(self):
+        mock = lambda m: patch(m).start()
+        self.print = mock('builtins.print')
+        self.progressbar = mock('cvra_bootloader.bootloader_flash.ProgressBar')
+        self.write = mock('cvra_bootloader.utils.write_command')
+        self.write_retry = mock('cvra_bootloader.utils.write_command_retry')
+        self.write_async = mock('cvra_bootloader.utils.write_command_async')
+        patch('cvra_bootloader.bootloader_flash.args', argparse.Namespace(verbose=False),
+              create=True).start()
+        self.binary = bytes(range(128))
+
+    def tearDown(self):
+        patch.stopall()
+
+    def replies(self, value, destinations=(1, 2)):
+        return {id: msgpack.packb(value) for id in destinations}
+
+    def test_pages_are_erased_asynchronously(self):
+        self.write_async.return_value = self.replies(1)
+        self.write_retry.return_value = self.replies(1)
+
+        flash_image('port', self.binary, 0x1000, 'dummy', [1, 2], page_size=64, asynchronous=True)
+
+        for address in (0x1000, 0x1040):
+            command = encode_erase_flash_page(address, 'dummy')
+            self.write_async.assert_any_call('port', command, [1, 2])
+        self.write_async.assert_called_with('port', encode_save_config(), [1, 2])
+
+        erases = [c for c in self.write_retry.call_args_list
+                  if c[0][1] == encode_erase_flash_page(0x1000, 'dummy')]
+        self.assertEqual([], erases)
+
+    def test_checksum_is_calculated_asynchronously(self):
+        self.write_async.return_value = {1: msgpack.packb(crc32(self.binary)),
+                                         2: msgpack.packb(0xdead)}
+
+        valid_nodes = verify_flash_write('port', self.binary, 0x1000, [1, 2], asynchronous=True)
+
+        self.assertEqual([1], valid_nodes)
+        self.write_async.assert_called_once_with('port', encode_crc_region(0x1000, 128), [1, 2])
+        self.write.assert_not_called()
+
+
 class RunApplicationTestCase(unittest.TestCase):
     fd = 'port'
 
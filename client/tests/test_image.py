@@ -0,0 +1,98 @@
+import unittest
+import struct
+
+from cvra_bootloader.image import *
+
+
+def make_elf(segments):
+    """
+    Builds a minimal little endian 32 bit ELF file with the given
+    (type, physical address, data, memory size) program headers.
+    """
+    header_size, phentsize = 52, 32
+    offset = header_size + phentsize * len(segments)
+
+    headers, contents = b'', b''
+    for p_type, paddr, data, memsz in segments:
+        headers += struct.pack('<8I', p_type, offset + len(contents), paddr + 0x10000000,
+                               paddr, len(data), memsz, 5, 4)
+        contents += data
+
+    ident = ELF_MAGIC + bytes([ELF_CLASS_32, ELF_DATA_LITTLE_ENDIAN, 1]) + bytes(9)
+    header = ident + struct.pack('<HHIIIIIHHHHHH', 2, 40, 1, 0, header_size, 0, 0,
+                                 header_size, phentsize, len(segments), 40, 0, 0)
+    return header + headers + contents
+
+
+def hex_record(record_type, address, payload):
+    record = bytes([len(payload)]) + struct.pack('>HB', address, record_type) + payload
+    return ':' + (record + bytes([-sum(record) & 0xff])).hex().upper()
+
+
+class ELFTestCase(unittest.TestCase):
+    def test_load_segments_at_physical_address(self):
+        elf = make_elf([(ELF_PT_LOAD, 0x08003800, b'text', 4),
+                        (ELF_PT_LOAD, 0x08003804, b'data', 4)])
+
+        self.assertEqual([(0x08003800, b'text'), (0x08003804, b'data')], read_elf(elf))
+
+    def test_segments_without_content_are_skipped(self):
+        elf = make_elf([(ELF_PT_LOAD, 0x08003800, b'text', 4),
+                        (ELF_PT_LOAD, 0x20000000, b'', 0x100),
+                        (6, 0x08003800, b'phdr', 4)])
+
+        self.assertEqual([(0x08003800, b'text')], read_elf(elf))
+
+    def test_other_files_are_rejected(self):
+        with self.assertRaises(ImageFormatError):
+            read_elf(b'\x00' * 64)
+
+
+class IntelHexTestCase(unittest.TestCase):
+    def test_data_records(self):
+        text = "\n".join([hex_record(HEX_DATA, 0x0000, b'abcd'),
+                          hex_record(HEX_DATA, 0x0004, b'ef'),
+                          hex_record(HEX_END_OF_FILE, 0, b'')])
+
+        self.assertEqual([(0, b'abcd'), (4, b'ef')], read_intel_hex(text))
+
+    def test_extended_linear_address(self):
+        text = "\n".join([hex_record(HEX_EXTENDED_LINEAR_ADDRESS, 0, b'\x08\x00'),
+                          hex_record(HEX_DATA, 0x3800, b'abcd')])
+
+        self.assertEqual([(0x08003800, b'abcd')], read_intel_hex(text))
+
+    def test_extended_segment_address(self):
+        text = "\n".join([hex_record(HEX_EXTENDED_SEGMENT_ADDRESS, 0, b'\x10\x00'),
+                          hex_record(HEX_DATA, 0x0010, b'abcd')])
+
+        self.assertEqual([(0x10010, b'abcd')], read_intel_hex(text))
+
+    def test_records_after_end_of_file_are_ignored(self):
+        text = "\n".join([hex_record(HEX_END_OF_FILE, 0, b''),
+                          hex_record(HEX_DATA, 0, b'abcd')])
+
+        self.assertEqual([], read_intel_hex(text))
+
+    def test_checksum_mismatch_is_rejected(self):
+        record = hex_record(HEX_DATA, 0, b'abcd')
+        record = record[:-2] + '00'
+
+        with self.assertRaises(ImageFormatError):
+            read_intel_hex(record)
+
+
+class FlattenTestCase(unittest.TestCase):
+    def test_gaps_are_erased(self):
+        address, binary = flatten([(0x1008, b'cd'), (0x1000, b'ab')])
+
+        self.assertEqual(0x1000, address)
+        self.assertEqual(b'ab' + b'\xff' * 6 + b'cd', binary)
+
+    def test_empty_image_is_rejected(self):
+        with self.assertRaises(ImageFormatError):
+            flatten([])
+
+    def test_erased_data(self):
+        self.assertTrue(is_erased(b'\xff' * 16))
+        self.assertFalse(is_erased(b'\xff' * 15 + b'\x00'))
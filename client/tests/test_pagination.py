@@ -23,3 +23,12 @@ class PaginationTestCase(unittest.TestCase):
         self.assertEqual(next(p), bytes(range(12, 16)))
         self.assertEqual(next(p), bytes([16]))
 
+    def test_pages_do_not_copy_data(self):
+        """
+        Tests that the pages are views of the data.
+        """
+        b = bytearray(range(16))
+        p = list(slice_into_pages(b, page_size=4))
+        b[5] = 0xff
+
+        self.assertEqual(p[1][1], 0xff)
@@ -0,0 +1,77 @@
+import unittest
+
+try:
+    from unittest.mock import *
+except ImportError:
+    from mock import *
+
+from msgpack import *
+
+from cvra_bootloader.read_stats import main, format_stats, format_boot_trace
+from cvra_bootloader.commands import *
+import sys
+
+
+class ReadStatsToolTestCase(unittest.TestCase):
+    def test_format_converts_cycles_to_microseconds(self):
+        stats = {"frequency": 1000000,
+                 "stats": [[CommandType.Write, 4, 3, 10, 20, 30]]}
+
+        lines = format_stats(stats).splitlines()
+
+        self.assertEqual(2, len(lines))
+        self.assertEqual(["Write", "flash", "write", "3", "10.0", "20.0", "30.0"],
+                         lines[1].split())
+
+    def test_format_reports_missing_cycle_counter(self):
+        stats = {"frequency": None,
+                 "stats": [[CommandType.Write, 4, 3, 0, 0, 0]]}
+
+        self.assertIn("unavailable", format_stats(stats))
+
+    @patch('cvra_bootloader.utils.request_retry', new_callable=AsyncMock)
+    @patch('cvra_bootloader.utils.open_transport')
+    @patch('builtins.print')
+    def test_integration(self, print_mock, open_transport, request_retry):
+        sys.argv = "test.py -p /dev/ttyUSB0 --reset 1 2".split()
+        stats = {"frequency": 1000000, "stats": []}
+
+        request_retry.return_value = {
+            i: packb(stats, use_bin_type=True) for i in (1, 2)
+        }
+
+        main()
+
+        request_retry.assert_any_call(open_transport.return_value,
+                                      encode_get_stats(True), [1, 2])
+        print_mock.assert_any_call("Board 2:")
+        print_mock.assert_any_call(format_stats(stats))
+
+    def test_boot_trace_durations(self):
+        trace = {"frequency": 1000000,
+                 "trace": [[0, 100], [1, 350], [2, 400]]}
+
+        lines = format_boot_trace(trace).splitlines()
+
+        self.assertEqual(["reset", "0.0", "100.0"], lines[1].split())
+        self.assertEqual(["clock", "250.0", "350.0"], lines[2].split())
+        self.assertEqual(["can", "init", "50.0", "400.0"], lines[3].split())
+
+    def test_boot_trace_reports_missing_cycle_counter(self):
+        trace = {"frequency": None, "trace": [[0, 0], [1, 0]]}
+
+        self.assertIn("unavailable", format_boot_trace(trace))
+
+    @patch('cvra_bootloader.utils.request_retry', new_callable=AsyncMock)
+    @patch('cvra_bootloader.utils.open_transport')
+    @patch('builtins.print')
+    def test_boot_trace_is_requested(self, print_mock, open_transport, request_retry):
+        sys.argv = "test.py -p /dev/ttyUSB0 --boot-trace 1".split()
+        trace = {"frequency": 1000000, "trace": [[0, 1]]}
+        request_retry.return_value = {1: packb(trace, use_bin_type=True)}
+
+        main()
+
+        request_retry.assert_any_call(open_transport.return_value,
+                                      encode_get_boot_trace(), [1])
+        print_mock.assert_any_call(format_boot_trace(trace))
@@ -0,0 +1,120 @@
+import unittest
+from unittest.mock import patch
+
+from tests.simulator import BusSimulation, NodeModel
+from cvra_bootloader import utils
+
+
+class SlottedReplySimulationTestCase(unittest.TestCase):
+    """
+    Compares immediate and slotted multicast replies on a simulated bus.
+    """
+    nodes = list(range(1, 31))
+
+    def setUp(self):
+        self.bus = BusSimulation()
+
+    def immediate(self, nodes):
+        return self.bus.replies({node: 0.0 for node in nodes})
+
+    def slotted(self, nodes):
+        return self.bus.replies({node: slot * utils.REPLY_SLOT_DURATION
+                                 for slot, node in enumerate(nodes)})
+
+    def test_few_immediate_replies_are_received(self):
+        result = self.immediate([1, 2])
+        self.assertEqual({1, 2}, result.received)
+
+    def test_immediate_replies_overflow_adapter(self):
+        result = self.immediate(self.nodes)
+        self.assertGreater(result.arbitration_losses, 0)
+        self.assertGreater(result.dropped_frames, 0)
+
+    def test_slotted_replies_do_not_collide(self):
+        result = self.slotted(self.nodes)
+        self.assertEqual(0, result.arbitration_losses)
+        self.assertEqual(0, result.dropped_frames)
+        self.assertEqual(set(self.nodes), result.received)
+
+    def test_slotted_reply_window_is_deterministic(self):
+        result = self.slotted(self.nodes)
+        self.assertLess(result.duration, len(self.nodes) * utils.REPLY_SLOT_DURATION)
+
+    def test_slotted_command_completes_faster(self):
+        immediate = self.bus.command(self.nodes, slotted=False)
+        slotted = self.bus.command(self.nodes, slotted=True)
+
+        self.assertGreater(immediate.rounds, 1)
+        self.assertEqual(1, slotted.rounds)
+        self.assertLess(slotted.duration, immediate.duration)
+        self.assertLess(slotted.bus_time, immediate.bus_time)
+
+
+class NackOnlySimulationTestCase(unittest.TestCase):
+    """
+    Compares acknowledged and NACK-only writes of 32 pages on a simulated bus.
+    """
+    pages = 32
+
+    def setUp(self):
+        self.bus = BusSimulation()
+
+    def flash(self, node_count, nack_only, slotted=False):
+        return self.bus.flash(list(range(1, node_count + 1)), self.pages, nack_only, slotted)
+
+    def test_nack_only_waits_less_for_replies(self):
+        acknowledged = self.flash(30, nack_only=False)
+        nack_only = self.flash(30, nack_only=True)
+
+        self.assertLess(nack_only.reply_time, acknowledged.reply_time / 10)
+        self.assertLess(nack_only.duration, acknowledged.duration)
+
+    def test_nack_only_duration_barely_grows_with_node_count(self):
+        single = self.flash(1, nack_only=True, slotted=True)
+        many = self.flash(60, nack_only=True, slotted=True)
+
+        # Only the checkpoint replies grow, by one reply slot per node
+        self.assertLess(many.duration, 1.05 * single.duration)
+
+
+@patch('cvra_bootloader.utils.INTER_FRAME_DELAY', 0.0)
+class IndependentSessionSimulationTestCase(unittest.TestCase):
+    """
+    Compares lockstep and per node scheduled flash sessions of 32 pages on a simulated bus.
+    """
+    pages = 32
+
+    def setUp(self):
+        self.bus = BusSimulation()
+
+    def session(self, fleet, independent):
+        return self.bus.flash_session(fleet, self.pages, independent)
+
+    def mixed_fleet(self):
+        # Nodes with small, fast erasing pages, nodes with slowly erased sectors and a flaky node
+        fleet = {id: NodeModel(0.02, 0.05, 0.03, 0.) for id in range(1, 9)}
+        fleet.update({id: NodeModel(0.25, 0.015, 0.01, 0.) for id in range(9, 11)})
+        fleet[11] = NodeModel(0.02, 0.05, 0.03, 0.05)
+        return fleet
+
+    def test_mixed_fleet_completes_faster(self):
+        lockstep = self.session(self.mixed_fleet(), independent=False)
+        independent = self.session(self.mixed_fleet(), independent=True)
+
+        self.assertLess(independent.duration, 0.8 * lockstep.duration)
+
+    def test_fast_nodes_do_not_wait_for_slow_nodes(self):
+        independent = self.session(self.mixed_fleet(), independent=True)
+
+        fast = max(independent.finish_times[id] for id in range(1, 9))
+        slow = min(independent.finish_times[id] for id in range(9, 11))
+        self.assertLess(fast, slow)
+
+    def test_identical_nodes_share_commands(self):
+        fleet = {id: NodeModel(0.02, 0.05, 0.03, 0.) for id in range(1, 12)}
+
+        lockstep = self.session(fleet, independent=False)
+        independent = self.session(fleet, independent=True)
+
+        self.assertEqual(lockstep.commands, independent.commands)
+        self.assertAlmostEqual(lockstep.duration, independent.duration)
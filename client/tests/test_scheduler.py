@@ -0,0 +1,89 @@
+import unittest
+
+from cvra_bootloader.scheduler import *
+
+
+class FlashSchedulerTestCase(unittest.TestCase):
+    def setUp(self):
+        self.scheduler = FlashScheduler([1, 2, 3], erase_offsets=[0, 100], write_offsets=[0, 100])
+
+    def test_nodes_in_same_state_share_request(self):
+        requests = self.scheduler.next_requests()
+
+        self.assertEqual([Request(ERASE, 0, (1, 2, 3))], requests)
+
+    def test_busy_nodes_are_not_scheduled(self):
+        self.scheduler.next_requests()
+
+        self.assertEqual([], self.scheduler.next_requests())
+
+    def test_steps_in_order(self):
+        steps = []
+        while not self.scheduler.done():
+            for request in self.scheduler.next_requests():
+                steps.append((request.step, request.offset))
+                self.scheduler.completed(request, request.nodes)
+
+        self.assertEqual([(ERASE, 0), (ERASE, 100), (WRITE, 0), (WRITE, 100), (VERIFY, 0)], steps)
+        self.assertEqual(set(), self.scheduler.failed())
+        self.assertEqual(1., self.scheduler.progress())
+
+    def test_lagging_node_drops_out_of_cohort(self):
+        request, = self.scheduler.next_requests()
+        self.scheduler.completed(request, succeeded=[1, 2])
+
+        requests = self.scheduler.next_requests()
+
+        self.assertEqual([Request(ERASE, 100, (1, 2)), Request(ERASE, 0, (3,))], requests)
+
+    def test_node_rejoins_cohort_in_same_state(self):
+        request, = self.scheduler.next_requests()
+        self.scheduler.completed(request, succeeded=[1, 2])
+        ahead, behind = self.scheduler.next_requests()
+        self.scheduler.completed(behind, succeeded=[3])
+
+        # Node 3 waits for the same step as the busy nodes, but doesn't wait for them
+        self.assertEqual([Request(ERASE, 100, (3,))], self.scheduler.next_requests())
+
+        self.scheduler.completed(ahead, succeeded=[])
+        self.scheduler.completed(Request(ERASE, 100, (3,)), succeeded=[])
+        self.assertEqual([Request(ERASE, 100, (1, 2, 3))], self.scheduler.next_requests())
+
+    def test_fatal_error_gives_node_up(self):
+        request, = self.scheduler.next_requests()
+        self.scheduler.completed(request, succeeded=[1, 2], fatal=[3])
+
+        self.assertEqual({3}, self.scheduler.failed())
+        self.assertEqual([Request(ERASE, 100, (1, 2))], self.scheduler.next_requests())
+
+    def test_node_is_given_up_after_max_attempts(self):
+        scheduler = FlashScheduler([1], [0], [0], max_attempts=2)
+
+        for _ in range(2):
+            request, = scheduler.next_requests()
+            scheduler.completed(request, succeeded=[])
+
+        self.assertEqual({1}, scheduler.failed())
+        self.assertTrue(scheduler.done())
+
+    def test_attempts_are_counted_per_step(self):
+        scheduler = FlashScheduler([1], [0, 100], [], verify=False, max_attempts=2)
+
+        request, = scheduler.next_requests()
+        scheduler.completed(request, succeeded=[])
+        request, = scheduler.next_requests()
+        scheduler.completed(request, succeeded=[1])
+        request, = scheduler.next_requests()
+        scheduler.completed(request, succeeded=[])
+
+        self.assertEqual(set(), scheduler.failed())
+        self.assertFalse(scheduler.done())
+
+    def test_partial_completion_keeps_other_nodes_busy(self):
+        request, = self.scheduler.next_requests()
+        self.scheduler.completed(request, succeeded=[1, 2], nodes=[1, 2])
+
+        self.assertEqual([Request(ERASE, 100, (1, 2))], self.scheduler.next_requests())
+
+        self.scheduler.completed(request, succeeded=[3], nodes=[3])
+        self.assertEqual([Request(ERASE, 100, (3,))], self.scheduler.next_requests())
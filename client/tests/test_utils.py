@@ -5,10 +5,13 @@ except ImportError:
     from mock import *
 
 from cvra_bootloader.utils import *
+from cvra_bootloader import utils
 from itertools import repeat
+import asyncio
 from collections import namedtuple
 
 from cvra_bootloader import commands
+from cvra_bootloader.error import Error
 import msgpack
 
 @patch('cvra_bootloader.utils.read_can_datagrams')
@@ -54,6 +57,193 @@ class WriteCommandTestCase(unittest.TestCase):
         for f in frames:
             fdesc.send_frame.assert_any_call(f)
 
+    @patch('cvra_bootloader.utils.INTER_FRAME_DELAY', 0.0)
+    def test_write_without_delay_sends_batch(self, sleep):
+        data = bytes(range(3))
+        dst = [1, 2]
+        datagram = can.encode_datagram(data, dst)
+        frames = list(can.datagram_to_frames(datagram, 0))
+
+        fdesc = Mock()
+        write_command(fdesc, data, dst)
+
+        fdesc.send_frames.assert_called_once_with(frames)
+        fdesc.send_frame.assert_not_called()
+        sleep.assert_not_called()
+
+class DatagramCacheTestCase(unittest.TestCase):
+    def setUp(self):
+        self.cache = DatagramCache(size=2)
+        self.command = commands.encode_ping()
+
+    def test_frames_match_datagram(self):
+        frames = self.cache.frames(self.command, [1, 2], source=3)
+
+        datagram = can.encode_datagram(self.command, [1, 2])
+        self.assertEqual(list(can.datagram_to_frames(datagram, 3)), frames)
+
+    def test_frames_are_reused(self):
+        frames = self.cache.frames(self.command, [1, 2])
+
+        self.assertIs(frames, self.cache.frames(self.command, [1, 2]))
+
+    def test_other_destinations_are_encoded(self):
+        frames = self.cache.frames(self.command, [1, 2])
+
+        self.assertNotEqual(frames, self.cache.frames(self.command, [1, 3]))
+
+    def test_least_recently_used_datagram_is_evicted(self):
+        frames = self.cache.frames(self.command, [1])
+        self.cache.frames(self.command, [2])
+        self.cache.frames(self.command, [1])
+        self.cache.frames(self.command, [3])
+
+        self.assertIs(frames, self.cache.frames(self.command, [1]))
+        self.assertEqual(2, len(self.cache.entries))
+
+
+class PrefetchTestCase(unittest.TestCase):
+    def test_items_are_yielded_in_order(self):
+        self.assertEqual(list(range(100)), list(prefetch(range(100), depth=2)))
+
+    def test_errors_are_raised_in_consumer(self):
+        def failing():
+            yield 1
+            raise ValueError
+
+        items = prefetch(failing())
+        self.assertEqual(1, next(items))
+        with self.assertRaises(ValueError):
+            next(items)
+
+
+class RetransmissionTimerTestCase(unittest.TestCase):
+    def setUp(self):
+        self.timer = RetransmissionTimer(initial=3., minimum=0.02, maximum=10.)
+        self.command = commands.encode_ping()
+
+    def test_initial_timeout(self):
+        self.assertEqual(3., self.timer.rto(1, command_type(self.command)))
+
+    def test_first_sample(self):
+        self.timer.sample(1, 'ping', 0.1)
+
+        # rto = srtt + 4 * rttvar = rtt + 4 * rtt / 2
+        self.assertAlmostEqual(0.3, self.timer.rto(1, 'ping'))
+
+    def test_command_types_are_estimated_separately(self):
+        self.timer.sample(1, 'ping', 0.1)
+
+        self.assertEqual(3., self.timer.rto(1, 'erase'))
+        self.assertEqual(3., self.timer.rto(2, 'ping'))
+
+    def test_steady_round_trip_converges(self):
+        for _ in range(50):
+            self.timer.sample(1, 'ping', 0.1)
+
+        self.assertAlmostEqual(0.1, self.timer.rto(1, 'ping'), places=2)
+
+    def test_timeout_is_bounded(self):
+        self.timer.sample(1, 'ping', 0.)
+        self.timer.sample(2, 'ping', 100.)
+
+        self.assertEqual(0.02, self.timer.rto(1, 'ping'))
+        self.assertEqual(10., self.timer.rto(2, 'ping'))
+
+    def test_loss_doubles_timeout(self):
+        self.timer.sample(1, 'ping', 0.1)
+        self.timer.lost([1], 'ping')
+
+        self.assertAlmostEqual(0.6, self.timer.rto(1, 'ping'))
+
+    def test_sample_after_loss_without_previous_sample(self):
+        self.timer.lost([1], 'ping')
+        self.assertEqual(6., self.timer.rto(1, 'ping'))
+
+        self.timer.sample(1, 'ping', 0.1)
+        self.assertAlmostEqual(0.3, self.timer.rto(1, 'ping'))
+
+    def test_timeout_of_several_nodes_is_the_longest(self):
+        kind = command_type(self.command)
+        self.timer.sample(1, kind, 0.1)
+        self.timer.sample(2, kind, 0.2)
+
+        timeout = self.timer.timeout([1, 2], self.command)
+        self.assertGreater(timeout, 0.6)
+        self.assertLess(timeout, 0.7)
+
+    def test_sequenced_command_has_type_of_wrapped_command(self):
+        self.assertEqual(commands.CommandType.Ping,
+                         command_type(commands.encode_sequenced(42, self.command)))
+
+    def test_unsequenced_write_waits_at_least_the_floor(self):
+        timer = RetransmissionTimer(initial=3., minimum=0.02, unsequenced_minimum=1.)
+        write = commands.encode_write_flash(bytes(8), 0x1000, 'dummy')
+        timer.sample(1, commands.CommandType.Write, 0.01)
+
+        self.assertGreaterEqual(timer.timeout([1], write), 1.)
+
+    def test_sequenced_write_uses_estimated_timeout(self):
+        timer = RetransmissionTimer(initial=3., minimum=0.02, unsequenced_minimum=1.)
+        write = commands.encode_sequenced(42, commands.encode_write_flash(bytes(8), 0x1000, 'dummy'))
+        timer.sample(1, commands.CommandType.Write, 0.01)
+
+        self.assertLess(timer.timeout([1], write), 1.)
+
+    def test_timeout_scales_with_payload(self):
+        short = self.timer.timeout([1], bytes(8))
+        long = self.timer.timeout([1], bytes(2048))
+
+        self.assertGreater(long, short)
+
+    def test_slotted_replies_extend_timeout(self):
+        timeout = self.timer.timeout([1, 2], self.command)
+        slotted = self.timer.timeout([1, 2], self.command, flags=can.FLAG_SLOTTED_REPLY)
+
+        self.assertAlmostEqual(2 * REPLY_SLOT_DURATION, slotted - timeout)
+
+    def test_loss_rate(self):
+        self.timer.sent([1, 2])
+        self.timer.sent([1])
+        self.timer.lost([1], 'ping')
+
+        self.assertEqual(0.5, self.timer.loss_rate(1))
+        self.assertEqual(0., self.timer.loss_rate(2))
+        self.assertEqual(0., self.timer.loss_rate(3))
+
+
+@patch('logging.warning')
+@patch('cvra_bootloader.utils.INTER_FRAME_DELAY', 0.0)
+class AdaptPacingTestCase(unittest.TestCase):
+    def setUp(self):
+        self.timer = RetransmissionTimer()
+
+    def test_no_pacing_without_losses(self, warning):
+        self.timer.sent(range(PACING_WINDOW))
+
+        self.assertFalse(adapt_pacing(self.timer))
+        self.assertEqual(0.0, utils.INTER_FRAME_DELAY)
+
+    def test_no_pacing_before_window_is_full(self, warning):
+        self.timer.sent(range(PACING_WINDOW - 1))
+        self.timer.lost(range(PACING_WINDOW - 1), 'ping')
+
+        self.assertFalse(adapt_pacing(self.timer))
+
+    def test_losses_start_pacing(self, warning):
+        self.timer.sent(range(PACING_WINDOW))
+        self.timer.lost([1, 2], 'ping')
+
+        self.assertTrue(adapt_pacing(self.timer))
+        self.assertEqual(PACING_STEP, utils.INTER_FRAME_DELAY)
+
+    def test_pacing_is_doubled_up_to_maximum(self, warning):
+        for _ in range(10):
+            self.timer.sent(range(PACING_WINDOW))
+            self.timer.lost(range(PACING_WINDOW), 'ping')
+            adapt_pacing(self.timer)
+
+        self.assertEqual(MAX_INTER_FRAME_DELAY, utils.INTER_FRAME_DELAY)
 
 
 @patch('cvra_bootloader.utils.read_can_datagrams')
@@ -83,6 +273,94 @@ class CommandRetryTestCase(unittest.TestCase):
         write.assert_any_call(None, data, [1, 2], 0)
         write.assert_any_call(None, data, [1], 0)
 
+    def test_group_is_addressed_first(self, write, read):
+        """
+        Checks that only the first transmission is sent to the group.
+        """
+        port = Mock()
+        port.rx_queue.empty.return_value = True
+        group = can.DeviceClassDestination("dummy")
+        read.return_value = iter([(20, [10], 2), None, (10, [10], 1)])
+
+        with patch('logging.warning'):
+            write_command_retry(port, "full", [1, 2], group=group, group_command="short")
+
+        write.assert_any_call(port, "short", group, 0, 0)
+        write.assert_any_call(port, "full", [1], 0, 0)
+
+    def make_port(self):
+        port = Mock()
+        port.rx_queue.empty.return_value = True
+        return port
+
+    def test_reader_waits_for_retransmission_timeout(self, write, read):
+        timer = RetransmissionTimer(initial=0.5)
+        read.return_value = iter([(10, [10], 1)])
+
+        write_command_retry(self.make_port(), bytes(4), [1], timer=timer)
+
+        timeout = read.call_args[1]['timeout']
+        self.assertAlmostEqual(0.5, timeout(), places=1)
+
+    def test_replies_are_sampled(self, write, read):
+        timer = RetransmissionTimer(initial=3.)
+        read.return_value = iter([(10, [10], 1)])
+
+        write_command_retry(self.make_port(), bytes(4), [1], timer=timer)
+
+        self.assertLess(timer.rto(1, 0), 3.)
+
+    @patch('cvra_bootloader.utils.sleep')
+    def test_retransmitted_replies_are_not_sampled(self, sleep, write, read):
+        timer = RetransmissionTimer(initial=3.)
+        read.return_value = iter([None, (10, [10], 1)])
+
+        with patch('logging.warning'):
+            write_command_retry(self.make_port(), bytes(4), [1], timer=timer)
+
+        self.assertEqual(6., timer.rto(1, 0))
+        self.assertEqual(0.5, timer.loss_rate(1))
+
+    @patch('cvra_bootloader.utils.next_token')
+    @patch('cvra_bootloader.utils.sleep')
+    def test_sequenced_retries_carry_same_token(self, sleep, token, write, read):
+        token.return_value = 42
+        port = self.make_port()
+        command = commands.encode_ping()
+        read.return_value = iter([None, (10, [10], 1)])
+
+        with patch('logging.warning'):
+            write_command_retry(port, command, [1], sequenced=True)
+
+        sequenced = commands.encode_sequenced(42, command)
+        self.assertEqual([call(port, sequenced, [1], 0, 0)] * 2, write.call_args_list)
+
+    def test_datagrams_of_other_sources_are_ignored(self, write, read):
+        """
+        Checks that the commands of other clients are not taken for replies.
+        """
+        read.return_value = iter([(b'foo', [1], 0x78), (10, [0], 1)])
+
+        res = write_command_retry(self.make_port(), bytes(4), [1])
+        self.assertEqual({1: 10}, res)
+
+    def test_reply_from_changed_id_is_accepted(self, write, read):
+        """
+        Checks that a node answering from its new ID after an ID change is not ignored.
+        """
+        read.return_value = iter([(10, [0], 5)])
+
+        res = write_command_retry(self.make_port(), bytes(4), [1])
+        self.assertEqual({5: 10}, res)
+
+    @patch('cvra_bootloader.utils.SOURCE_ID', 0x79)
+    def test_commands_are_sent_from_source_id(self, write, read):
+        port = self.make_port()
+        read.return_value = iter([(10, [0x79], 1)])
+
+        write_command_retry(port, bytes(4), [1])
+        write.assert_any_call(port, bytes(4), [1], 0x79, 0)
+
     def test_retry_limit(self, write, read):
         """
         Check that the retry limit is enforced.
@@ -100,6 +378,80 @@ class CommandRetryTestCase(unittest.TestCase):
             critical.assert_any_call(ANY)
 
 
+@patch('cvra_bootloader.utils.retry_delay', return_value=0.)
+class RequestRetryTestCase(unittest.TestCase):
+    def setUp(self):
+        self.transport = Mock()
+        self.transport.request = AsyncMock()
+        self.timer = RetransmissionTimer(initial=0.5)
+
+    def request(self, *args, **kwargs):
+        return asyncio.run(request_retry(self.transport, *args, timer=self.timer, **kwargs))
+
+    def test_answers_are_returned(self, delay):
+        self.transport.request.return_value = {1: b'a', 2: b'b'}
+
+        self.assertEqual({1: b'a', 2: b'b'}, self.request(b'cmd', [1, 2]))
+        self.transport.request.assert_called_once_with(b'cmd', [1, 2], timeout=ANY, sources=None)
+
+    def test_silent_nodes_are_retried(self, delay):
+        self.transport.request.side_effect = [{1: b'a'}, {2: b'b'}]
+
+        self.assertEqual({1: b'a', 2: b'b'}, self.request(b'cmd', [1, 2]))
+        self.transport.request.assert_called_with(b'cmd', [2], timeout=ANY, sources=None)
+        self.assertEqual(1, self.timer.losses[2])
+
+    def test_deadline_is_retransmission_timeout(self, delay):
+        self.transport.request.return_value = {1: b'a'}
+
+        self.request(b'cmd', [1])
+
+        timeout = self.transport.request.call_args[1]['timeout']
+        self.assertAlmostEqual(self.timer.timeout([1], b'cmd'), timeout)
+
+    def test_retry_limit(self, delay):
+        self.transport.request.return_value = {}
+
+        self.assertEqual({}, self.request(b'cmd', [1], retry_limit=2))
+        self.assertEqual(3, self.transport.request.call_count)
+
+    def test_sources_are_awaited_instead_of_destinations(self, delay):
+        self.transport.request.side_effect = [{}, {5: b'a'}]
+
+        self.assertEqual({5: b'a'}, self.request(b'cmd', [1], sources=[5]))
+        self.transport.request.assert_called_with(b'cmd', [1], timeout=ANY, sources=[5])
+
+
+@patch('cvra_bootloader.utils.write_command_retry')
+class ReadCapabilitiesTestCase(unittest.TestCase):
+    def test_command_is_sent(self, write):
+        write.return_value = {}
+
+        read_capabilities('port', [1, 2])
+
+        write.assert_any_call('port', commands.encode_get_capabilities(), [1, 2], error_exit=False)
+
+    def test_maps_are_returned(self, write):
+        write.return_value = {1: msgpack.packb({'input_buffer': 4096}),
+                              2: msgpack.packb(Error.COMMAND_NOT_FOUND)}
+
+        self.assertEqual({1: {'input_buffer': 4096}}, read_capabilities('port', [1, 2]))
+
+    def test_command_is_supported_if_listed_by_all_nodes(self, write):
+        supported = msgpack.packb({'commands': [commands.CommandType.SubmitAsync]})
+        write.return_value = {1: supported, 2: supported}
+
+        self.assertTrue(supports_command('port', [1, 2], commands.CommandType.SubmitAsync))
+
+        write.return_value = {1: supported, 2: msgpack.packb({'commands': []})}
+
+        self.assertFalse(supports_command('port', [1, 2], commands.CommandType.SubmitAsync))
+
+        write.return_value = {1: supported, 2: msgpack.packb(Error.COMMAND_NOT_FOUND)}
+
+        self.assertFalse(supports_command('port', [1, 2], commands.CommandType.SubmitAsync))
+
+
 class OpenConnectionTestCase(unittest.TestCase):
     Args = namedtuple("Args", ["serial_device", "can_interface"])
 
@@ -124,3 +476,84 @@ class ArgumentParserTestCase(unittest.TestCase):
 
         self.assertEqual('can0', args.can_interface)
 
+    def test_multiple_buses(self):
+        parser = ConnectionArgumentParser(multiple_buses=True)
+        args = parser.parse_args("--bus can0 --bus /dev/ttyUSB0=1,4-6".split())
+
+        self.assertEqual([Bus('can0', None), Bus('/dev/ttyUSB0', (1, 4, 5, 6))], args.buses)
+
+    def test_bus_and_single_interface_are_exclusive(self):
+        parser = ConnectionArgumentParser(multiple_buses=True)
+
+        with patch('argparse.ArgumentParser.error') as error:
+            parser.parse_args("-i can0 --bus can1".split())
+            error.assert_any_call(ANY)
+
+
+class BusArgsTestCase(unittest.TestCase):
+    def setUp(self):
+        self.args = argparse.Namespace(serial_device=None, can_interface=None, ids=[1, 2, 3])
+
+    def test_can_interface(self):
+        args = bus_args(self.args, Bus('can1', (2,)))
+
+        self.assertEqual('can1', args.can_interface)
+        self.assertIsNone(args.serial_device)
+        self.assertEqual([2], args.ids)
+
+    def test_serial_port(self):
+        args = bus_args(self.args, Bus('/dev/ttyUSB0', None))
+
+        self.assertEqual('/dev/ttyUSB0', args.serial_device)
+        self.assertIsNone(args.can_interface)
+        self.assertEqual([1, 2, 3], args.ids)
+
+    def test_original_args_are_unchanged(self):
+        bus_args(self.args, Bus('can1', (2,)))
+
+        self.assertIsNone(self.args.can_interface)
+
+
+
+@patch('cvra_bootloader.utils.sleep')
+@patch('cvra_bootloader.utils.next_token')
+@patch('cvra_bootloader.utils.write_command_retry')
+class WriteCommandAsyncTestCase(unittest.TestCase):
+    def test_command_is_submitted_with_token(self, write, token, sleep):
+        token.return_value = 42
+        write.side_effect = [
+            {1: msgpack.packb(commands.JobState.QUEUED)},
+            {1: msgpack.packb([42, commands.JobState.DONE, True])},
+        ]
+
+        write_command_async(None, b'foo', [1])
+
+        write.assert_any_call(None, commands.encode_submit_async(42, b'foo'), [1], 0)
+        write.assert_any_call(None, commands.encode_get_status(42), [1], 0,
+                              error_exit=False)
+
+    def test_polls_until_done(self, write, token, sleep):
+        token.return_value = 42
+        write.side_effect = [
+            {1: msgpack.packb(commands.JobState.QUEUED),
+             2: msgpack.packb(commands.JobState.QUEUED)},
+            {1: msgpack.packb([42, commands.JobState.DONE, 12]),
+             2: msgpack.packb([42, commands.JobState.RUNNING, None])},
+            {2: msgpack.packb([42, commands.JobState.DONE, 13])},
+        ]
+
+        res = write_command_async(None, b'foo', [1, 2])
+
+        self.assertEqual({1: msgpack.packb(12), 2: msgpack.packb(13)}, res)
+        self.assertEqual(3, write.call_count)
+
+    def test_rejected_command_is_not_polled(self, write, token, sleep):
+        token.return_value = 42
+        write.side_effect = [
+            {1: msgpack.packb(Error.ASYNC_ERROR_QUEUE_FULL)},
+        ]
+
+        res = write_command_async(None, b'foo', [1])
+
+        self.assertEqual({}, res)
+        self.assertEqual(1, write.call_count)
@@ -4,9 +4,15 @@
 #include <platform.h>
 #include "flash_writer.h"
 #include "boot_arg.h"
+#include "boot_trace.h"
 #include "config.h"
+#include "config_storage.h"
 #include "command.h"
 #include "error.h"
+#include "cycle_counter.h"
+#include "profiling.h"
+#include "command_queue.h"
+#include "can_datagram.h"
 
 
 /**
@@ -28,9 +34,210 @@ command_t commands[COMMAND_COUNT] = {
     {.index = 8, .callback = command_config_write_to_flash},
     {.index = 9, .callback = command_config_read},
     {.index = 10, .callback = command_get_status},
+    {.index = 11, .callback = command_get_profiling_stats},
+    {.index = 12, .callback = command_submit_async},
+    {.index = 13, .callback = command_get_boot_trace},
+    {.index = 14, .callback = command_flash_session},
+    {.index = 15, .callback = command_sequenced},
+    {.index = 16, .callback = command_get_capabilities},
 };
 
 
+/**
+ * Erase unit reported by the capabilities command,
+ * platforms with sectors of varying size erase whole sectors
+ */
+#ifdef FLASH_PAGE_SIZE
+#define CAPABILITY_FLASH_PAGE_SIZE      FLASH_PAGE_SIZE
+#else
+#define CAPABILITY_FLASH_PAGE_SIZE      0
+#endif
+
+/**
+ * Number of received frames the node can buffer,
+ * i.e. the software FIFO or the three hardware FIFO mailboxes
+ */
+#ifdef CAN_RX_BUFFER_ENABLED
+#define CAPABILITY_RX_FRAMES            CAN_FRAMES_BUFFERED
+#else
+#define CAPABILITY_RX_FRAMES            3
+#endif
+
+#ifdef CAN_INTER_FRAME_DELAY
+#define CAPABILITY_FRAME_DELAY          CAN_INTER_FRAME_DELAY
+#else
+#define CAPABILITY_FRAME_DELAY          0
+#endif
+
+/**
+ * Number of datagrams the node can hold, see DATAGRAM_BUFFER_COUNT in bootloader.h
+ */
+#ifdef DATAGRAM_BUFFER_COUNT
+#define CAPABILITY_DATAGRAM_BUFFERS     DATAGRAM_BUFFER_COUNT
+#else
+#define CAPABILITY_DATAGRAM_BUFFERS     1
+#endif
+
+
+/**
+ * Set while executing a datagram addressed by this node's device class
+ */
+static bool device_class_addressed = false;
+
+
+void command_set_device_class_addressed(bool addressed)
+{
+    device_class_addressed = addressed;
+}
+
+
+/**
+ * Source ID of the executed datagram
+ */
+static uint8_t datagram_source = 0;
+
+
+void command_set_source(uint8_t source)
+{
+    datagram_source = source;
+}
+
+
+/**
+ * Image being flashed in the current flash session, see command_flash_session()
+ */
+static struct {
+    uint8_t *address;
+    uint32_t size;
+    uint32_t crc;
+    /** Number of bytes written contiguously and verified from the image address */
+    uint32_t written;
+    /** Size of the writes, which advanced the mark */
+    uint32_t page_size;
+} session;
+
+
+/**
+ * Number of client source IDs: 0 and CLIENT_ID_MIN up to CAN_DATAGRAM_NODE_COUNT - 1
+ */
+#define SEQUENCED_SOURCE_COUNT  (1 + CAN_DATAGRAM_NODE_COUNT - CLIENT_ID_MIN)
+
+/**
+ * Token and reply of the last sequenced command of every client source ID,
+ * see command_sequenced()
+ */
+typedef struct {
+    bool valid;
+    uint32_t token;
+    uint8_t reply[SEQUENCED_REPLY_SIZE];
+    size_t reply_len;
+} sequenced_reply_t;
+
+static sequenced_reply_t last_sequenced[SEQUENCED_SOURCE_COUNT];
+
+
+/**
+ * Returns the sequenced reply cache of the given source ID.
+ * Sources below CLIENT_ID_MIN share the entry of source 0.
+ */
+static sequenced_reply_t *sequenced_reply(uint8_t source)
+{
+    if (source < CLIENT_ID_MIN || source >= CAN_DATAGRAM_NODE_COUNT) {
+        return &last_sequenced[0];
+    }
+    return &last_sequenced[1 + source - CLIENT_ID_MIN];
+}
+
+
+/**
+ * Advances the flash session's mark, if the write continues the written part of the image
+ *
+ * Clients skip pages which are erased in the image, so erased flash may precede the write.
+ */
+static void flash_session_written(uint8_t *address, const void *data, uint32_t size)
+{
+    uint8_t *end = session.address + session.written;
+
+    if (session.size == 0 || address < end || address + size > session.address + session.size) {
+        return;
+    }
+
+    if (!flash_page_is_erased(end, address - end) || memcmp(address, data, size) != 0) {
+        return;
+    }
+
+    session.written = (address - session.address) + size;
+    if (session.page_size == 0) {
+        session.page_size = size;
+    }
+}
+
+
+/**
+ * Lowers the flash session's mark to the first erased page
+ *
+ * Erasing a large sector may erase more than the requested page,
+ * hence the written pages below the mark are checked as well.
+ */
+static void flash_session_erased(uint8_t *address)
+{
+    if (session.size == 0 || session.page_size == 0) {
+        return;
+    }
+
+    // Only whole pages count as written
+    uint32_t written = (session.written / session.page_size) * session.page_size;
+
+    if (address < session.address) {
+        written = 0;
+    } else if (address < session.address + written) {
+        written = ((address - session.address) / session.page_size) * session.page_size;
+    }
+
+    while (written >= session.page_size &&
+           flash_page_is_erased(session.address + written - session.page_size, session.page_size)) {
+        written -= session.page_size;
+    }
+
+    session.written = written;
+}
+
+
+/**
+ * Reads the device class argument and compares it with the configured device class
+ *
+ * If the next argument is no string, it is left unread and the device class
+ * is only accepted, if the datagram was addressed by device class.
+ */
+static bool device_class_is_accepted(cmp_ctx_t *args, bootloader_config_t *config)
+{
+    char device_class[64 + 1];
+    uint32_t size = sizeof(device_class);
+    cmp_mem_access_t *cma = (cmp_mem_access_t *)(args->buf);
+    size_t pos = cmp_mem_access_get_pos(cma);
+
+    if (!cmp_read_str(args, device_class, &size)) {
+        cmp_mem_access_set_pos(cma, pos);
+        return device_class_addressed;
+    }
+
+    return (strcmp(device_class, config->device_class) == 0);
+}
+
+
+/**
+ * Invalidates the persisted application verified marker,
+ * before the application is modified for the first time.
+ */
+static void application_modification_begin(bootloader_config_t *config)
+{
+    if (config_application_is_verified(config)) {
+        config_application_clear_verified(config);
+        config_save(config);
+    }
+}
+
+
 command_t* get_command_by_index(uint8_t index)
 {
     for (uint8_t i=0; i<COMMAND_COUNT; i++)
@@ -46,7 +253,7 @@ void command_erase_flash_page(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloa
 {
     void *address;
     uint64_t tmp = 0;
-    char device_class[64];
+    uint32_t size = 64;
 
     // Read address (unsigned 64-bit integer) from MessagePack
     cmp_read_uinteger(args, &tmp);
@@ -64,16 +271,15 @@ void command_erase_flash_page(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloa
         return;
     }
 
-    // Read device class (string) from MessagePack
-    uint32_t size = 64;
-    cmp_read_str(args, device_class, &size);
-
-    // Check device class
-    if (strcmp(device_class, config->device_class) != 0) {
+    // Read and check device class (string) from MessagePack
+    if (!device_class_is_accepted(args, config)) {
         cmp_write_uint(out, FLASH_ERASE_ERROR_DEVICE_CLASS_MISMATCH);
         return;
     }
 
+    application_modification_begin(config);
+
+    uint32_t start = cycle_counter_get();
     uint8_t retry = FLASH_ERASE_RETRIES;
     do {
         // Erase flash at specified address
@@ -83,6 +289,9 @@ void command_erase_flash_page(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloa
     }
     // Check, if the target area was erased completely
     while ((!flash_page_is_erased(address, size)) && (retry-- > 0));
+    profiling_record(PROFILING_PHASE_FLASH_ERASE, cycle_counter_get() - start);
+
+    flash_session_erased(address);
 
     if (retry == 0) {
         // Flash area not erased
@@ -100,7 +309,6 @@ void command_write_flash(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_c
     void *src;
     uint64_t tmp = 0;
     uint32_t size;
-    char device_class[64];
 
     // Read address (unsigned 64-bit integer) from MessagePack
     cmp_read_uinteger(args, &tmp);
@@ -118,12 +326,8 @@ void command_write_flash(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_c
         return;
     }
 
-    // Read device class (string) from MessagePack
-    size = 64;
-    cmp_read_str(args, device_class, &size);
-
-    // Check device class
-    if (strcmp(device_class, config->device_class) != 0) {
+    // Read and check device class (string) from MessagePack
+    if (!device_class_is_accepted(args, config)) {
         cmp_write_uint(out, FLASH_WRITE_ERROR_DEVICE_CLASS_MISMATCH);
         return;
     }
@@ -148,10 +352,16 @@ void command_write_flash(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_c
         return;
     }
 
+    application_modification_begin(config);
+
     // Write received data to flash
+    uint32_t start = cycle_counter_get();
     flash_writer_unlock();
     flash_writer_page_write(address, src, size);
     flash_writer_lock();
+    profiling_record(PROFILING_PHASE_FLASH_WRITE, cycle_counter_get() - start);
+
+    flash_session_written(address, src, size);
 
     // Writing to flash succeeded
     cmp_write_bool(out, FLASH_WRITE_SUCCESS);
@@ -180,9 +390,26 @@ void command_read_flash(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_co
 void command_jump_to_application(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_config_t *config)
 {
 #ifndef COMMAND_JUMP_DISABLE_CRC_CHECKING
-    // Compare the CRC of the flashed application with the CRC stored in the config
-    if (crc32(0, memory_get_app_addr(), config->application_size) == config->application_crc) {
+    bool application_valid;
+
+    if (config_application_is_verified(config)) {
+        // The application was not modified since its last verification
+        application_valid = true;
+    } else {
+        // Compare the CRC of the flashed application with the CRC stored in the config
+        application_valid = (crc32(0, memory_get_app_addr(), config->application_size) == config->application_crc);
+
+        if (application_valid) {
+            // Remember the result for subsequent boots
+            config_application_set_verified(config);
+            config_save(config);
+        }
+    }
+    boot_trace_record(BOOT_TRACE_APP_CRC);
+
+    if (application_valid) {
         // CRC is valid: run application
+        boot_trace_record(BOOT_TRACE_JUMP);
         reboot_system(BOOT_ARG_START_APPLICATION);
     } else {
         // CRC is invalid: reboot and remain in bootloader
@@ -190,6 +417,7 @@ void command_jump_to_application(int argc, cmp_ctx_t *args, cmp_ctx_t *out, boot
     }
 #else
     // Run the flashed application regardless of whether it's CRC is valid or not
+    boot_trace_record(BOOT_TRACE_JUMP);
     reboot_system(BOOT_ARG_START_APPLICATION);
 #endif
 }
@@ -234,7 +462,9 @@ void command_crc_region(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_co
 #endif
 
     // Calculate checksum over the requested address range
+    uint32_t start = cycle_counter_get();
     crc = crc32(0, address, size);
+    profiling_record(PROFILING_PHASE_CRC, cycle_counter_get() - start);
 
     // Return calculated checksum value
     cmp_write_uint(out, crc);
@@ -243,7 +473,22 @@ void command_crc_region(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_co
 
 void command_config_update(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_config_t *config)
 {
-    config_update_from_serialized(config, args);
+    // Apply the update to a copy, so that a rejected update leaves the config unchanged
+    bootloader_config_t update = *config;
+
+    config_update_from_serialized(&update, args);
+
+    // Source ID 0 and the IDs from CLIENT_ID_MIN on belong to clients, see can_datagram.h
+    if (update.ID != config->ID && (update.ID == 0 || update.ID >= CLIENT_ID_MIN)) {
+        cmp_write_uint(out, CONFIG_ERROR_RESERVED_ID);
+        return;
+    }
+
+    // The verified marker is maintained by the bootloader only
+    update.application_verified_crc = config->application_verified_crc;
+    update.application_verified_count = config->application_verified_count;
+
+    *config = update;
     cmp_write_bool(out, 1);
 }
 
@@ -255,52 +500,13 @@ void command_ping(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_config_t
 }
 
 
-static bool flash_write_and_verify(void *addr, void *data, size_t len)
-{
-    flash_writer_unlock();
-    flash_writer_page_erase(addr);
-    flash_writer_page_write(addr, data, len);
-    flash_writer_lock();
-    return config_is_valid(addr, len);
-}
-
-
 void command_config_write_to_flash(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_config_t *config)
 {
     // Increment the number of times, this board has been flashed
     config->update_count += 1;
 
-    // Prepare a zero-padded configuration page buffer
-    static uint8_t config_page_buffer[CONFIG_PAGE_SIZE];
-    memset(config_page_buffer, 0, CONFIG_PAGE_SIZE);
-    config_write(config_page_buffer, config, CONFIG_PAGE_SIZE);
-
-    // Get pointers to configuration pages in flash memory
-    void *config1 = memory_get_config1_addr();
-    void *config2 = memory_get_config2_addr();
-
-    // Update both config pages
-    // The update order shall prevent a valid configuration from being overwritten, if one update fails.
-    bool success = false;
-    if (config_is_valid(config2, CONFIG_PAGE_SIZE)) {
-        if (flash_write_and_verify(config1, config_page_buffer, CONFIG_PAGE_SIZE)) {
-            if (flash_write_and_verify(config2, config_page_buffer, CONFIG_PAGE_SIZE)) {
-                success = true;
-            }
-        }
-    } else if (config_is_valid(config1, CONFIG_PAGE_SIZE)) {
-        if (flash_write_and_verify(config2, config_page_buffer, CONFIG_PAGE_SIZE)) {
-            if (flash_write_and_verify(config1, config_page_buffer, CONFIG_PAGE_SIZE)) {
-                success = true;
-            }
-        }
-    } else {
-        success = flash_write_and_verify(config1, config_page_buffer, CONFIG_PAGE_SIZE);
-        success &= flash_write_and_verify(config2, config_page_buffer, CONFIG_PAGE_SIZE);
-    }
-
     // Return whether updating both config pages was successful or not
-    if (success) {
+    if (config_save(config)) {
         cmp_write_bool(out, 1);
     } else {
         cmp_write_bool(out, 0);
@@ -327,6 +533,9 @@ int execute_datagram_commands(char *data, size_t data_len, const command_t *comm
     cmp_mem_access_t out_cma;
     cmp_ctx_t out_writer;
 
+    // Until a valid command was found, measurements are attributed to slot 0
+    profiling_set_command(0);
+
     // Prepare for reading commands from input buffer
     cmp_mem_access_ro_init(&command_reader, &command_cma, data, data_len);
     cmp_read_int(&command_reader, &command_version);
@@ -359,13 +568,23 @@ int execute_datagram_commands(char *data, size_t data_len, const command_t *comm
     cmd = get_command_by_index(command_index);
     if (cmd != 0)
     {
+        profiling_set_command(command_index);
+        uint32_t start = cycle_counter_get();
         cmd->callback(argc, &command_reader, &out_writer, config);
+        profiling_record(PROFILING_PHASE_EXECUTION, cycle_counter_get() - start);
         return cmp_mem_access_get_pos(&out_cma);
     }
     return -ERR_COMMAND_NOT_FOUND;
 }
 
 
+bool command_reply_is_success(const char *reply, int length)
+{
+    // MessagePack encodes true as 0xc3 and the integer 1 as positive fixint
+    return (length == 1) && ((uint8_t) reply[0] == 0xc3 || reply[0] == 0x01);
+}
+
+
 static volatile uint8_t status;
 
 void set_status(uint8_t code)
@@ -375,5 +594,239 @@ void set_status(uint8_t code)
 
 void command_get_status(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_config_t *config)
 {
-    cmp_write_u8(out, status);
+    uint32_t token;
+
+    // Without a token, report the status of the last received datagram
+    if (argc < 1 || !cmp_read_uint(args, &token)) {
+        cmp_write_u8(out, status);
+        return;
+    }
+
+    // Otherwise report the state and result of an asynchronous job
+    const command_job_t *job = command_queue_find(token);
+
+    cmp_write_array(out, 3);
+    cmp_write_uint(out, token);
+
+    if (job == NULL) {
+        cmp_write_uint(out, JOB_STATE_UNKNOWN);
+        cmp_write_nil(out);
+        return;
+    }
+
+    cmp_write_uint(out, job->state);
+
+    if (job->state == JOB_STATE_DONE) {
+        // The result is already MessagePack encoded
+        out->write(out, job->result, job->result_len);
+    } else {
+        cmp_write_nil(out);
+    }
+}
+
+
+void command_submit_async(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_config_t *config)
+{
+    uint32_t token;
+    uint32_t size;
+
+    // Read request token (unsigned 32-bit integer) from MessagePack
+    if (argc < 2 || !cmp_read_uint(args, &token)) {
+        cmp_write_uint(out, ASYNC_ERROR_MALFORMED);
+        return;
+    }
+
+    // Read size of the encoded command (binary) from MessagePack
+    if (!cmp_read_bin_size(args, &size)) {
+        cmp_write_uint(out, ASYNC_ERROR_MALFORMED);
+        return;
+    }
+
+    if (size > COMMAND_QUEUE_DATA_SIZE) {
+        cmp_write_uint(out, ASYNC_ERROR_TOO_LARGE);
+        return;
+    }
+
+    // Zero copy access to the encoded command, see command_write_flash()
+    cmp_mem_access_t *cma = (cmp_mem_access_t *)(args->buf);
+    void *data = cmp_mem_access_get_ptr_at_pos(cma, cmp_mem_access_get_pos(cma));
+
+    job_state_t state = command_queue_submit(token, data, size);
+
+    if (state == JOB_STATE_UNKNOWN) {
+        cmp_write_uint(out, ASYNC_ERROR_QUEUE_FULL);
+        return;
+    }
+
+    // Accepted, respectively state of a previously submitted request with the same token
+    cmp_write_uint(out, state);
+}
+
+
+void command_get_profiling_stats(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_config_t *config)
+{
+    bool reset = false;
+
+    // Optional argument: Clear statistics after reading them
+    if (argc > 0) {
+        cmp_read_bool(args, &reset);
+    }
+
+    profiling_write_messagepack(out);
+
+    if (reset) {
+        profiling_reset();
+    }
+}
+
+
+void command_get_boot_trace(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_config_t *config)
+{
+    const boot_trace_t *trace = boot_trace_get();
+    uint32_t count = (trace != NULL) ? trace->count : 0;
+
+    cmp_write_map(out, 2);
+
+    const char *frequency_key = "frequency";
+    cmp_write_str(out, frequency_key, strlen(frequency_key));
+    profiling_write_frequency(out);
+
+    const char *trace_key = "trace";
+    cmp_write_str(out, trace_key, strlen(trace_key));
+    cmp_write_array(out, count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        cmp_write_array(out, 2);
+        cmp_write_uint(out, trace->entries[i].phase);
+        cmp_write_uint(out, trace->entries[i].cycles);
+    }
+}
+
+
+void command_flash_session(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_config_t *config)
+{
+    uint64_t address;
+    uint32_t size, crc;
+
+    if (argc < 3 ||
+        !cmp_read_uinteger(args, &address) ||
+        !cmp_read_uint(args, &size) ||
+        !cmp_read_uint(args, &crc)) {
+        // Malformed requests end the session
+        memset(&session, 0, sizeof(session));
+        cmp_write_uint(out, 0);
+        return;
+    }
+
+    if ((uint8_t *)(uintptr_t) address != session.address || size != session.size || crc != session.crc) {
+        // Another image, begin a new session
+        memset(&session, 0, sizeof(session));
+        session.address = (uint8_t *)(uintptr_t) address;
+        session.size = size;
+        session.crc = crc;
+    }
+
+    cmp_write_uint(out, session.written);
+}
+
+
+void command_sequenced_reset(void)
+{
+    memset(last_sequenced, 0, sizeof(last_sequenced));
+}
+
+
+void command_sequenced(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_config_t *config)
+{
+    uint32_t token;
+    uint32_t size;
+
+    if (argc < 2 || !cmp_read_uint(args, &token) || !cmp_read_bin_size(args, &size)) {
+        cmp_write_uint(out, ERR_INVALID_COMMAND);
+        return;
+    }
+
+    // Tokens are only unique per client
+    sequenced_reply_t *last = sequenced_reply(datagram_source);
+
+    // A retransmission, whose original was executed already: Replay its reply
+    if (last->valid && last->token == token) {
+        out->write(out, last->reply, last->reply_len);
+        return;
+    }
+
+    // Zero copy access to the encoded command, see command_write_flash()
+    cmp_mem_access_t *cma = (cmp_mem_access_t *)(args->buf);
+    void *data = cmp_mem_access_get_ptr_at_pos(cma, cmp_mem_access_get_pos(cma));
+
+    int reply_len = execute_datagram_commands(
+            (char *) data,
+            size,
+            &commands[0],
+            COMMAND_COUNT,
+            (char *) last->reply,
+            SEQUENCED_REPLY_SIZE,
+            config
+            );
+
+    if (reply_len < 0) {
+        // Report the error code the same way as an unwrapped command would
+        cmp_mem_access_t reply_cma;
+        cmp_ctx_t reply_ctx;
+        cmp_mem_access_init(&reply_ctx, &reply_cma, last->reply, SEQUENCED_REPLY_SIZE);
+        cmp_write_uint(&reply_ctx, -reply_len);
+        reply_len = cmp_mem_access_get_pos(&reply_cma);
+    }
+
+    last->token = token;
+    last->reply_len = reply_len;
+    last->valid = true;
+
+    out->write(out, last->reply, last->reply_len);
+}
+
+
+/**
+ * Writes a MessagePack string key followed by an unsigned integer value
+ */
+static void write_uint_entry(cmp_ctx_t *out, const char *key, uint64_t value)
+{
+    cmp_write_str(out, key, strlen(key));
+    cmp_write_uint(out, value);
+}
+
+
+void command_get_capabilities(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_config_t *config)
+{
+    uint32_t features = CAPABILITY_COMPACT_DATAGRAMS | CAPABILITY_REPLY_FLAGS;
+
+    #ifdef CAN_RX_BUFFER_ENABLED
+    features |= CAPABILITY_RX_BUFFER;
+    #endif
+    #ifdef CAN_FILTERS_ENABLED
+    features |= CAPABILITY_FRAME_FILTERS;
+    #endif
+    #ifdef BOOT_TRACE_ENABLED
+    features |= CAPABILITY_BOOT_TRACE;
+    #endif
+
+    cmp_write_map(out, 10);
+
+    write_uint_entry(out, "input_buffer", INPUT_BUFFER_SIZE);
+    write_uint_entry(out, "output_buffer", OUTPUT_BUFFER_SIZE);
+    write_uint_entry(out, "flash_page", CAPABILITY_FLASH_PAGE_SIZE);
+    write_uint_entry(out, "app_address", (uintptr_t) memory_get_app_addr());
+    write_uint_entry(out, "app_size", memory_get_app_size());
+    write_uint_entry(out, "rx_frames", CAPABILITY_RX_FRAMES);
+    write_uint_entry(out, "frame_delay", CAPABILITY_FRAME_DELAY);
+    write_uint_entry(out, "datagram_buffers", CAPABILITY_DATAGRAM_BUFFERS);
+
+    const char *commands_key = "commands";
+    cmp_write_str(out, commands_key, strlen(commands_key));
+    cmp_write_array(out, COMMAND_COUNT);
+    for (uint8_t i = 0; i < COMMAND_COUNT; i++) {
+        cmp_write_uint(out, commands[i].index);
+    }
+
+    write_uint_entry(out, "features", features);
 }
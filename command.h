@@ -14,7 +14,32 @@ extern "C" {
 #define COMMAND_SET_VERSION 3
 
 /** Total number of supported commands */
-#define COMMAND_COUNT 10
+#define COMMAND_COUNT 16
+
+/** Maximum size of a reply, which is kept for replaying it to duplicate sequenced commands */
+#ifndef SEQUENCED_REPLY_SIZE
+#define SEQUENCED_REPLY_SIZE 32
+#endif
+
+
+/**
+ * Feature flags reported by the capabilities command
+ *
+ * The values are part of the protocol and must be kept in sync
+ * with class Capability in file client/cvra_bootloader/commands.py
+ */
+typedef enum {
+    /** Compact (version 2) datagrams with bitmap, range, class and group destinations */
+    CAPABILITY_COMPACT_DATAGRAMS = (1 << 0),
+    /** Slotted and quiet replies, see CAN_DATAGRAM_FLAG_SLOTTED_REPLY and CAN_DATAGRAM_FLAG_QUIET */
+    CAPABILITY_REPLY_FLAGS = (1 << 1),
+    /** Received frames are buffered in RAM, see CAN_RX_BUFFER_ENABLED */
+    CAPABILITY_RX_BUFFER = (1 << 2),
+    /** Frames addressed to other nodes are filtered in hardware */
+    CAPABILITY_FRAME_FILTERS = (1 << 3),
+    /** Boot phases are traced, see boot_trace.h */
+    CAPABILITY_BOOT_TRACE = (1 << 4),
+} capability_t;
 
 
 /**
@@ -58,7 +83,35 @@ command_t* get_command_by_index(uint8_t index);
 int execute_datagram_commands(char *data, size_t data_len, const command_t *commands, int command_len, char *out_buf, size_t out_len, bootloader_config_t *config);
 
 
+/** Checks whether a command reply merely reports success.
+ *
+ * Such replies consist of the single MessagePack value true or 1
+ * and are omitted for datagrams with the quiet flag set.
+ * @param [in] reply The reply as written by the command.
+ * @param [in] length Length of the reply, negative for error codes.
+ */
+bool command_reply_is_success(const char *reply, int length);
+
+
+/** Signals whether the executed datagram was addressed by this node's device class.
+ *
+ * The erase and write commands accept a missing device class argument only in this case.
+ * @param [in] addressed True while executing a device class addressed datagram.
+ */
+void command_set_device_class_addressed(bool addressed);
+
+
+/** Signals the source ID of the executed datagram.
+ *
+ * Sequenced commands are told apart by source ID and token.
+ * @param [in] source Source ID of the datagram's frames.
+ */
+void command_set_source(uint8_t source);
+
+
 /** Command used to erase a flash page.
+ *
+ * Arguments: address, device class (optional in device class addressed datagrams)
  *
  * @note Should not be called directly but be a part of the commands given to protocol_execute_command.
  */
@@ -66,6 +119,8 @@ void command_erase_flash_page(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloa
 
 
 /** Command used to write to a flash page.
+ *
+ * Arguments: address, device class (optional in device class addressed datagrams), data
  *
  * @note Should not be called directly but be a part of the commands given to protocol_execute_command.
  */
@@ -110,10 +165,71 @@ void command_ping(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_config_t
 void set_status(uint8_t code);
 
 
-/** Command requesting last status code */
+/** Command requesting last status code
+ *
+ * If a request token is given as argument, the reply is [token, state, result]
+ * of the corresponding asynchronous job instead. The result is nil until the job is done.
+ */
 void command_get_status(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_config_t *config);
 
 
+/** Command returning the recorded cycle counts per command and phase.
+ *
+ * An optional boolean argument requests the statistics to be cleared afterwards.
+ */
+void command_get_profiling_stats(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_config_t *config);
+
+
+/** Command queueing another command for execution from the main loop.
+ *
+ * Arguments are a request token and the encoded command (binary).
+ * Replies immediately with the job state, see command_queue.h.
+ */
+void command_submit_async(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_config_t *config);
+
+
+/** Command returning the boot phase trace of the current boot, see boot_trace.h */
+void command_get_boot_trace(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_config_t *config);
+
+
+/** Command beginning or resuming a flash session.
+ *
+ * Arguments: image address, image size and image CRC32
+ *
+ * The session records how many bytes of the image were written contiguously
+ * and verified, starting at the image address. Erasing flash lowers this mark
+ * to the first erased page. The session is kept in RAM only.
+ *
+ * Replies with the number of bytes written so far, if the image matches the
+ * current session, otherwise a new session is begun and 0 is returned.
+ */
+void command_flash_session(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_config_t *config);
+
+
+/** Command executing another command, unless it carries the same sequence token
+ * as the previous sequenced command of the same source ID.
+ *
+ * Arguments are a sequence token and the encoded command (binary).
+ * Replies with the reply of the wrapped command. For a duplicate token,
+ * the reply of the previous execution is sent again instead.
+ */
+void command_sequenced(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_config_t *config);
+
+
+/** Forgets the tokens and replies of the last sequenced commands. */
+void command_sequenced_reset(void);
+
+
+/** Command returning the limits and features of this node as MessagePack map.
+ *
+ * Keys: input_buffer, output_buffer (bytes), flash_page (erase unit in bytes, 0 for sectors
+ * of varying size), app_address, app_size, rx_frames (number of frames buffered on reception),
+ * frame_delay (milliseconds between reply frames), commands (array of command indices)
+ * and features (capability_t flags).
+ */
+void command_get_capabilities(int argc, cmp_ctx_t *args, cmp_ctx_t *out, bootloader_config_t *config);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,131 @@
+#include <string.h>
+#include <cmp_mem_access/cmp_mem_access.h>
+#include "command.h"
+#include "command_queue.h"
+
+
+/**
+ * List of commands supported by this firmware
+ * as defined in command.c
+ */
+extern command_t commands[COMMAND_COUNT];
+
+
+static command_job_t jobs[COMMAND_QUEUE_SIZE];
+
+/**
+ * Sequence number of the next submitted job
+ */
+static uint32_t next_sequence;
+
+
+void command_queue_init(void)
+{
+    memset(jobs, 0, sizeof(jobs));
+    next_sequence = 0;
+}
+
+
+const command_job_t *command_queue_find(uint32_t token)
+{
+    for (int i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+        if (jobs[i].state != JOB_STATE_UNKNOWN && jobs[i].token == token) {
+            return &jobs[i];
+        }
+    }
+    return NULL;
+}
+
+
+job_state_t command_queue_submit(uint32_t token, const void *data, size_t len)
+{
+    // A retransmitted request must not be executed twice
+    const command_job_t *known = command_queue_find(token);
+    if (known != NULL) {
+        return known->state;
+    }
+
+    if (len > COMMAND_QUEUE_DATA_SIZE) {
+        return JOB_STATE_UNKNOWN;
+    }
+
+    // Use an empty slot or else forget the oldest finished job
+    command_job_t *job = NULL;
+    for (int i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+        if (jobs[i].state == JOB_STATE_UNKNOWN) {
+            job = &jobs[i];
+            break;
+        }
+        if (jobs[i].state == JOB_STATE_DONE
+         && (job == NULL || jobs[i].sequence < job->sequence)) {
+            job = &jobs[i];
+        }
+    }
+
+    if (job == NULL) {
+        // All slots are occupied by unfinished jobs
+        return JOB_STATE_UNKNOWN;
+    }
+
+    job->token = token;
+    job->sequence = next_sequence++;
+    memcpy(job->data, data, len);
+    job->data_len = len;
+    job->result_len = 0;
+    job->state = JOB_STATE_QUEUED;
+
+    return job->state;
+}
+
+
+bool command_queue_pending(void)
+{
+    for (int i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+        if (jobs[i].state == JOB_STATE_QUEUED) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool command_queue_process(bootloader_config_t *config)
+{
+    command_job_t *job = NULL;
+    for (int i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+        if (jobs[i].state == JOB_STATE_QUEUED
+         && (job == NULL || jobs[i].sequence < job->sequence)) {
+            job = &jobs[i];
+        }
+    }
+
+    if (job == NULL) {
+        return false;
+    }
+
+    job->state = JOB_STATE_RUNNING;
+
+    int result_len = execute_datagram_commands(
+            (char *) job->data,
+            job->data_len,
+            &commands[0],
+            COMMAND_COUNT,
+            (char *) job->result,
+            COMMAND_QUEUE_RESULT_SIZE,
+            config
+            );
+
+    if (result_len < 0) {
+        // Report the error code the same way as a synchronous command would
+        cmp_mem_access_t cma;
+        cmp_ctx_t ctx;
+        cmp_mem_access_init(&ctx, &cma, job->result, COMMAND_QUEUE_RESULT_SIZE);
+        cmp_write_uint(&ctx, -result_len);
+        result_len = cmp_mem_access_get_pos(&cma);
+    }
+
+    job->result_len = result_len;
+    job->state = JOB_STATE_DONE;
+
+    return true;
+}
@@ -0,0 +1,110 @@
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "config.h"
+
+
+/** Number of jobs, which can be queued or remembered at the same time */
+#ifndef COMMAND_QUEUE_SIZE
+#define COMMAND_QUEUE_SIZE 4
+#endif
+
+/** Maximum size of an encoded command, which can be queued */
+#ifndef COMMAND_QUEUE_DATA_SIZE
+#define COMMAND_QUEUE_DATA_SIZE 128
+#endif
+
+/** Maximum size of an encoded command result */
+#ifndef COMMAND_QUEUE_RESULT_SIZE
+#define COMMAND_QUEUE_RESULT_SIZE 32
+#endif
+
+
+/**
+ * Possible states of an asynchronous command job
+ *
+ * The values are part of the protocol and must be kept in sync
+ * with class JobState in file client/cvra_bootloader/commands.py
+ */
+typedef enum {
+    /** No job with this token is known (anymore) */
+    JOB_STATE_UNKNOWN = 0,
+    /** The job was accepted and waits for execution */
+    JOB_STATE_QUEUED = 1,
+    /** The job is currently being executed */
+    JOB_STATE_RUNNING = 2,
+    /** The job was executed, its result is available */
+    JOB_STATE_DONE = 3,
+} job_state_t;
+
+
+/**
+ * Asynchronously executed command
+ */
+typedef struct {
+    /** Client chosen identifier of this request */
+    uint32_t token;
+    job_state_t state;
+    /** Submission order, the oldest queued job is executed first */
+    uint32_t sequence;
+    /** Encoded command (version, index, arguments) */
+    uint8_t data[COMMAND_QUEUE_DATA_SIZE];
+    size_t data_len;
+    /** MessagePack encoded result of the command */
+    uint8_t result[COMMAND_QUEUE_RESULT_SIZE];
+    size_t result_len;
+} command_job_t;
+
+
+/**
+ * Discards all jobs
+ */
+void command_queue_init(void);
+
+/**
+ * Queues an encoded command for later execution
+ *
+ * If a job with the same token is already known,
+ * the command is not queued a second time.
+ *
+ * @param token     Identifier of the request
+ * @param data      Encoded command as it would appear in a datagram
+ * @param len       Length of data
+ * @returns The state of the job with the given token
+ * @retval JOB_STATE_UNKNOWN The command was too large or the queue is full.
+ */
+job_state_t command_queue_submit(uint32_t token, const void *data, size_t len);
+
+/**
+ * Returns the job with the given token
+ *
+ * @retval NULL No such job is known
+ */
+const command_job_t *command_queue_find(uint32_t token);
+
+/**
+ * Returns whether jobs are waiting for execution
+ */
+bool command_queue_pending(void);
+
+/**
+ * Executes the oldest queued job, if any
+ *
+ * @param config    Bootloader configuration passed to the command
+ * @returns Whether a job was executed
+ */
+bool command_queue_process(bootloader_config_t *config);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMMAND_QUEUE_H */
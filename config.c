@@ -37,6 +37,29 @@ bool config_is_valid(void *page, size_t page_size)
 }
 
 
+bool config_application_is_verified(bootloader_config_t *config)
+{
+    // A zero update counter never occurs in a saved config
+    return (config->application_verified_count != 0)
+        && (config->application_verified_count == config->update_count)
+        && (config->application_verified_crc == config->application_crc);
+}
+
+
+void config_application_set_verified(bootloader_config_t *config)
+{
+    config->application_verified_crc = config->application_crc;
+    config->application_verified_count = config->update_count;
+}
+
+
+void config_application_clear_verified(bootloader_config_t *config)
+{
+    config->application_verified_crc = 0;
+    config->application_verified_count = 0;
+}
+
+
 void config_write(void *buffer, bootloader_config_t *config, size_t buffer_size)
 {
     cmp_ctx_t context;
@@ -56,7 +79,7 @@ void config_write(void *buffer, bootloader_config_t *config, size_t buffer_size)
 
 void config_write_messagepack(cmp_ctx_t *context, bootloader_config_t *config)
 {
-    cmp_write_map(context, 8);
+    cmp_write_map(context, 11);
 
     cmp_write_str(context, CONFIG_KEY_ID, sizeof(CONFIG_KEY_ID)-1);
     cmp_write_u8(context, config->ID);
@@ -67,6 +90,9 @@ void config_write_messagepack(cmp_ctx_t *context, bootloader_config_t *config)
     cmp_write_str(context, CONFIG_KEY_DEVICE_CLASS, sizeof(CONFIG_KEY_DEVICE_CLASS)-1);
     cmp_write_str(context, config->device_class, strlen(config->device_class));
 
+    cmp_write_str(context, CONFIG_KEY_GROUP, sizeof(CONFIG_KEY_GROUP)-1);
+    cmp_write_u8(context, config->group);
+
     cmp_write_str(context, CONFIG_KEY_APPLICATION_CRC, sizeof(CONFIG_KEY_APPLICATION_CRC)-1);
     cmp_write_uint(context, config->application_crc);
 
@@ -76,6 +102,12 @@ void config_write_messagepack(cmp_ctx_t *context, bootloader_config_t *config)
     cmp_write_str(context, CONFIG_KEY_UPDATE_COUNT, sizeof(CONFIG_KEY_UPDATE_COUNT)-1);
     cmp_write_uint(context, config->update_count);
 
+    cmp_write_str(context, CONFIG_KEY_VERIFIED_CRC, sizeof(CONFIG_KEY_VERIFIED_CRC)-1);
+    cmp_write_uint(context, config->application_verified_crc);
+
+    cmp_write_str(context, CONFIG_KEY_VERIFIED_COUNT, sizeof(CONFIG_KEY_VERIFIED_COUNT)-1);
+    cmp_write_uint(context, config->application_verified_count);
+
     cmp_write_str(context, CONFIG_KEY_BOOTLOADER_COMMIT, sizeof(CONFIG_KEY_BOOTLOADER_COMMIT)-1);
     cmp_write_str(context, config->bootloader_commit, strlen(config->bootloader_commit));
 
@@ -88,6 +120,9 @@ bootloader_config_t config_read(void *buffer, size_t buffer_size)
 {
     bootloader_config_t result;
 
+    // Keys missing in older config pages must not leave garbage behind
+    memset(&result, 0, sizeof(result));
+
     cmp_ctx_t context;
     cmp_mem_access_t cma;
 
@@ -125,6 +160,10 @@ void config_update_from_serialized(bootloader_config_t *config, cmp_ctx_t *conte
             cmp_read_str(context, config->device_class, &name_len);
         }
 
+        if (!strcmp(CONFIG_KEY_GROUP, key)) {
+            cmp_read_uchar(context, &config->group);
+        }
+
 #ifdef CONFIG_APPLICATION_AS_STRUCT
         if (!strcmp(CONFIG_KEY_APPLICATION, key)) {
 
@@ -144,5 +183,13 @@ void config_update_from_serialized(bootloader_config_t *config, cmp_ctx_t *conte
         if (!strcmp(CONFIG_KEY_UPDATE_COUNT, key)) {
             cmp_read_uint(context,  &config->update_count);
         }
+
+        if (!strcmp(CONFIG_KEY_VERIFIED_CRC, key)) {
+            cmp_read_uint(context,  &config->application_verified_crc);
+        }
+
+        if (!strcmp(CONFIG_KEY_VERIFIED_COUNT, key)) {
+            cmp_read_uint(context,  &config->application_verified_count);
+        }
     }
 }
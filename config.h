@@ -15,6 +15,7 @@ extern "C" {
 #define CONFIG_KEY_ID                   "ID"
 #define CONFIG_KEY_BOARD_NAME           "name"
 #define CONFIG_KEY_DEVICE_CLASS         "device_class"
+#define CONFIG_KEY_GROUP                "group"
 #ifdef CONFIG_APPLICATION_AS_STRUCT
 #define CONFIG_KEY_APPLICATION          "application"
 #define CONFIG_KEY_APPLICATION_CRC      "crc"
@@ -24,6 +25,8 @@ extern "C" {
 #define CONFIG_KEY_APPLICATION_SIZE     "application_size"
 #endif
 #define CONFIG_KEY_UPDATE_COUNT         "update_count"
+#define CONFIG_KEY_VERIFIED_CRC         "application_verified_crc"
+#define CONFIG_KEY_VERIFIED_COUNT       "application_verified_count"
 #define CONFIG_KEY_BOOTLOADER_COMMIT    "bootloader_commit"
 #define CONFIG_KEY_BOOTLOADER_VERSION   "bootloader_version"
 
@@ -36,10 +39,20 @@ typedef struct {
     uint8_t ID; /**< Node ID */
     char board_name[64 + 1];   /**< Node human readable name, eg: 'arms.left.shoulder'. */
     char device_class[64 + 1]; /**< Node device class example : 'CVRA.motorboard.v1'*/
+    uint8_t group; /**< Multicast group the node belongs to, 0 for none */
     uint32_t application_crc;
     uint32_t application_size;
     uint32_t update_count;
 
+    /**
+     * Marker caching the result of the last application CRC check:
+     * The application was verified against application_verified_crc
+     * while the update counter was application_verified_count.
+     * The marker is only valid, if both values match the current ones.
+     */
+    uint32_t application_verified_crc;
+    uint32_t application_verified_count;
+
     /** The hash of the commit this binary was compiled from */
     char* bootloader_commit;
 
@@ -48,6 +61,24 @@ typedef struct {
 } bootloader_config_t;
 
 
+/**
+ * Returns true if the application was verified with the current CRC and update counter.
+ */
+bool config_application_is_verified(bootloader_config_t *config);
+
+
+/**
+ * Marks the application as verified with the current CRC and update counter.
+ */
+void config_application_set_verified(bootloader_config_t *config);
+
+
+/**
+ * Invalidates the application verified marker.
+ */
+void config_application_clear_verified(bootloader_config_t *config);
+
+
 /**
  * Returns true if the given config page is valid.
  */
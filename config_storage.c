@@ -0,0 +1,192 @@
+#include <string.h>
+#include <platform.h>
+#include <cmp_mem_access/cmp_mem_access.h>
+#include <crc/crc32.h>
+#include "flash_writer.h"
+#include "config.h"
+#include "config_storage.h"
+
+
+typedef struct {
+    /** Newest valid record in the page, NULL if there is none */
+    const config_record_header_t *newest;
+    /** Offset of the first byte following the last record */
+    size_t end;
+} config_log_t;
+
+
+static inline size_t config_record_size(size_t length)
+{
+    return (sizeof(config_record_header_t) + length + 3) & ~3u;
+}
+
+
+static uint32_t config_record_crc(const config_record_header_t *record)
+{
+    return crc32(0, (const uint8_t *) record + sizeof(record->crc),
+                 sizeof(config_record_header_t) - sizeof(record->crc) + record->length);
+}
+
+
+static bool config_record_is_valid(const config_record_header_t *record)
+{
+    return (record->marker == CONFIG_RECORD_MARKER)
+        && (config_record_crc(record) == record->crc);
+}
+
+
+static void config_log_scan(uint8_t *page, config_log_t *log)
+{
+    size_t offset = 0;
+    log->newest = NULL;
+
+    while (offset + sizeof(config_record_header_t) <= CONFIG_LOG_SIZE) {
+        const config_record_header_t *record = (const config_record_header_t *) &page[offset];
+        if (record->marker != CONFIG_RECORD_MARKER) {
+            // Either free space or not a log page
+            break;
+        }
+
+        size_t size = config_record_size(record->length);
+        if (offset + size > CONFIG_LOG_SIZE) {
+            break;
+        }
+
+        // Records with an invalid CRC were interrupted while writing and are skipped
+        if (config_record_is_valid(record) &&
+            (log->newest == NULL || record->sequence > log->newest->sequence)) {
+            log->newest = record;
+        }
+        offset += size;
+    }
+
+    log->end = offset;
+}
+
+
+static bool config_log_is_free(uint8_t *p, size_t len)
+{
+    while (len-- > 0) {
+        if (*p++ != 0xff) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static void config_record_read(const config_record_header_t *record, bootloader_config_t *config)
+{
+    cmp_ctx_t context;
+    cmp_mem_access_t cma;
+
+    memset(config, 0, sizeof(bootloader_config_t));
+    cmp_mem_access_ro_init(&context, &cma, (const uint8_t *) record + sizeof(config_record_header_t), record->length);
+    config_update_from_serialized(config, &context);
+}
+
+
+bool config_load(bootloader_config_t *config)
+{
+    config_log_t log1, log2;
+    config_log_scan(memory_get_config1_addr(), &log1);
+    config_log_scan(memory_get_config2_addr(), &log2);
+
+    const config_record_header_t *newest = log1.newest;
+    if (log2.newest != NULL && (newest == NULL || log2.newest->sequence > newest->sequence)) {
+        newest = log2.newest;
+    }
+
+    if (newest != NULL) {
+        config_record_read(newest, config);
+        return true;
+    }
+
+    if (config_is_valid(memory_get_config1_addr(), CONFIG_PAGE_SIZE)) {
+        // Read legacy configuration from first configuration page
+        *config = config_read(memory_get_config1_addr(), CONFIG_PAGE_SIZE);
+        return true;
+    }
+
+    if (config_is_valid(memory_get_config2_addr(), CONFIG_PAGE_SIZE)) {
+        // Read legacy configuration from second configuration page
+        *config = config_read(memory_get_config2_addr(), CONFIG_PAGE_SIZE);
+        return true;
+    }
+
+    return false;
+}
+
+
+static bool config_record_write(uint8_t *addr, const config_record_header_t *record, bool erase)
+{
+    flash_writer_unlock();
+    if (erase) {
+        flash_writer_page_erase(addr);
+    }
+    flash_writer_page_write(addr, (void *) record, config_record_size(record->length));
+    flash_writer_lock();
+
+    const config_record_header_t *written = (const config_record_header_t *) addr;
+    return config_record_is_valid(written) && (written->sequence == record->sequence);
+}
+
+
+bool config_save(bootloader_config_t *config)
+{
+    // The record must not exceed the legacy config page, which bounded the config size so far
+    static uint8_t record_buffer[CONFIG_PAGE_SIZE];
+    config_record_header_t *record = (config_record_header_t *) record_buffer;
+    cmp_ctx_t context;
+    cmp_mem_access_t cma;
+
+    memset(record_buffer, 0xff, sizeof(record_buffer));
+    cmp_mem_access_init(&context, &cma, &record_buffer[sizeof(config_record_header_t)],
+                        sizeof(record_buffer) - sizeof(config_record_header_t));
+    config_write_messagepack(&context, config);
+
+    // Get pointers to configuration pages in flash memory
+    uint8_t *config1 = memory_get_config1_addr();
+    uint8_t *config2 = memory_get_config2_addr();
+
+    config_log_t log1, log2;
+    config_log_scan(config1, &log1);
+    config_log_scan(config2, &log2);
+
+    // The active page contains the newest record
+    uint8_t *active = NULL;
+    config_log_t *active_log = NULL;
+    if (log1.newest != NULL && (log2.newest == NULL || log1.newest->sequence > log2.newest->sequence)) {
+        active = config1;
+        active_log = &log1;
+    } else if (log2.newest != NULL) {
+        active = config2;
+        active_log = &log2;
+    }
+
+    record->sequence = (active_log != NULL) ? active_log->newest->sequence + 1 : 1;
+    record->length = cmp_mem_access_get_pos(&cma);
+    record->marker = CONFIG_RECORD_MARKER;
+    record->crc = config_record_crc(record);
+    size_t size = config_record_size(record->length);
+
+    // Append the record to the active page, if it has enough free space left
+    if (active != NULL &&
+        active_log->end + size <= CONFIG_LOG_SIZE &&
+        config_log_is_free(&active[active_log->end], size)) {
+        if (config_record_write(&active[active_log->end], record, false)) {
+            return true;
+        }
+    }
+
+    // Otherwise compact into the other page, leaving the newest record untouched.
+    // Without any record, keep a valid legacy page (if any) until the new record was written.
+    uint8_t *target;
+    if (active != NULL) {
+        target = (active == config1) ? config2 : config1;
+    } else {
+        target = config_is_valid(config1, CONFIG_PAGE_SIZE) ? config2 : config1;
+    }
+
+    return config_record_write(target, record, true);
+}
@@ -0,0 +1,74 @@
+#ifndef CONFIG_STORAGE_H
+#define CONFIG_STORAGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <platform.h>
+#include "config.h"
+
+
+/**
+ * Number of bytes of each config page used for the record log
+ *
+ * Defaults to the legacy config page size.
+ * Platforms with large flash sectors should use the whole sector.
+ */
+#ifndef CONFIG_LOG_SIZE
+#define CONFIG_LOG_SIZE                 CONFIG_PAGE_SIZE
+#endif
+
+/** Identifies a config record header */
+#define CONFIG_RECORD_MARKER            0xc0f1
+
+
+/**
+ * Each config page is an append-only log of config records.
+ * A record consists of this header, followed by the configuration
+ * as MessagePack map. Records are padded to a multiple of 4 bytes.
+ */
+typedef struct {
+    /** CRC32 over the remaining header fields and the payload */
+    uint32_t crc;
+    /** Incremented with every saved record, the highest valid one is current */
+    uint32_t sequence;
+    /** Payload length in bytes */
+    uint16_t length;
+    /** Always CONFIG_RECORD_MARKER */
+    uint16_t marker;
+} config_record_header_t;
+
+
+/**
+ * Reads the newest valid configuration record of the two config pages
+ *
+ * Pages in the legacy format (CRC followed by a single configuration)
+ * are read, if neither page contains a valid record.
+ *
+ * @retval true A valid configuration was read
+ * @retval false Neither config page is valid, config was not modified
+ */
+bool config_load(bootloader_config_t *config);
+
+/**
+ * Appends the configuration as new record to the config page log
+ *
+ * The record is appended to the page containing the newest record.
+ * Only if that page is full, the other page is erased and the record
+ * is written to its beginning, such that the previous record remains in flash,
+ * if the update fails.
+ *
+ * @note The update counter is not modified.
+ * @retval true The record was written and verified successfully
+ */
+bool config_save(bootloader_config_t *config);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONFIG_STORAGE_H */
@@ -0,0 +1,40 @@
+#ifndef CYCLE_COUNTER_H
+#define CYCLE_COUNTER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+
+/**
+ * Enables the free-running cycle counter
+ *
+ * On ARMv7-M targets this is the DWT cycle counter (CYCCNT),
+ * on the host it is backed by a monotonic clock.
+ *
+ * @param frequency     Number of counter ticks per second
+ *                      i.e. the core clock frequency in Hz
+ */
+void cycle_counter_init(uint32_t frequency);
+
+/**
+ * Returns the current counter value
+ *
+ * The counter wraps around at 2^32,
+ * so only differences between two readings are meaningful.
+ */
+uint32_t cycle_counter_get(void);
+
+/**
+ * Returns the number of counter ticks per second
+ */
+uint32_t cycle_counter_get_frequency(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CYCLE_COUNTER_H */
@@ -72,4 +72,17 @@ enum error_codes {
 #define CRC_ERROR_LENGTH_UNSPECIFIED                31
 #define CRC_ERROR_ILLEGAL_ADDRESS                   32
 
+/**
+ * Possible reply values for the asynchronous submit command
+ * besides to the job state (see command_queue.h)
+ */
+#define ASYNC_ERROR_MALFORMED                       40
+#define ASYNC_ERROR_TOO_LARGE                       41
+#define ASYNC_ERROR_QUEUE_FULL                      42
+
+/**
+ * Possible reply value for the config update command
+ */
+#define CONFIG_ERROR_RESERVED_ID                    50
+
 #endif
@@ -5,6 +5,7 @@
 #include <stddef.h>
 #include <bootloader.h>
 #include <boot_arg.h>
+#include <cycle_counter.h>
 #include <platform/mcu/armv7-m/timeout_timer.h>
 #include "platform.h"
 
@@ -124,6 +125,9 @@ void platform_main(int arg)
 {
     rcc_clock_setup_hse(&clock_72mhz);
 
+    // Enable cycle counter for profiling, runs at the core clock
+    cycle_counter_init(72000000);
+
     rcc_periph_clock_enable(RCC_GPIOA);
     rcc_periph_clock_enable(RCC_GPIOB);
 
@@ -6,6 +6,7 @@
 @   1 : bootloader, without timeout
 @   2 : application, RAM content is not altered
 @   3 : internal ST bootloader from system memeory
+@   4 : bootloader, with full timeout instead of the short listen window
 @
 @ This is has several purposes:
 @ - Start the bootloader with an argument (such as disable the timeout)
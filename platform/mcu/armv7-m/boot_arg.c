@@ -1,6 +1,10 @@
 #include <stdint.h>
+#include <stddef.h>
 #include <libopencm3/cm3/scb.h>
+#include <platform.h>
 #include <boot_arg.h>
+#include <boot_trace.h>
+#include <cycle_counter.h>
 
 const uint32_t boot_arg_magic_value_lo = 0x01234567;
 const uint32_t boot_arg_magic_value_hi = 0x0089abcd;
@@ -18,3 +22,54 @@ void reboot_system(uint8_t arg)
     // Reboot with RAM content retention
     scb_reset_system();
 }
+
+
+#ifdef BOOT_TRACE_ENABLED
+/**
+ * The trace is located after the boot argument words.
+ * The platform's linker script must keep this area free of other data,
+ * i.e. reserve BOOT_TRACE_RESERVED_SIZE bytes at the beginning of RAM.
+ */
+static boot_trace_t *boot_trace(void)
+{
+    extern uint32_t ram_begin;
+    return (boot_trace_t *) (&ram_begin + 2);
+}
+
+void boot_trace_start(void)
+{
+    boot_trace_t *trace = boot_trace();
+    trace->count = 0;
+    trace->magic = BOOT_TRACE_MAGIC;
+}
+
+void boot_trace_record(boot_trace_phase_t phase)
+{
+    boot_trace_t *trace = boot_trace();
+    if (trace->count >= BOOT_TRACE_LENGTH) {
+        return;
+    }
+    trace->entries[trace->count].phase = phase;
+    trace->entries[trace->count].cycles = cycle_counter_get();
+    trace->count++;
+}
+
+const boot_trace_t *boot_trace_get(void)
+{
+    extern uint32_t ram_begin;
+    return boot_trace_at(&ram_begin);
+}
+#else
+void boot_trace_start(void)
+{
+}
+
+void boot_trace_record(boot_trace_phase_t phase)
+{
+}
+
+const boot_trace_t *boot_trace_get(void)
+{
+    return NULL;
+}
+#endif
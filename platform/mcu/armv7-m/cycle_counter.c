@@ -0,0 +1,40 @@
+#include <stdint.h>
+#include <libopencm3/cm3/common.h>
+#include <cycle_counter.h>
+
+/*
+ * The debug registers are identical on all ARMv7-M cores,
+ * see the ARMv7-M Architecture Reference Manual, C1.6 and C1.8.
+ */
+#define SCS_DEMCR               MMIO32(0xE000EDFC)
+#define SCS_DEMCR_TRCENA        (1 << 24)
+#define DWT_CTRL                MMIO32(0xE0001000)
+#define DWT_CTRL_CYCCNTENA      (1 << 0)
+#define DWT_CYCCNT              MMIO32(0xE0001004)
+
+
+static uint32_t counter_frequency;
+
+
+void cycle_counter_init(uint32_t frequency)
+{
+    counter_frequency = frequency;
+
+    // The DWT unit is only clocked, if tracing is enabled
+    SCS_DEMCR |= SCS_DEMCR_TRCENA;
+
+    DWT_CYCCNT = 0;
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+}
+
+
+uint32_t cycle_counter_get(void)
+{
+    return DWT_CYCCNT;
+}
+
+
+uint32_t cycle_counter_get_frequency(void)
+{
+    return counter_frequency;
+}
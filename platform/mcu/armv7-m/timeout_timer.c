@@ -78,6 +78,12 @@ bool bootloader_timeout_reached()
 }
 
 
+void bootloader_timeout_set(uint32_t bootloader_timeout)
+{
+    bootloader_timeout_ms = bootloader_timeout;
+}
+
+
 void datagram_timeout_reset()
 {
     datagram_timeout_start_ms = time_ms;
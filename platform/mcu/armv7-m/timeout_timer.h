@@ -31,6 +31,12 @@ void bootloader_timeout_start();
  */
 bool bootloader_timeout_reached();
 
+/**
+ * Changes the bootloader timeout
+ * @param [in] bootloader_timeout   Number of milliseconds since bootloader_timeout_start()
+ */
+void bootloader_timeout_set(uint32_t bootloader_timeout);
+
 /**
  * Remember the current time in milliseconds
  */
@@ -243,6 +243,18 @@ void can_set_filters(uint32_t id)
         0,
         true
         );
+    /*
+     * Frames of the reserved client IDs (see CLIENT_ID_MIN),
+     * both start and continuation frames
+     */
+    can_filter_id_mask_32bit_init(
+        CAN1,
+        5,
+        CLIENT_ID_MIN << 21,
+        ((0x7FF & ~ID_START_MASK & ~(CAN_DATAGRAM_NODE_COUNT - 1 - CLIENT_ID_MIN)) << 21) | 0x6,
+        0,
+        true
+        );
     #endif  // CAN_FILTERS_ENABLED
 }
 
@@ -63,6 +63,114 @@ void rcc_set_pc9_mco2()
 }
 
 
+const clock_profile_t clock_profile_hsi_144mhz = {
+    // HSI=16 MHz / M=8 * N=144 / P=2 = 144 MHz
+    .pll_source = RCC_PLLCFGR_PLLSRC_HSI,
+    .pllm = 8,
+    .plln = 144,
+    .pllp = 2,
+    .pllq = 6,
+    .hpre = RCC_CFGR_HPRE_DIV_NONE,
+    // APB1 at most 45 MHz, APB2 at most 90 MHz
+    .ppre1 = RCC_CFGR_PPRE_DIV_8,
+    .ppre2 = RCC_CFGR_PPRE_DIV_2,
+    // 4 wait states from 120 to 150 MHz at 2.7-3.6 V, see RM0390 table 5
+    .flash_ws = FLASH_ACR_LATENCY_4WS,
+    .ahb_frequency = 144000000,
+    .apb1_frequency = 18000000,
+    .apb2_frequency = 72000000,
+};
+
+
+const clock_profile_t clock_profile_hse_25mhz_144mhz = {
+    // HSE=25 MHz / M=25 * N=288 / P=2 = 144 MHz
+    .pll_source = RCC_PLLCFGR_PLLSRC_HSE,
+    .pllm = 25,
+    .plln = 288,
+    .pllp = 2,
+    .pllq = 6,
+    .hpre = RCC_CFGR_HPRE_DIV_NONE,
+    .ppre1 = RCC_CFGR_PPRE_DIV_8,
+    .ppre2 = RCC_CFGR_PPRE_DIV_2,
+    .flash_ws = FLASH_ACR_LATENCY_4WS,
+    .ahb_frequency = 144000000,
+    .apb1_frequency = 18000000,
+    .apb2_frequency = 72000000,
+};
+
+
+const clock_profile_t clock_profile_hsi_72mhz = {
+    // HSI=16 MHz / M=8 * N=72 / P=2 = 72 MHz
+    .pll_source = RCC_PLLCFGR_PLLSRC_HSI,
+    .pllm = 8,
+    .plln = 72,
+    .pllp = 2,
+    .pllq = 2,
+    .hpre = RCC_CFGR_HPRE_DIV_NONE,
+    .ppre1 = RCC_CFGR_PPRE_DIV_4,
+    .ppre2 = RCC_CFGR_PPRE_DIV_2,
+    .flash_ws = FLASH_ACR_LATENCY_2WS,
+    .ahb_frequency = 72000000,
+    .apb1_frequency = 18000000,
+    .apb2_frequency = 36000000,
+};
+
+
+void clock_setup(const clock_profile_t *profile)
+{
+    // While configuring the clock, the processor must run directly from HSI
+    rcc_osc_on(HSI);
+    rcc_wait_for_osc_ready(HSI);
+    rcc_set_sysclk_source(RCC_CFGR_SW_HSI);
+    rcc_wait_for_sysclk_status(HSI);
+
+    if (profile->pll_source == RCC_PLLCFGR_PLLSRC_HSE) {
+        rcc_osc_on(HSE);
+        rcc_wait_for_osc_ready(HSE);
+    }
+
+    // Disable PLL (obligatory before configuring PLL)
+    rcc_osc_off(PLL);
+    rcc_wait_for_osc_not_ready(PLL);
+
+    if (profile->pll_source == RCC_PLLCFGR_PLLSRC_HSE) {
+        rcc_set_main_pll_hse(profile->pllm, profile->plln, profile->pllp, profile->pllq);
+    } else {
+        rcc_set_pll_source(RCC_PLLCFGR_PLLSRC_HSI);
+        rcc_set_main_pll_hsi(profile->pllm, profile->plln, profile->pllp, profile->pllq);
+    }
+
+    rcc_osc_on(PLL);
+    rcc_wait_for_osc_ready(PLL);
+
+    /*
+     * The wait states must be increased before switching to the faster clock.
+     * Prefetch and caches compensate most of the wait states (ART accelerator).
+     * The caches must be reset while disabled.
+     */
+    flash_set_ws(profile->flash_ws);
+    flash_dcache_disable();
+    flash_icache_disable();
+    flash_dcache_reset();
+    flash_icache_reset();
+    flash_prefetch_enable();
+    flash_icache_enable();
+    flash_dcache_enable();
+
+    // Configure prescalers before the bus clocks increase
+    rcc_set_hpre(profile->hpre);
+    rcc_set_ppre1(profile->ppre1);
+    rcc_set_ppre2(profile->ppre2);
+
+    rcc_set_sysclk_source(RCC_CFGR_SW_PLL);
+    rcc_wait_for_sysclk_status(PLL);
+
+    rcc_ahb_frequency = profile->ahb_frequency;
+    rcc_apb1_frequency = profile->apb1_frequency;
+    rcc_apb2_frequency = profile->apb2_frequency;
+}
+
+
 void rcc_clock_setup_in_hsi_out_36mhz(void)
 {
     // Enable internal high-speed resonator (16 MHz)
@@ -20,6 +20,64 @@
 #endif
 
 
+/**
+ * Clock configuration of a platform
+ *
+ * f(VCO clock) = f(PLL clock input) × (PLLN / PLLM)
+ * f(PLL clock output) = f(VCO clock) / PLLP
+ *
+ * 2 ≤ PLLM ≤ 63
+ * 50 ≤ PLLN ≤ 432
+ * PLLP = 2, 4, 6 or 8
+ */
+typedef struct {
+    /** PLL input, either RCC_PLLCFGR_PLLSRC_HSI or RCC_PLLCFGR_PLLSRC_HSE */
+    uint8_t pll_source;
+    uint8_t pllm;
+    uint16_t plln;
+    uint8_t pllp;
+    uint8_t pllq;
+    /** Bus prescalers as RCC_CFGR_HPRE_DIV_x respectively RCC_CFGR_PPRE_DIV_x */
+    uint8_t hpre;
+    uint8_t ppre1;
+    uint8_t ppre2;
+    /** Flash wait states for the AHB frequency as FLASH_ACR_LATENCY_xWS */
+    uint8_t flash_ws;
+    /** Resulting bus frequencies in Hz */
+    uint32_t ahb_frequency;
+    uint32_t apb1_frequency;
+    uint32_t apb2_frequency;
+} clock_profile_t;
+
+/**
+ * 144 MHz core clock from the internal 16 MHz resonator
+ *
+ * APB1 runs at 18 MHz like with rcc_clock_setup_in_hsi_out_36mhz(),
+ * so the CAN bit timing does not change. 144 MHz is the highest
+ * multiple of 18 MHz reachable without the over-drive mode.
+ */
+extern const clock_profile_t clock_profile_hsi_144mhz;
+
+/**
+ * 144 MHz core clock from an external 25 MHz quartz, APB1 at 18 MHz
+ */
+extern const clock_profile_t clock_profile_hse_25mhz_144mhz;
+
+/**
+ * 72 MHz core clock from the internal resonator, APB1 at 18 MHz
+ *
+ * This is the configuration applied by rcc_clock_setup_in_hsi_out_36mhz(),
+ * since its AHB prescaler value 2 means "not divided".
+ */
+extern const clock_profile_t clock_profile_hsi_72mhz;
+
+/**
+ * Configures the PLL, bus prescalers and flash wait states according to a profile
+ * and enables the flash prefetch buffer as well as instruction and data caches
+ * (ART accelerator).
+ */
+void clock_setup(const clock_profile_t *profile);
+
 /**
  * Configure the processor to run from the internal resonator
  */
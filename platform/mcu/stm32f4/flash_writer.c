@@ -45,6 +45,24 @@
 static bool flash_sector_is_erased[FLASH_SECTOR_INDEX_MAX];
 
 
+/**
+ * Invalidate the flash instruction and data caches (ART accelerator)
+ *
+ * After erasing or programming, the caches may still hold the previous flash content,
+ * see RM0390 section 3.4.2. Caches can only be reset while disabled.
+ */
+static void flash_caches_flush(void)
+{
+    uint32_t acr = FLASH_ACR;
+
+    FLASH_ACR &= ~(FLASH_ACR_ICEN | FLASH_ACR_DCEN);
+    FLASH_ACR |= (FLASH_ACR_ICRST | FLASH_ACR_DCRST);
+    FLASH_ACR &= ~(FLASH_ACR_ICRST | FLASH_ACR_DCRST);
+
+    FLASH_ACR = acr;
+}
+
+
 /**
  * Verify, that a given address lies within the address boundaries of flash memory
  */
@@ -196,6 +214,7 @@ void flash_writer_page_erase(void *page)
      * flash sector erasing. According to the RM p.69 this is not required.
      */
     flash_erase_sector(sector, FLASH_PROGRAM_SIZE);
+    flash_caches_flush();
 
     // Check FLASH_SR for success
     if (FLASH_SR & FLASH_SR_ANY_ERROR)
@@ -243,6 +262,7 @@ void flash_writer_page_write(void *page, void *data, size_t len)
 
     // Write data to flash
     flash_program((uint32_t)page, data, len);
+    flash_caches_flush();
 
     // Check FLASH_SR for success
     if (FLASH_SR & FLASH_SR_ANY_ERROR)
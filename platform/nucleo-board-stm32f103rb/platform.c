@@ -5,6 +5,7 @@
 #include <stddef.h>
 #include <bootloader.h>
 #include <boot_arg.h>
+#include <cycle_counter.h>
 #include <platform/mcu/armv7-m/timeout_timer.h>
 #include "platform.h"
 
@@ -103,6 +104,9 @@ void platform_main(int arg)
     //Else internal clock
     rcc_clock_setup_in_hsi_out_36mhz();
 
+    // Enable cycle counter for profiling, runs at the core clock
+    cycle_counter_init(36000000);
+
 
     //Activate PORTA
     rcc_periph_clock_enable(RCC_GPIOA);
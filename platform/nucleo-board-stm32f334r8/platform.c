@@ -10,6 +10,7 @@
 
 #include <bootloader.h>
 #include <boot_arg.h>
+#include <cycle_counter.h>
 #include <platform/mcu/armv7-m/timeout_timer.h>
 #include "platform.h"
 
@@ -184,6 +185,9 @@ void platform_main(int arg)
     // Otherwise use internal RC oscillator
     rcc_clock_setup_in_hsi_out_36mhz();
 
+    // Enable cycle counter for profiling, runs at the core clock
+    cycle_counter_init(36000000);
+
     // Initialize the onboard LED
     led_init();
 
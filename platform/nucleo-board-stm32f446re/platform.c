@@ -8,6 +8,8 @@
 #include <bootloader.h>
 #include <boot_arg.h>
 #include <can_interface.h>
+#include <cycle_counter.h>
+#include <boot_trace.h>
 #include <led.h>
 #include <platform/mcu/armv7-m/timeout_timer.h>
 #include <platform/mcu/stm32f4/clock.h>
@@ -24,23 +26,28 @@ void fault_handler(void)
 
 void platform_main(int arg)
 {
-    // Run from internal RC oscillator
-    rcc_clock_setup_in_hsi_out_36mhz();
+    // Enable cycle counter for profiling first, so that the clock setup is traced as well
+    cycle_counter_init(CLOCK_PROFILE.ahb_frequency);
+    boot_trace_start();
+    boot_trace_record(BOOT_TRACE_RESET);
 
-    // Run from external 25 MHz quartz
-//    rcc_clock_setup_in_hse_25mhz_out_36mhz();
+    // Run at full speed as configured in platform_config.h
+    clock_setup(&CLOCK_PROFILE);
+
+    boot_trace_record(BOOT_TRACE_CLOCK);
 
     // Initialize the on-board LED(s)
     led_init();
 
-    // Configure timeout according to platform-specific define (assuming 36 Mhz system clock, see above)
-    timer_init(36000000, BOOTLOADER_TIMEOUT, DATAGRAM_TIMEOUT);
+    // Configure timeout according to platform-specific define
+    timer_init(CLOCK_PROFILE.ahb_frequency, BOOTLOADER_TIMEOUT, DATAGRAM_TIMEOUT);
 
     // Blink on-board LED to indicate platform startup (must be after timer_init())
     led_on(LED_SUCCESS);
 
     // Configure and enable CAN peripheral
     can_interface_init();
+    boot_trace_record(BOOT_TRACE_CAN_INIT);
 
     // Start bootloader program
     bootloader_main(arg);
@@ -48,6 +48,12 @@ extern "C" {
  */
 #define CONFIG_PAGE_SIZE            512
 
+/**
+ * Config records are appended to the whole 16K config sector,
+ * such that the sector only needs to be erased once it is full.
+ */
+#define CONFIG_LOG_SIZE             0x4000
+
 
 /**
  * Configure onboard LEDs
@@ -20,6 +20,18 @@
  */
 #define BOOTLOADER_TIMEOUT      4000
 
+/**
+ * Fast boot: Number of milliseconds to listen for bootloader frames
+ * after a reset before booting to the payload application
+ *
+ * A datagram addressed to this node's ID, device class or group (e.g. a ping
+ * to all nodes) extends the window to BOOTLOADER_TIMEOUT, as soon as its
+ * destinations are received. The application can request
+ * the full timeout by rebooting with BOOT_ARG_START_BOOTLOADER_LONG_TIMEOUT.
+ * Comment out to always wait for BOOTLOADER_TIMEOUT.
+ */
+#define BOOTLOADER_LISTEN_WINDOW    50
+
 /**
  * Prevents bootloader from booting the app after a timeout occured;
  * instead wait for CAN input forever and only boot the app,
@@ -37,6 +49,16 @@
  */
 #define OUTPUT_BUFFER_SIZE      8192
 
+/**
+ * Reassemble the next datagram in a second input buffer, while the previous
+ * one waits for execution, or the datagrams of two clients at a time
+ *
+ * RAM budget (128K - 256): 2 x 33K datagram buffers, 8K output buffer
+ * and 8K CAN frame FIFO, leaving about 45K for the profiling table,
+ * the command queue and the stack.
+ */
+#define DATAGRAM_BUFFER_COUNT   2
+
 /**
  * Number of milliseconds to wait for a datagram to complete
  * before sending an error reply
@@ -64,6 +86,22 @@
 //#define BOOTLOADER_SLEEP_UNTIL_INTERRUPT
 
 
+/**
+ * Clock configuration, see platform/mcu/stm32f4/clock.h
+ *
+ * All profiles keep the APB1 clock (and thereby the CAN bit timing) unchanged.
+ * Use clock_profile_hse_25mhz_144mhz, if an external 25 MHz quartz is fitted.
+ */
+#define CLOCK_PROFILE   clock_profile_hsi_144mhz
+
+/**
+ * Record the duration of the boot phases in RAM,
+ * see boot_trace.h. Requires the beginning of RAM
+ * to be reserved in the linker script.
+ */
+#define BOOT_TRACE_ENABLED
+
+
 /**
  * Configure onboard LEDs
  */
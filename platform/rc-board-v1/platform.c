@@ -5,6 +5,7 @@
 #include <stddef.h>
 #include <bootloader.h>
 #include <boot_arg.h>
+#include <cycle_counter.h>
 #include <platform/mcu/armv7-m/timeout_timer.h>
 #include "platform.h"
 
@@ -132,6 +133,9 @@ void platform_main(int arg)
 {
     rcc_clock_setup_hse(&clock_72mhz);
 
+    // Enable cycle counter for profiling, runs at the core clock
+    cycle_counter_init(72000000);
+
     // LEDs
     rcc_periph_clock_enable(RCC_GPIOC);
     gpio_mode_setup(GPIOC, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, GPIO13 | GPIO14 | GPIO15);
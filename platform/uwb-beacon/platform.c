@@ -7,6 +7,7 @@
 #include <stddef.h>
 #include <bootloader.h>
 #include <boot_arg.h>
+#include <cycle_counter.h>
 #include <platform/mcu/armv7-m/timeout_timer.h>
 #include "platform.h"
 
@@ -67,6 +68,9 @@ void platform_main(int arg)
 {
     rcc_clock_setup_hse_3v3(&hse_16mhz_3v3[CLOCK_3V3_168MHZ]);
 
+    // Enable cycle counter for profiling, runs at the core clock
+    cycle_counter_init(168000000);
+
     rcc_periph_clock_enable(RCC_GPIOB);
 
     // CAN pin
@@ -0,0 +1,108 @@
+#include <string.h>
+#include "cycle_counter.h"
+#include "profiling.h"
+
+
+/**
+ * Recorded statistics by command index and phase
+ */
+static profiling_entry_t entries[PROFILING_COMMAND_SLOTS][PROFILING_PHASE_COUNT];
+
+/**
+ * Command index, to which records are currently attributed
+ */
+static uint8_t current_command;
+
+
+void profiling_set_command(uint8_t index)
+{
+    if (index >= PROFILING_COMMAND_SLOTS) {
+        index = 0;
+    }
+    current_command = index;
+}
+
+
+void profiling_record(profiling_phase_t phase, uint32_t cycles)
+{
+    if (phase >= PROFILING_PHASE_COUNT) {
+        return;
+    }
+
+    profiling_entry_t *entry = &entries[current_command][phase];
+
+    if (entry->count == 0 || cycles < entry->min) {
+        entry->min = cycles;
+    }
+    if (cycles > entry->max) {
+        entry->max = cycles;
+    }
+    entry->sum += cycles;
+    entry->count++;
+}
+
+
+const profiling_entry_t *profiling_get_entry(uint8_t index, profiling_phase_t phase)
+{
+    if (index >= PROFILING_COMMAND_SLOTS || phase >= PROFILING_PHASE_COUNT) {
+        return NULL;
+    }
+    return &entries[index][phase];
+}
+
+
+void profiling_reset(void)
+{
+    memset(entries, 0, sizeof(entries));
+    current_command = 0;
+}
+
+
+void profiling_write_frequency(cmp_ctx_t *out)
+{
+    uint32_t frequency = cycle_counter_get_frequency();
+    if (frequency == 0) {
+        cmp_write_nil(out);
+    } else {
+        cmp_write_uint(out, frequency);
+    }
+}
+
+
+void profiling_write_messagepack(cmp_ctx_t *out)
+{
+    uint32_t used = 0;
+    for (int i = 0; i < PROFILING_COMMAND_SLOTS; i++) {
+        for (int j = 0; j < PROFILING_PHASE_COUNT; j++) {
+            if (entries[i][j].count > 0) {
+                used++;
+            }
+        }
+    }
+
+    cmp_write_map(out, 2);
+
+    const char *frequency_key = "frequency";
+    cmp_write_str(out, frequency_key, strlen(frequency_key));
+    profiling_write_frequency(out);
+
+    const char *stats_key = "stats";
+    cmp_write_str(out, stats_key, strlen(stats_key));
+    cmp_write_array(out, used);
+
+    for (int i = 0; i < PROFILING_COMMAND_SLOTS; i++) {
+        for (int j = 0; j < PROFILING_PHASE_COUNT; j++) {
+            profiling_entry_t *entry = &entries[i][j];
+            if (entry->count == 0) {
+                continue;
+            }
+            cmp_write_array(out, 6);
+            cmp_write_uint(out, i);
+            cmp_write_uint(out, j);
+            cmp_write_uint(out, entry->count);
+            cmp_write_uint(out, entry->min);
+            cmp_write_uint(out, (uint32_t) (entry->sum / entry->count));
+            cmp_write_uint(out, entry->max);
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef PROFILING_H
+#define PROFILING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <cmp/cmp.h>
+
+
+/**
+ * Number of command indices, for which statistics are recorded;
+ * index 0 collects everything, that happens outside of a command
+ * e.g. the reassembly of a datagram, that turned out to be corrupt.
+ */
+#ifndef PROFILING_COMMAND_SLOTS
+#define PROFILING_COMMAND_SLOTS 24
+#endif
+
+
+/**
+ * The phases of datagram processing, which are timed individually
+ */
+typedef enum {
+    /** Reception and reassembly of the datagram's CAN frames */
+    PROFILING_PHASE_REASSEMBLY = 0,
+    /** Execution of the command handler (including all phases below) */
+    PROFILING_PHASE_EXECUTION,
+    /** CRC calculation over flash memory */
+    PROFILING_PHASE_CRC,
+    /** Erasing a flash page */
+    PROFILING_PHASE_FLASH_ERASE,
+    /** Programming data to flash */
+    PROFILING_PHASE_FLASH_WRITE,
+    /** Transmission of the reply datagram */
+    PROFILING_PHASE_REPLY,
+    PROFILING_PHASE_COUNT
+} profiling_phase_t;
+
+
+/**
+ * Statistics of one phase of one command
+ */
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+} profiling_entry_t;
+
+
+/**
+ * Sets the command index, to which all following records are attributed
+ *
+ * Indices outside of the profiled range are attributed to slot 0.
+ */
+void profiling_set_command(uint8_t index);
+
+/**
+ * Adds a measurement to the statistics of the current command
+ *
+ * @param phase     Phase, which was measured
+ * @param cycles    Duration in cycle counter ticks
+ */
+void profiling_record(profiling_phase_t phase, uint32_t cycles);
+
+/**
+ * Returns the statistics entry of a command/phase pair
+ *
+ * @retval NULL The command index is outside of the profiled range
+ */
+const profiling_entry_t *profiling_get_entry(uint8_t index, profiling_phase_t phase);
+
+/**
+ * Clears all recorded statistics
+ */
+void profiling_reset(void);
+
+/**
+ * Serializes the cycle counter frequency in ticks per second,
+ * or nil if the platform did not start the cycle counter
+ */
+void profiling_write_frequency(cmp_ctx_t *out);
+
+/**
+ * Serializes all non-empty entries as MessagePack map:
+ * {"frequency": ticks per second or nil,
+ *  "stats": [[command, phase, count, min, avg, max], ...]}
+ */
+void profiling_write_messagepack(cmp_ctx_t *out);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PROFILING_H */
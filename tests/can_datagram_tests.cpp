@@ -340,6 +340,192 @@ TEST(CANDatagramInputTestGroup, CanResetToStart)
     CHECK_EQUAL(42, datagram.data[0]);
 }
 
+TEST(CANDatagramInputTestGroup, ListedDestinationsAreAddressed)
+{
+    uint8_t buf[] = {
+        0x01, // protocol version
+        0x00, 0x00, 0x00, 0x00, // CRC
+        2, // destination node list length
+        2, 3 // destination nodes
+    };
+
+    input_data(buf, sizeof buf);
+
+    CHECK_TRUE(can_datagram_is_addressed(&datagram, 2));
+    CHECK_TRUE(can_datagram_is_addressed(&datagram, 3));
+    CHECK_FALSE(can_datagram_is_addressed(&datagram, 4));
+}
+
+TEST(CANDatagramInputTestGroup, DestinationsAreDecodedAfterLastNode)
+{
+    uint8_t buf[] = {
+        0x01, // protocol version
+        0x00, 0x00, 0x00, 0x00, // CRC
+        2, // destination node list length
+        2, 3 // destination nodes
+    };
+
+    input_data(buf, sizeof buf - 1);
+    CHECK_FALSE(can_datagram_destinations_are_decoded(&datagram));
+
+    input_data(&buf[sizeof buf - 1], 1);
+    CHECK_TRUE(can_datagram_destinations_are_decoded(&datagram));
+}
+
+TEST(CANDatagramInputTestGroup, CanReadBitmapDestinations)
+{
+    uint8_t buf[] = {
+        0x02, // protocol version
+        0x00, 0x00, 0x00, 0x00, // CRC
+        CAN_DATAGRAM_DESTINATION_BITMAP, // destination format
+        2, // destination length
+        0x02, 0x80 // nodes 1 and 15
+    };
+
+    input_data(buf, sizeof buf);
+
+    CHECK_TRUE(can_datagram_is_addressed(&datagram, 1));
+    CHECK_TRUE(can_datagram_is_addressed(&datagram, 15));
+    CHECK_FALSE(can_datagram_is_addressed(&datagram, 2));
+    CHECK_FALSE(can_datagram_is_addressed(&datagram, 16));
+}
+
+TEST(CANDatagramInputTestGroup, CanReadRangeDestinations)
+{
+    uint8_t buf[] = {
+        0x02, // protocol version
+        0x00, 0x00, 0x00, 0x00, // CRC
+        CAN_DATAGRAM_DESTINATION_RANGES, // destination format
+        4, // destination length
+        1, 127, // first range
+        0, 0 // second range
+    };
+
+    input_data(buf, sizeof buf);
+
+    for (int id = 0; id < 128; id++) {
+        CHECK_TRUE(can_datagram_is_addressed(&datagram, id));
+    }
+}
+
+TEST(CANDatagramInputTestGroup, DestinationsAreClearedOnStart)
+{
+    uint8_t buf[] = {
+        0x01, // protocol version
+        0x00, 0x00, 0x00, 0x00, // CRC
+        1, // destination node list length
+        2 // destination nodes
+    };
+
+    input_data(buf, sizeof buf);
+    can_datagram_start(&datagram);
+
+    CHECK_FALSE(can_datagram_is_addressed(&datagram, 2));
+}
+
+TEST(CANDatagramInputTestGroup, CompactDatagramIsValidWhenCRCMatches)
+{
+    uint8_t buf[] = {
+        0x02, // protocol version
+        0x3d, 0xc6, 0x1c, 0x01, // CRC, including the destination format
+        CAN_DATAGRAM_DESTINATION_BITMAP, // destination format
+        2, // destination length
+        0x00, 0x40, // node 14
+        0x00, 0x00, 0x00, 0x01, // data length
+        0x42 // data
+    };
+
+    input_data(buf, sizeof buf);
+
+    CHECK_TRUE(can_datagram_is_valid(&datagram));
+    CHECK_TRUE(can_datagram_is_addressed(&datagram, 14));
+    CHECK_EQUAL(0x42, datagram.data[0]);
+}
+
+TEST(CANDatagramInputTestGroup, CanBeAddressedByDeviceClass)
+{
+    uint8_t buf[] = {
+        0x02, // protocol version
+        0x00, 0x00, 0x00, 0x00, // CRC
+        CAN_DATAGRAM_DESTINATION_CLASS, // destination format
+        4, // destination length
+        0xa1, 0x73, 0xee, 0xdb // CRC32 of "CVRA.motor.v1"
+    };
+
+    input_data(buf, sizeof buf);
+
+    CHECK_TRUE(can_datagram_is_class_addressed(&datagram, "CVRA.motor.v1"));
+    CHECK_FALSE(can_datagram_is_class_addressed(&datagram, "CVRA.motor.v2"));
+    CHECK_FALSE(can_datagram_is_addressed(&datagram, 0xa1 & 0x7f));
+}
+
+TEST(CANDatagramInputTestGroup, CanBeAddressedByGroup)
+{
+    uint8_t buf[] = {
+        0x02, // protocol version
+        0x00, 0x00, 0x00, 0x00, // CRC
+        CAN_DATAGRAM_DESTINATION_GROUPS, // destination format
+        2, // destination length
+        3, 5 // groups
+    };
+
+    input_data(buf, sizeof buf);
+
+    CHECK_TRUE(can_datagram_is_group_addressed(&datagram, 5));
+    CHECK_FALSE(can_datagram_is_group_addressed(&datagram, 4));
+    CHECK_FALSE(can_datagram_is_group_addressed(&datagram, 0));
+    CHECK_FALSE(can_datagram_is_class_addressed(&datagram, ""));
+}
+
+TEST(CANDatagramInputTestGroup, NodeListIsNoGroup)
+{
+    uint8_t buf[] = {
+        0x01, // protocol version
+        0x00, 0x00, 0x00, 0x00, // CRC
+        1, // destination node list length
+        3 // destination nodes
+    };
+
+    input_data(buf, sizeof buf);
+
+    CHECK_FALSE(can_datagram_is_group_addressed(&datagram, 3));
+}
+
+TEST(CANDatagramInputTestGroup, ReplySlotIsRankAmongDestinations)
+{
+    uint8_t buf[] = {
+        0x02, // protocol version
+        0x00, 0x00, 0x00, 0x00, // CRC
+        CAN_DATAGRAM_FLAG_SLOTTED_REPLY | CAN_DATAGRAM_DESTINATION_LIST, // destination format
+        3, // destination length
+        42, 7, 12 // destination nodes
+    };
+
+    input_data(buf, sizeof buf);
+
+    CHECK_EQUAL(CAN_DATAGRAM_DESTINATION_LIST, datagram.destination_format);
+    CHECK_EQUAL(CAN_DATAGRAM_FLAG_SLOTTED_REPLY, datagram.destination_flags);
+    CHECK_EQUAL(0, can_datagram_reply_slot(&datagram, 7));
+    CHECK_EQUAL(1, can_datagram_reply_slot(&datagram, 12));
+    CHECK_EQUAL(2, can_datagram_reply_slot(&datagram, 42));
+}
+
+TEST(CANDatagramInputTestGroup, ReplySlotOfGroupMemberIsNodeID)
+{
+    uint8_t buf[] = {
+        0x02, // protocol version
+        0x00, 0x00, 0x00, 0x00, // CRC
+        CAN_DATAGRAM_FLAG_SLOTTED_REPLY | CAN_DATAGRAM_DESTINATION_GROUPS, // destination format
+        1, // destination length
+        3 // group
+    };
+
+    input_data(buf, sizeof buf);
+
+    CHECK_TRUE(can_datagram_is_group_addressed(&datagram, 3));
+    CHECK_EQUAL(42, can_datagram_reply_slot(&datagram, 42));
+}
+
 TEST_GROUP(CANDatagramOutputTestGroup)
 {
     can_datagram_t datagram;
@@ -469,6 +655,22 @@ TEST(CANDatagramOutputTestGroup, IfWeStopEarlierBytesWrittenIsReturned)
     CHECK_EQUAL(3, ret);
 }
 
+TEST(CANDatagramOutputTestGroup, CanOutputDestinationFormat)
+{
+    datagram.protocol_version = CAN_DATAGRAM_VERSION_COMPACT;
+    datagram.destination_format = CAN_DATAGRAM_DESTINATION_RANGES;
+    datagram.destination_nodes_len = 2;
+    datagram.destination_nodes[0] = 1;
+    datagram.destination_nodes[1] = 127;
+
+    can_datagram_output_bytes(&datagram, output, 9);
+
+    BYTES_EQUAL(CAN_DATAGRAM_DESTINATION_RANGES, output[5]);
+    BYTES_EQUAL(2, output[6]);
+    BYTES_EQUAL(1, output[7]);
+    BYTES_EQUAL(127, output[8]);
+}
+
 TEST_GROUP(CANIDTestGroup)
 {
 };
@@ -0,0 +1,95 @@
+#include <cstring>
+#include <CppUTest/TestHarness.h>
+#include <cmp_mem_access/cmp_mem_access.h>
+
+#include "../command.h"
+
+
+TEST_GROUP(CapabilitiesCommandTestGroup)
+{
+    cmp_mem_access_t out_cma;
+    cmp_ctx_t out_ctx;
+    char out_data[256];
+
+    void setup()
+    {
+        cmp_mem_access_init(&out_ctx, &out_cma, out_data, sizeof out_data);
+        memset(out_data, 0, sizeof out_data);
+
+        command_get_capabilities(0, NULL, &out_ctx, NULL);
+        cmp_mem_access_set_pos(&out_cma, 0);
+    }
+
+    /* Positions the reader at the value of the given key */
+    bool find(const char *key)
+    {
+        uint32_t size, key_len;
+        char buf[32];
+
+        cmp_mem_access_set_pos(&out_cma, 0);
+        cmp_read_map(&out_ctx, &size);
+
+        for (uint32_t i = 0; i < size; i++) {
+            key_len = sizeof buf;
+            cmp_read_str(&out_ctx, buf, &key_len);
+            if (!strcmp(buf, key)) {
+                return true;
+            }
+
+            // Skip the value, which is an integer or an array of integers
+            cmp_object_t value;
+            cmp_read_object(&out_ctx, &value);
+            uint32_t elements = 0;
+            cmp_object_as_array(&value, &elements);
+            while (elements-- > 0) {
+                cmp_read_object(&out_ctx, &value);
+            }
+        }
+        return false;
+    }
+};
+
+TEST(CapabilitiesCommandTestGroup, BufferSizesAreReported)
+{
+    uint32_t value;
+
+    CHECK_TRUE(find("input_buffer"));
+    cmp_read_uint(&out_ctx, &value);
+    CHECK_EQUAL(INPUT_BUFFER_SIZE, value);
+
+    CHECK_TRUE(find("output_buffer"));
+    cmp_read_uint(&out_ctx, &value);
+    CHECK_EQUAL(OUTPUT_BUFFER_SIZE, value);
+}
+
+TEST(CapabilitiesCommandTestGroup, CommandsAreListed)
+{
+    uint32_t size, index;
+
+    CHECK_TRUE(find("commands"));
+    cmp_read_array(&out_ctx, &size);
+    CHECK_EQUAL(COMMAND_COUNT, size);
+
+    for (uint32_t i = 0; i < size; i++) {
+        cmp_read_uint(&out_ctx, &index);
+        CHECK_TRUE(get_command_by_index(index) != NULL);
+    }
+}
+
+TEST(CapabilitiesCommandTestGroup, CompactDatagramsAreSupported)
+{
+    uint32_t features;
+
+    CHECK_TRUE(find("features"));
+    cmp_read_uint(&out_ctx, &features);
+    CHECK_TRUE(features & CAPABILITY_COMPACT_DATAGRAMS);
+}
+
+TEST(CapabilitiesCommandTestGroup, AtLeastOneDatagramBufferIsReported)
+{
+    uint32_t buffers;
+
+    CHECK_TRUE(find("datagram_buffers"));
+    cmp_read_uint(&out_ctx, &buffers);
+    CHECK_TRUE(buffers >= 1);
+}
@@ -0,0 +1,147 @@
+#include <cstring>
+#include <CppUTest/TestHarness.h>
+#include <cmp_mem_access/cmp_mem_access.h>
+
+#include "../command_queue.h"
+#include "../command.h"
+#include "../error.h"
+
+
+TEST_GROUP(CommandQueueTestGroup)
+{
+    cmp_mem_access_t command_cma;
+    cmp_ctx_t command_builder;
+    char command_data[32];
+    size_t command_len;
+
+    cmp_mem_access_t out_cma;
+    cmp_ctx_t out_ctx;
+    char out_data[64];
+
+    bootloader_config_t config;
+
+    void setup()
+    {
+        command_queue_init();
+        memset(&config, 0, sizeof config);
+
+        // Encoded ping command
+        cmp_mem_access_init(&command_builder, &command_cma, command_data, sizeof command_data);
+        cmp_write_uint(&command_builder, COMMAND_SET_VERSION);
+        cmp_write_uint(&command_builder, 5);
+        cmp_write_array(&command_builder, 0);
+        command_len = cmp_mem_access_get_pos(&command_cma);
+
+        cmp_mem_access_init(&out_ctx, &out_cma, out_data, sizeof out_data);
+        memset(out_data, 0, sizeof out_data);
+    }
+};
+
+TEST(CommandQueueTestGroup, SubmittedJobIsQueued)
+{
+    CHECK_EQUAL(JOB_STATE_QUEUED, command_queue_submit(42, command_data, command_len));
+    CHECK_TRUE(command_queue_pending());
+    CHECK_EQUAL(42, command_queue_find(42)->token);
+}
+
+TEST(CommandQueueTestGroup, ProcessingExecutesCommand)
+{
+    command_queue_submit(42, command_data, command_len);
+
+    CHECK_TRUE(command_queue_process(&config));
+
+    const command_job_t *job = command_queue_find(42);
+    CHECK_EQUAL(JOB_STATE_DONE, job->state);
+    CHECK_EQUAL(1, job->result_len);
+    CHECK_EQUAL(0xc3, job->result[0]); // MessagePack true
+    CHECK_FALSE(command_queue_process(&config));
+}
+
+TEST(CommandQueueTestGroup, DuplicateTokenIsNotExecutedTwice)
+{
+    command_queue_submit(42, command_data, command_len);
+    command_queue_process(&config);
+
+    CHECK_EQUAL(JOB_STATE_DONE, command_queue_submit(42, command_data, command_len));
+    CHECK_FALSE(command_queue_pending());
+}
+
+TEST(CommandQueueTestGroup, FullQueueRejectsJobs)
+{
+    for (int i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+        command_queue_submit(i, command_data, command_len);
+    }
+
+    CHECK_EQUAL(JOB_STATE_UNKNOWN, command_queue_submit(100, command_data, command_len));
+}
+
+TEST(CommandQueueTestGroup, FinishedJobsAreRecycled)
+{
+    for (int i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+        command_queue_submit(i, command_data, command_len);
+        command_queue_process(&config);
+    }
+
+    CHECK_EQUAL(JOB_STATE_QUEUED, command_queue_submit(100, command_data, command_len));
+    POINTERS_EQUAL(NULL, command_queue_find(0));
+    CHECK_TRUE(command_queue_find(1) != NULL);
+}
+
+TEST(CommandQueueTestGroup, StatusReportsJobResult)
+{
+    cmp_mem_access_t arg_cma;
+    cmp_ctx_t arg_ctx;
+    char arg_data[8];
+    uint32_t size, value;
+    bool result;
+
+    command_queue_submit(42, command_data, command_len);
+    command_queue_process(&config);
+
+    cmp_mem_access_init(&arg_ctx, &arg_cma, arg_data, sizeof arg_data);
+    cmp_write_uint(&arg_ctx, 42);
+    cmp_mem_access_set_pos(&arg_cma, 0);
+
+    command_get_status(1, &arg_ctx, &out_ctx, &config);
+    cmp_mem_access_set_pos(&out_cma, 0);
+
+    cmp_read_array(&out_ctx, &size);
+    CHECK_EQUAL(3, size);
+    cmp_read_uint(&out_ctx, &value);
+    CHECK_EQUAL(42, value);
+    cmp_read_uint(&out_ctx, &value);
+    CHECK_EQUAL(JOB_STATE_DONE, value);
+    CHECK_TRUE(cmp_read_bool(&out_ctx, &result));
+    CHECK_TRUE(result);
+}
+
+TEST(CommandQueueTestGroup, SubmitCommandRepliesAccepted)
+{
+    cmp_mem_access_t arg_cma;
+    cmp_ctx_t arg_ctx;
+    char arg_data[64];
+    uint32_t reply;
+
+    cmp_mem_access_init(&arg_ctx, &arg_cma, arg_data, sizeof arg_data);
+    cmp_write_uint(&arg_ctx, 7);
+    cmp_write_bin(&arg_ctx, command_data, command_len);
+    cmp_mem_access_set_pos(&arg_cma, 0);
+
+    command_submit_async(2, &arg_ctx, &out_ctx, &config);
+    cmp_mem_access_set_pos(&out_cma, 0);
+
+    cmp_read_uint(&out_ctx, &reply);
+    CHECK_EQUAL(JOB_STATE_QUEUED, reply);
+    CHECK_EQUAL(JOB_STATE_QUEUED, command_queue_find(7)->state);
+}
+
+TEST(CommandQueueTestGroup, SubmitCommandRejectsMissingArguments)
+{
+    uint32_t reply;
+
+    command_submit_async(0, NULL, &out_ctx, &config);
+    cmp_mem_access_set_pos(&out_cma, 0);
+
+    cmp_read_uint(&out_ctx, &reply);
+    CHECK_EQUAL(ASYNC_ERROR_MALFORMED, reply);
+}
@@ -5,6 +5,8 @@
 
 #include "../flash_writer.h"
 #include "../command.h"
+#include "../can_datagram.h"
+#include "../error.h"
 #include "mocks/platform_mock.h"
 
 
@@ -48,6 +50,69 @@ TEST(ConfigCommandTestGroup, CanChangeNodeID)
     CHECK_TRUE(ret);
 }
 
+TEST(ConfigCommandTestGroup, CannotUseReservedClientID)
+{
+    config.ID = 42;
+
+    cmp_write_map(&write_ctx, 1);
+
+    cmp_write_str(&write_ctx, "ID", 2);
+    cmp_write_u8(&write_ctx, CLIENT_ID_MIN);
+
+    cmp_mem_access_set_pos(&write_cma, 0);
+
+    command_config_update(1, &write_ctx, &read_ctx, &config);
+
+    CHECK_EQUAL(42, config.ID);
+
+    uint32_t ret = 0;
+    cmp_mem_access_set_pos(&read_cma, 0);
+    cmp_read_uint(&read_ctx, &ret);
+    CHECK_EQUAL(CONFIG_ERROR_RESERVED_ID, ret);
+}
+
+TEST(ConfigCommandTestGroup, CannotUseDefaultClientID)
+{
+    config.ID = 42;
+
+    cmp_write_map(&write_ctx, 1);
+
+    cmp_write_str(&write_ctx, "ID", 2);
+    cmp_write_u8(&write_ctx, 0);
+
+    cmp_mem_access_set_pos(&write_cma, 0);
+
+    command_config_update(1, &write_ctx, &read_ctx, &config);
+
+    CHECK_EQUAL(42, config.ID);
+
+    uint32_t ret = 0;
+    cmp_mem_access_set_pos(&read_cma, 0);
+    cmp_read_uint(&read_ctx, &ret);
+    CHECK_EQUAL(CONFIG_ERROR_RESERVED_ID, ret);
+}
+
+TEST(ConfigCommandTestGroup, RejectedUpdateLeavesConfigUnchanged)
+{
+    config.ID = 42;
+    strcpy(config.board_name, "foo");
+
+    cmp_write_map(&write_ctx, 2);
+
+    cmp_write_str(&write_ctx, "name", 4);
+    cmp_write_str(&write_ctx, "bar", 3);
+
+    cmp_write_str(&write_ctx, "ID", 2);
+    cmp_write_u8(&write_ctx, CLIENT_ID_MIN);
+
+    cmp_mem_access_set_pos(&write_cma, 0);
+
+    command_config_update(1, &write_ctx, &read_ctx, &config);
+
+    CHECK_EQUAL(42, config.ID);
+    STRCMP_EQUAL("foo", config.board_name);
+}
+
 TEST(ConfigCommandTestGroup, CanReadConfig)
 {
     bootloader_config_t read_config;
@@ -64,3 +129,22 @@ TEST(ConfigCommandTestGroup, CanReadConfig)
     // The rest is tested in ConfigSerializationTest
     CHECK_EQUAL(config.ID, read_config.ID);
 }
+
+TEST(ConfigCommandTestGroup, CannotChangeVerifiedMarker)
+{
+    config.application_verified_crc = 0x1234;
+    config.application_verified_count = 3;
+
+    cmp_write_map(&write_ctx, 2);
+    cmp_write_str(&write_ctx, CONFIG_KEY_VERIFIED_CRC, strlen(CONFIG_KEY_VERIFIED_CRC));
+    cmp_write_uint(&write_ctx, 0xdead);
+    cmp_write_str(&write_ctx, CONFIG_KEY_VERIFIED_COUNT, strlen(CONFIG_KEY_VERIFIED_COUNT));
+    cmp_write_uint(&write_ctx, 42);
+
+    cmp_mem_access_set_pos(&write_cma, 0);
+
+    command_config_update(1, &write_ctx, &read_ctx, &config);
+
+    CHECK_EQUAL(0x1234, config.application_verified_crc);
+    CHECK_EQUAL(3, config.application_verified_count);
+}
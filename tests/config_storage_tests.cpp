@@ -0,0 +1,118 @@
+#include <cstring>
+#include <CppUTest/TestHarness.h>
+#include <CppUTestExt/MockSupport.h>
+#include "mocks/platform_mock.h"
+#include "../config_storage.h"
+
+
+TEST_GROUP(ConfigStorageTestGroup)
+{
+    bootloader_config_t config;
+    bootloader_config_t loaded;
+
+    void setup()
+    {
+        // Erased flash
+        memset(memory_mock_config1, 0xff, sizeof(memory_mock_config1));
+        memset(memory_mock_config2, 0xff, sizeof(memory_mock_config2));
+
+        memset(&config, 0, sizeof config);
+        config.ID = 1;
+        strcpy(config.board_name, "foo");
+        strcpy(config.device_class, "bar");
+        config.update_count = 1;
+
+        mock("flash").ignoreOtherCalls();
+    }
+
+    void teardown()
+    {
+        mock().checkExpectations();
+        mock().clear();
+    }
+};
+
+TEST(ConfigStorageTestGroup, ErasedPagesAreInvalid)
+{
+    CHECK_FALSE(config_load(&loaded));
+}
+
+TEST(ConfigStorageTestGroup, CanLoadSavedConfig)
+{
+    CHECK_TRUE(config_save(&config));
+    CHECK_TRUE(config_load(&loaded));
+
+    CHECK_EQUAL(1, loaded.ID);
+    STRCMP_EQUAL("foo", loaded.board_name);
+    STRCMP_EQUAL("bar", loaded.device_class);
+}
+
+TEST(ConfigStorageTestGroup, SaveAppendsWithoutErasing)
+{
+    config_save(&config);
+    mock().clear();
+
+    mock("flash").expectNoCall("page_erase");
+    mock("flash").ignoreOtherCalls();
+
+    config.ID = 2;
+    CHECK_TRUE(config_save(&config));
+    CHECK_TRUE(config_load(&loaded));
+    CHECK_EQUAL(2, loaded.ID);
+
+    // The second page is not touched
+    CHECK_EQUAL(0xff, memory_mock_config2[0]);
+}
+
+TEST(ConfigStorageTestGroup, FullPageIsCompactedIntoOtherPage)
+{
+    const config_record_header_t *first = (config_record_header_t *) memory_mock_config2;
+    int saves = 0;
+
+    while (first->marker != CONFIG_RECORD_MARKER && saves < CONFIG_LOG_SIZE) {
+        config.ID = saves++;
+        CHECK_TRUE(config_save(&config));
+    }
+
+    CHECK_TRUE(saves > 1);
+    CHECK_TRUE(config_load(&loaded));
+    CHECK_EQUAL(config.ID, loaded.ID);
+}
+
+TEST(ConfigStorageTestGroup, InterruptedRecordIsIgnored)
+{
+    config_save(&config);
+    const config_record_header_t *first = (config_record_header_t *) memory_mock_config1;
+    uint8_t *second = &memory_mock_config1[(sizeof(*first) + first->length + 3) & ~3u];
+
+    config.ID = 2;
+    config_save(&config);
+
+    // Corrupt the payload of the newest record
+    second[sizeof(config_record_header_t)] ^= 0xff;
+
+    CHECK_TRUE(config_load(&loaded));
+    CHECK_EQUAL(1, loaded.ID);
+}
+
+TEST(ConfigStorageTestGroup, CanLoadLegacyPage)
+{
+    config_write(memory_mock_config2, &config, CONFIG_PAGE_SIZE);
+
+    CHECK_TRUE(config_load(&loaded));
+    STRCMP_EQUAL("foo", loaded.board_name);
+}
+
+TEST(ConfigStorageTestGroup, LegacyPageIsKeptUntilRecordIsWritten)
+{
+    config_write(memory_mock_config1, &config, CONFIG_PAGE_SIZE);
+
+    mock().clear();
+    mock("flash").expectOneCall("page_erase").withPointerParameter("adress", memory_mock_config2);
+    mock("flash").ignoreOtherCalls();
+
+    config.ID = 2;
+    CHECK_TRUE(config_save(&config));
+    CHECK_TRUE(config_load(&loaded));
+    CHECK_EQUAL(2, loaded.ID);
+}
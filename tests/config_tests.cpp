@@ -51,6 +51,15 @@ TEST(ConfigTest, CanSerializeNodeID)
     CHECK_EQUAL(config.ID, result.ID);
 }
 
+TEST(ConfigTest, CanSerializeGroup)
+{
+    config.group = 3;
+
+    config_read_and_write();
+
+    CHECK_EQUAL(3, result.group);
+}
+
 TEST(ConfigTest, CanSerializeNodeName)
 {
     strncpy(config.board_name, "test.dummy", 64);
@@ -95,3 +104,34 @@ TEST(ConfigTest, CanSerializeUpdateCount)
 
     CHECK_EQUAL(23, result.update_count);
 }
+
+TEST(ConfigTest, CanSerializeVerifiedMarker)
+{
+    config.application_crc = 0xdeadbeef;
+    config.update_count = 23;
+    config_application_set_verified(&config);
+
+    config_read_and_write();
+
+    CHECK_EQUAL(0xdeadbeef, result.application_verified_crc);
+    CHECK_EQUAL(23, result.application_verified_count);
+    CHECK_TRUE(config_application_is_verified(&result));
+}
+
+TEST(ConfigTest, VerifiedMarkerRequiresMatchingCRC)
+{
+    config.application_crc = 0xdeadbeef;
+    config.update_count = 23;
+    config_application_set_verified(&config);
+
+    config.application_crc = 0xcafebabe;
+
+    CHECK_FALSE(config_application_is_verified(&config));
+}
+
+TEST(ConfigTest, ClearedMarkerIsNotVerified)
+{
+    config_application_clear_verified(&config);
+
+    CHECK_FALSE(config_application_is_verified(&config));
+}
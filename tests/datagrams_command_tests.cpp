@@ -280,3 +280,29 @@ TEST(ProtocolOutputCommand, BytesCountIsReturned)
     CHECK_EQUAL(6, result);
 }
 
+
+TEST(ProtocolOutputCommand, TrueAndOneAreSuccessReplies)
+{
+    const char reply_true[] = {(char) 0xc3};
+    const char reply_one[] = {0x01};
+
+    CHECK_TRUE(command_reply_is_success(reply_true, 1));
+    CHECK_TRUE(command_reply_is_success(reply_one, 1));
+}
+
+TEST(ProtocolOutputCommand, ErrorCodesAreNoSuccessReplies)
+{
+    const char reply_false[] = {(char) 0xc2};
+    const char reply_error[] = {0x0b};
+
+    CHECK_FALSE(command_reply_is_success(reply_false, 1));
+    CHECK_FALSE(command_reply_is_success(reply_error, 1));
+    CHECK_FALSE(command_reply_is_success(reply_error, -ERR_COMMAND_NOT_FOUND));
+}
+
+TEST(ProtocolOutputCommand, LongerRepliesAreNoSuccessReplies)
+{
+    const char reply[] = {0x01, 0x01};
+
+    CHECK_FALSE(command_reply_is_success(reply, 2));
+}
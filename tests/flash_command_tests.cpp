@@ -6,7 +6,10 @@
 #include "mocks/platform_mock.h"
 #include "../flash_writer.h"
 #include "../command.h"
+#include "../config_storage.h"
+#include "../error.h"
 #include "../boot_arg.h"
+#include "../boot_trace.h"
 
 
 TEST_GROUP(FlashCommandTestGroup)
@@ -30,6 +33,7 @@ TEST_GROUP(FlashCommandTestGroup)
         memset(out_data, 0, sizeof out_data);
 
         // Creates a dummy device class for testing
+        memset(&config, 0, sizeof config);
         strcpy(config.device_class, "test.dummy");
 
         // Erases flash memory
@@ -228,9 +232,188 @@ TEST(FlashCommandTestGroup, DoesNotErasePastEndOfFlash)
 
 }
 
+TEST(FlashCommandTestGroup, DeviceClassMayBeOmittedWhenClassAddressed)
+{
+    const char *data = "xkcd";
+
+    cmp_write_u64(&command_builder, (size_t)memory_mock_app);
+    cmp_write_bin(&command_builder, data, strlen(data));
+
+    mock("flash").expectOneCall("unlock");
+    mock("flash").expectOneCall("lock");
+    mock("flash").expectOneCall("page_write")
+    .withPointerParameter("page_adress", memory_mock_app)
+    .withIntParameter("size", strlen(data));
+
+    cmp_mem_access_set_pos(&command_cma, 0);
+    command_set_device_class_addressed(true);
+    command_write_flash(2, &command_builder, &out, &config);
+    command_set_device_class_addressed(false);
+
+    STRCMP_EQUAL(data, (char *)memory_mock_app);
+}
+
+TEST(FlashCommandTestGroup, MissingDeviceClassIsRejected)
+{
+    const char *data = "xkcd";
+
+    cmp_write_u64(&command_builder, (size_t)memory_mock_app);
+    cmp_write_bin(&command_builder, data, strlen(data));
+
+    cmp_mem_access_set_pos(&command_cma, 0);
+    command_write_flash(2, &command_builder, &out, &config);
+
+    // No flash operation should have occured
+    mock().checkExpectations();
+
+    uint32_t ret = 0;
+    cmp_mem_access_set_pos(&out_cma, 0);
+    cmp_read_uint(&out, &ret);
+    CHECK_EQUAL(FLASH_WRITE_ERROR_DEVICE_CLASS_MISMATCH, ret);
+}
+
+TEST(FlashCommandTestGroup, DeviceClassMayBeOmittedForErasePage)
+{
+    cmp_write_u64(&command_builder, (size_t)memory_mock_app);
+
+    mock("flash").expectOneCall("unlock");
+    mock("flash").expectOneCall("lock");
+    mock("flash").expectOneCall("page_erase")
+    .withPointerParameter("adress", memory_mock_app);
+
+    cmp_mem_access_set_pos(&command_cma, 0);
+    command_set_device_class_addressed(true);
+    command_erase_flash_page(1, &command_builder, &out, &config);
+    command_set_device_class_addressed(false);
+}
+
+TEST_GROUP(FlashSessionTestGroup)
+{
+    bootloader_config_t config;
+    char out_data[64];
+
+    void setup()
+    {
+        memset(&config, 0, sizeof config);
+        strcpy(config.device_class, "test.dummy");
+
+        // Erased flash memory
+        memset(memory_mock_app, 0xff, sizeof(memory_mock_app));
+
+        mock("flash").ignoreOtherCalls();
+    }
+
+    void teardown()
+    {
+        mock().checkExpectations();
+        mock().clear();
+    }
+
+    unsigned int session(uint32_t size, uint32_t crc)
+    {
+        char command_data[32];
+        cmp_mem_access_t command_cma, out_cma;
+        cmp_ctx_t command_builder, out;
+
+        cmp_mem_access_init(&command_builder, &command_cma, command_data, sizeof command_data);
+        cmp_write_uint(&command_builder, (size_t)memory_mock_app);
+        cmp_write_uint(&command_builder, size);
+        cmp_write_uint(&command_builder, crc);
+        cmp_mem_access_set_pos(&command_cma, 0);
+
+        cmp_mem_access_init(&out, &out_cma, out_data, sizeof out_data);
+        command_flash_session(3, &command_builder, &out, &config);
+
+        unsigned int written = 0;
+        cmp_mem_access_set_pos(&out_cma, 0);
+        cmp_read_uint(&out, &written);
+        return written;
+    }
+
+    void write(size_t offset, const char *data)
+    {
+        char command_data[64];
+        cmp_mem_access_t command_cma, out_cma;
+        cmp_ctx_t command_builder, out;
+
+        cmp_mem_access_init(&command_builder, &command_cma, command_data, sizeof command_data);
+        cmp_write_uint(&command_builder, (size_t)&memory_mock_app[offset]);
+        cmp_write_str(&command_builder, config.device_class, strlen(config.device_class));
+        cmp_write_bin(&command_builder, data, strlen(data));
+        cmp_mem_access_set_pos(&command_cma, 0);
+
+        cmp_mem_access_init(&out, &out_cma, out_data, sizeof out_data);
+        command_write_flash(3, &command_builder, &out, &config);
+    }
+};
+
+TEST(FlashSessionTestGroup, NewSessionHasNothingWritten)
+{
+    CHECK_EQUAL(0, session(8, 0x1234));
+}
+
+TEST(FlashSessionTestGroup, ContiguousWritesAdvanceMark)
+{
+    session(8, 0x2345);
+
+    write(0, "abcd");
+    write(4, "efgh");
+
+    CHECK_EQUAL(8, session(8, 0x2345));
+}
+
+TEST(FlashSessionTestGroup, WriteAfterGapDoesNotAdvanceMark)
+{
+    session(8, 0x3456);
+
+    // Not erased
+    memset(memory_mock_app, 0, 4);
+    write(4, "efgh");
+
+    CHECK_EQUAL(0, session(8, 0x3456));
+}
+
+TEST(FlashSessionTestGroup, WriteAfterErasedPagesAdvancesMark)
+{
+    session(8, 0x3457);
+
+    // Erased pages of the image are skipped by the client
+    write(4, "efgh");
+
+    CHECK_EQUAL(8, session(8, 0x3457));
+}
+
+TEST(FlashSessionTestGroup, WriteBeyondImageDoesNotAdvanceMark)
+{
+    session(4, 0x3458);
+
+    write(0, "abcdefgh");
+
+    CHECK_EQUAL(0, session(4, 0x3458));
+}
+
+TEST(FlashSessionTestGroup, OtherImageBeginsNewSession)
+{
+    session(8, 0x4567);
+    write(0, "abcd");
+
+    CHECK_EQUAL(0, session(8, 0x5678));
+}
+
 TEST_GROUP(JumpToApplicationCodetestGroup)
 {
     bootloader_config_t config;
+
+    void setup()
+    {
+        memset(&config, 0, sizeof config);
+        config.bootloader_commit = (char *) "commit";
+        config.bootloader_version = (char *) "version";
+        config.update_count = 1;
+        memset(memory_mock_config1, 0, sizeof(memory_mock_config1));
+        memset(memory_mock_config2, 0, sizeof(memory_mock_config2));
+    }
+
     void teardown()
     {
         mock().checkExpectations();
@@ -250,7 +433,144 @@ TEST(JumpToApplicationCodetestGroup, CanJumpToApplication)
     // Expect to reboot into application
     mock().expectOneCall("reboot").withIntParameter("arg", BOOT_ARG_START_APPLICATION);
 
+    // The verified marker is saved to the config pages
+    mock("flash").ignoreOtherCalls();
+
+    command_jump_to_application(0, NULL, NULL, &config);
+}
+
+TEST(JumpToApplicationCodetestGroup, ValidCRCIsRemembered)
+{
+    memset(&memory_mock_app[0], 0x2a, sizeof(memory_mock_app));
+    config.application_size = sizeof(memory_mock_app);
+    config.application_crc = crc32(0, &memory_mock_app[0], sizeof(memory_mock_app));
+
+    mock().expectOneCall("reboot").withIntParameter("arg", BOOT_ARG_START_APPLICATION);
+    mock("flash").ignoreOtherCalls();
+
     command_jump_to_application(0, NULL, NULL, &config);
+
+    CHECK_TRUE(config_application_is_verified(&config));
+
+    bootloader_config_t saved;
+    CHECK_TRUE(config_load(&saved));
+    CHECK_EQUAL(config.application_crc, saved.application_verified_crc);
+    CHECK_EQUAL(config.update_count, saved.application_verified_count);
+}
+
+TEST(JumpToApplicationCodetestGroup, VerifiedApplicationSkipsCRC)
+{
+    memset(&memory_mock_app[0], 0x2a, sizeof(memory_mock_app));
+    config.application_size = sizeof(memory_mock_app);
+
+    // The CRC would not match, so the application must not be read at all
+    config.application_crc = 0xbad ^ crc32(0, &memory_mock_app[0], sizeof(memory_mock_app));
+    config_application_set_verified(&config);
+
+    // No flash access is expected
+    mock().expectOneCall("reboot").withIntParameter("arg", BOOT_ARG_START_APPLICATION);
+
+    command_jump_to_application(0, NULL, NULL, &config);
+}
+
+TEST(JumpToApplicationCodetestGroup, UpdateCountInvalidatesVerifiedMarker)
+{
+    memset(&memory_mock_app[0], 0x2a, sizeof(memory_mock_app));
+    config.application_size = sizeof(memory_mock_app);
+    config.application_crc = 0xbad ^ crc32(0, &memory_mock_app[0], sizeof(memory_mock_app));
+    config_application_set_verified(&config);
+
+    config.update_count++;
+
+    mock().expectOneCall("reboot").withIntParameter("arg", BOOT_ARG_START_BOOTLOADER_NO_TIMEOUT);
+
+    command_jump_to_application(0, NULL, NULL, &config);
+}
+
+TEST(JumpToApplicationCodetestGroup, JumpIsTraced)
+{
+    config.application_crc = 0x1234;
+    config_application_set_verified(&config);
+    boot_trace_start();
+
+    mock().expectOneCall("reboot").withIntParameter("arg", BOOT_ARG_START_APPLICATION);
+
+    command_jump_to_application(0, NULL, NULL, &config);
+
+    const boot_trace_t *trace = boot_trace_get();
+    CHECK_EQUAL(2, trace->count);
+    CHECK_EQUAL(BOOT_TRACE_APP_CRC, trace->entries[0].phase);
+    CHECK_EQUAL(BOOT_TRACE_JUMP, trace->entries[1].phase);
+}
+
+TEST(JumpToApplicationCodetestGroup, BootTraceCanBeRead)
+{
+    cmp_mem_access_t out_cma;
+    cmp_ctx_t out;
+    char out_data[128];
+    char key[16];
+    uint32_t size, value;
+
+    boot_trace_start();
+    boot_trace_record(BOOT_TRACE_RESET);
+    boot_trace_record(BOOT_TRACE_CLOCK);
+
+    cmp_mem_access_init(&out, &out_cma, out_data, sizeof out_data);
+    command_get_boot_trace(0, NULL, &out, &config);
+    cmp_mem_access_set_pos(&out_cma, 0);
+
+    cmp_read_map(&out, &size);
+    CHECK_EQUAL(2, size);
+    size = sizeof key;
+    cmp_read_str(&out, key, &size);
+    STRCMP_EQUAL("frequency", key);
+    cmp_read_uint(&out, &value);
+
+    size = sizeof key;
+    cmp_read_str(&out, key, &size);
+    STRCMP_EQUAL("trace", key);
+    cmp_read_array(&out, &size);
+    CHECK_EQUAL(2, size);
+
+    cmp_read_array(&out, &size);
+    CHECK_EQUAL(2, size);
+    cmp_read_uint(&out, &value);
+    CHECK_EQUAL(BOOT_TRACE_RESET, value);
+    cmp_read_uint(&out, &value);
+
+    cmp_read_array(&out, &size);
+    cmp_read_uint(&out, &value);
+    CHECK_EQUAL(BOOT_TRACE_CLOCK, value);
+}
+
+TEST(JumpToApplicationCodetestGroup, ModifyingApplicationClearsVerifiedMarker)
+{
+    cmp_mem_access_t cma;
+    cmp_ctx_t args;
+    char args_data[64];
+    cmp_mem_access_t out_cma;
+    cmp_ctx_t out;
+    char out_data[16];
+
+    strcpy(config.device_class, "test.dummy");
+    config.application_crc = 0x1234;
+    config_application_set_verified(&config);
+
+    cmp_mem_access_init(&args, &cma, args_data, sizeof args_data);
+    cmp_write_uint(&args, (size_t)&memory_mock_app[0]);
+    cmp_write_str(&args, config.device_class, strlen(config.device_class));
+    cmp_mem_access_set_pos(&cma, 0);
+    cmp_mem_access_init(&out, &out_cma, out_data, sizeof out_data);
+
+    mock("flash").ignoreOtherCalls();
+
+    command_erase_flash_page(2, &args, &out, &config);
+
+    CHECK_FALSE(config_application_is_verified(&config));
+
+    bootloader_config_t saved;
+    CHECK_TRUE(config_load(&saved));
+    CHECK_EQUAL(0, saved.application_verified_count);
 }
 
 TEST(JumpToApplicationCodetestGroup, WrongCRCMeansReboot)
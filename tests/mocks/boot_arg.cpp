@@ -3,9 +3,36 @@
 
 extern "C" {
 #include "../../boot_arg.h"
+#include "../../boot_trace.h"
 }
 
 void reboot_system(uint8_t arg)
 {
     mock().actualCall("reboot").withIntParameter("arg", arg);
 }
+
+/* On the host, the trace is kept in a regular buffer without boot arguments. */
+static uint32_t boot_trace_ram[2 + sizeof(boot_trace_t) / sizeof(uint32_t)];
+
+void boot_trace_start(void)
+{
+    boot_trace_t *trace = (boot_trace_t *) &boot_trace_ram[2];
+    trace->count = 0;
+    trace->magic = BOOT_TRACE_MAGIC;
+}
+
+void boot_trace_record(boot_trace_phase_t phase)
+{
+    boot_trace_t *trace = (boot_trace_t *) &boot_trace_ram[2];
+    if (trace->count >= BOOT_TRACE_LENGTH) {
+        return;
+    }
+    trace->entries[trace->count].phase = phase;
+    trace->entries[trace->count].cycles = trace->count;
+    trace->count++;
+}
+
+const boot_trace_t *boot_trace_get(void)
+{
+    return boot_trace_at(boot_trace_ram);
+}
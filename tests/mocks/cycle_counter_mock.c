@@ -0,0 +1,23 @@
+#include <time.h>
+#include "../../cycle_counter.h"
+
+/*
+ * On the host the cycle counter is emulated using a monotonic clock
+ * with nanosecond resolution.
+ */
+
+void cycle_counter_init(uint32_t frequency)
+{
+}
+
+uint32_t cycle_counter_get(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t) (now.tv_sec * 1000000000ull + now.tv_nsec);
+}
+
+uint32_t cycle_counter_get_frequency(void)
+{
+    return 1000000000;
+}
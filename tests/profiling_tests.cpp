@@ -0,0 +1,106 @@
+#include <cstring>
+#include <CppUTest/TestHarness.h>
+#include <cmp_mem_access/cmp_mem_access.h>
+
+#include "../profiling.h"
+#include "../command.h"
+
+
+TEST_GROUP(ProfilingTestGroup)
+{
+    cmp_mem_access_t cma;
+    cmp_ctx_t ctx;
+    char data[1024];
+
+    void setup()
+    {
+        profiling_reset();
+        cmp_mem_access_init(&ctx, &cma, data, sizeof data);
+        memset(data, 0, sizeof data);
+    }
+};
+
+TEST(ProfilingTestGroup, RecordsMinMaxAndSum)
+{
+    profiling_set_command(4);
+    profiling_record(PROFILING_PHASE_FLASH_WRITE, 30);
+    profiling_record(PROFILING_PHASE_FLASH_WRITE, 10);
+    profiling_record(PROFILING_PHASE_FLASH_WRITE, 20);
+
+    const profiling_entry_t *entry = profiling_get_entry(4, PROFILING_PHASE_FLASH_WRITE);
+    CHECK_EQUAL(3, entry->count);
+    CHECK_EQUAL(10, entry->min);
+    CHECK_EQUAL(30, entry->max);
+    CHECK_EQUAL(60, entry->sum);
+}
+
+TEST(ProfilingTestGroup, OutOfRangeCommandGoesToSlotZero)
+{
+    profiling_set_command(PROFILING_COMMAND_SLOTS);
+    profiling_record(PROFILING_PHASE_EXECUTION, 5);
+
+    CHECK_EQUAL(1, profiling_get_entry(0, PROFILING_PHASE_EXECUTION)->count);
+    POINTERS_EQUAL(NULL, profiling_get_entry(PROFILING_COMMAND_SLOTS, PROFILING_PHASE_EXECUTION));
+}
+
+TEST(ProfilingTestGroup, ResetClearsStatistics)
+{
+    profiling_set_command(2);
+    profiling_record(PROFILING_PHASE_CRC, 100);
+    profiling_reset();
+
+    CHECK_EQUAL(0, profiling_get_entry(2, PROFILING_PHASE_CRC)->count);
+}
+
+TEST(ProfilingTestGroup, StatsAreSerialized)
+{
+    uint32_t size, frequency, value;
+    char key[16];
+
+    profiling_set_command(3);
+    profiling_record(PROFILING_PHASE_FLASH_ERASE, 100);
+    profiling_record(PROFILING_PHASE_FLASH_ERASE, 300);
+
+    command_get_profiling_stats(0, NULL, &ctx, NULL);
+    cmp_mem_access_set_pos(&cma, 0);
+
+    cmp_read_map(&ctx, &size);
+    CHECK_EQUAL(2, size);
+
+    size = sizeof key;
+    cmp_read_str(&ctx, key, &size);
+    STRCMP_EQUAL("frequency", key);
+    cmp_read_uint(&ctx, &frequency);
+    CHECK_EQUAL(1000000000, frequency);
+
+    size = sizeof key;
+    cmp_read_str(&ctx, key, &size);
+    STRCMP_EQUAL("stats", key);
+    cmp_read_array(&ctx, &size);
+    CHECK_EQUAL(1, size);
+
+    cmp_read_array(&ctx, &size);
+    CHECK_EQUAL(6, size);
+    uint32_t expected[] = {3, PROFILING_PHASE_FLASH_ERASE, 2, 100, 200, 300};
+    for (int i = 0; i < 6; i++) {
+        cmp_read_uint(&ctx, &value);
+        CHECK_EQUAL(expected[i], value);
+    }
+}
+
+TEST(ProfilingTestGroup, StatsCanBeResetAfterReading)
+{
+    cmp_mem_access_t arg_cma;
+    cmp_ctx_t arg_ctx;
+    char arg_data[8];
+    cmp_mem_access_init(&arg_ctx, &arg_cma, arg_data, sizeof arg_data);
+    cmp_write_bool(&arg_ctx, true);
+    cmp_mem_access_set_pos(&arg_cma, 0);
+
+    profiling_set_command(5);
+    profiling_record(PROFILING_PHASE_EXECUTION, 1);
+
+    command_get_profiling_stats(1, &arg_ctx, &ctx, NULL);
+
+    CHECK_EQUAL(0, profiling_get_entry(5, PROFILING_PHASE_EXECUTION)->count);
+}
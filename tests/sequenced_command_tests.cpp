@@ -0,0 +1,159 @@
+#include <cstring>
+#include <CppUTest/TestHarness.h>
+#include <cmp_mem_access/cmp_mem_access.h>
+
+#include "../command.h"
+#include "../error.h"
+#include "../can_datagram.h"
+
+
+TEST_GROUP(SequencedCommandTestGroup)
+{
+    cmp_mem_access_t command_cma;
+    cmp_ctx_t command_builder;
+    char command_data[32];
+    size_t command_len;
+
+    cmp_mem_access_t arg_cma;
+    cmp_ctx_t arg_ctx;
+    char arg_data[64];
+
+    cmp_mem_access_t out_cma;
+    cmp_ctx_t out_ctx;
+    char out_data[64];
+
+    bootloader_config_t config;
+
+    void setup()
+    {
+        command_sequenced_reset();
+        command_set_source(0);
+        memset(&config, 0, sizeof config);
+
+        cmp_mem_access_init(&out_ctx, &out_cma, out_data, sizeof out_data);
+        memset(out_data, 0, sizeof out_data);
+    }
+
+    void encode_config_update(uint32_t id)
+    {
+        cmp_mem_access_init(&command_builder, &command_cma, command_data, sizeof command_data);
+        cmp_write_uint(&command_builder, COMMAND_SET_VERSION);
+        cmp_write_uint(&command_builder, 7);
+        cmp_write_array(&command_builder, 1);
+        cmp_write_map(&command_builder, 1);
+        cmp_write_str(&command_builder, "ID", 2);
+        cmp_write_uint(&command_builder, id);
+        command_len = cmp_mem_access_get_pos(&command_cma);
+    }
+
+    void execute(uint32_t token)
+    {
+        cmp_mem_access_init(&arg_ctx, &arg_cma, arg_data, sizeof arg_data);
+        cmp_write_uint(&arg_ctx, token);
+        cmp_write_bin(&arg_ctx, command_data, command_len);
+        cmp_mem_access_set_pos(&arg_cma, 0);
+
+        cmp_mem_access_set_pos(&out_cma, 0);
+        command_sequenced(2, &arg_ctx, &out_ctx, &config);
+        cmp_mem_access_set_pos(&out_cma, 0);
+    }
+};
+
+TEST(SequencedCommandTestGroup, CommandIsExecuted)
+{
+    bool reply;
+    encode_config_update(42);
+
+    execute(1);
+
+    CHECK_EQUAL(42, config.ID);
+    CHECK_TRUE(cmp_read_bool(&out_ctx, &reply));
+    CHECK_TRUE(reply);
+}
+
+TEST(SequencedCommandTestGroup, DuplicateTokenIsNotExecutedTwice)
+{
+    bool reply;
+    encode_config_update(42);
+    execute(1);
+
+    config.ID = 10;
+    execute(1);
+
+    CHECK_EQUAL(10, config.ID);
+    CHECK_TRUE(cmp_read_bool(&out_ctx, &reply));
+    CHECK_TRUE(reply);
+}
+
+TEST(SequencedCommandTestGroup, NewTokenIsExecuted)
+{
+    encode_config_update(42);
+    execute(1);
+
+    encode_config_update(43);
+    execute(2);
+
+    CHECK_EQUAL(43, config.ID);
+}
+
+TEST(SequencedCommandTestGroup, SameTokenOfAnotherSourceIsExecuted)
+{
+    encode_config_update(42);
+    command_set_source(CLIENT_ID_MIN);
+    execute(1);
+
+    encode_config_update(43);
+    command_set_source(CLIENT_ID_MIN + 1);
+    execute(1);
+
+    CHECK_EQUAL(43, config.ID);
+}
+
+TEST(SequencedCommandTestGroup, DuplicateTokenIsReplayedPerSource)
+{
+    encode_config_update(42);
+    command_set_source(CLIENT_ID_MIN);
+    execute(1);
+
+    encode_config_update(43);
+    command_set_source(0);
+    execute(1);
+
+    config.ID = 10;
+    encode_config_update(42);
+    command_set_source(CLIENT_ID_MIN);
+    execute(1);
+
+    CHECK_EQUAL(10, config.ID);
+}
+
+TEST(SequencedCommandTestGroup, ErrorIsReplayedAsCode)
+{
+    uint32_t reply;
+
+    // Unknown command index
+    cmp_mem_access_init(&command_builder, &command_cma, command_data, sizeof command_data);
+    cmp_write_uint(&command_builder, COMMAND_SET_VERSION);
+    cmp_write_uint(&command_builder, 100);
+    cmp_write_array(&command_builder, 0);
+    command_len = cmp_mem_access_get_pos(&command_cma);
+
+    execute(1);
+    CHECK_TRUE(cmp_read_uint(&out_ctx, &reply));
+    CHECK_EQUAL(ERR_COMMAND_NOT_FOUND, reply);
+
+    execute(1);
+    CHECK_TRUE(cmp_read_uint(&out_ctx, &reply));
+    CHECK_EQUAL(ERR_COMMAND_NOT_FOUND, reply);
+}
+
+TEST(SequencedCommandTestGroup, MissingArgumentsAreRejected)
+{
+    uint32_t reply;
+
+    command_sequenced(0, NULL, &out_ctx, &config);
+    cmp_mem_access_set_pos(&out_cma, 0);
+
+    cmp_read_uint(&out_ctx, &reply);
+    CHECK_EQUAL(ERR_INVALID_COMMAND, reply);
+}